@@ -0,0 +1,213 @@
+#include <stb_image.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "texture_container.hpp"
+
+// Bakes a demo's assets directory into the layout its runtime loads:
+// images become .gtex containers with a gamma-correct mip chain, already
+// flipped bottom-up, and every other file is copied as is. Inputs whose
+// content hash matches the manifest from the last run are skipped, the
+// rest are spread over one worker per core.
+//
+//   asset_baker <source dir> <output dir>
+
+namespace fs = std::filesystem;
+
+// bump whenever the baked output changes for the same input
+const uint64_t BAKE_VERSION = 1;
+const char* BAKE_MANIFEST = ".bake_manifest";
+
+enum class BakeResult { Skipped, Baked, Copied, Failed };
+
+struct Asset {
+  fs::path source;
+  std::string relativePath;
+  fs::path output;
+  bool image;
+  uint64_t hash = 0;
+  BakeResult result = BakeResult::Failed;
+};
+
+bool isImagePath(const fs::path& path) {
+  std::string ext = path.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+  return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".tga" || ext == ".bmp";
+}
+
+// FNV-1a over the file contents, seeded with BAKE_VERSION
+uint64_t hashAsset(const std::vector<char>& bytes) {
+  uint64_t hash = 14695981039346656037ull ^ BAKE_VERSION;
+  for (char c : bytes) {
+    hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+  }
+  return hash;
+}
+
+bool readFile(const fs::path& path, std::vector<char>& bytes) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open()) {
+    return false;
+  }
+  bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  return !in.bad();
+}
+
+// Writes to a temporary name first so an interrupted bake never leaves a
+// truncated output behind that a later run would then skip.
+bool writeFileAtomically(const fs::path& path, const std::vector<char>& bytes) {
+  fs::path tmpPath = path;
+  tmpPath += ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      return false;
+    }
+    out.write(bytes.data(), bytes.size());
+    if (!out.good()) {
+      return false;
+    }
+  }
+  std::error_code error;
+  fs::rename(tmpPath, path, error);
+  return !error;
+}
+
+bool bakeImage(const std::vector<char>& bytes, const fs::path& output) {
+  int width, height, channels;
+  unsigned char* pixels = stbi_load_from_memory((const stbi_uc*)bytes.data(), (int)bytes.size(), &width, &height, &channels, 0);
+  if (!pixels) {
+    return false;
+  }
+  // grey and grey+alpha images are widened, the runtime only takes RGB(A)
+  if (channels < 3) {
+    stbi_image_free(pixels);
+    int wantChannels = channels == 2 ? 4 : 3;
+    pixels = stbi_load_from_memory((const stbi_uc*)bytes.data(), (int)bytes.size(), &width, &height, &channels, wantChannels);
+    channels = wantChannels;
+    if (!pixels) {
+      return false;
+    }
+  }
+
+  std::vector<char> file = serializeTextureContainer(buildTextureMipChain(pixels, width, height, channels));
+  stbi_image_free(pixels);
+  return writeFileAtomically(output, file);
+}
+
+void bakeAsset(Asset& asset, const std::unordered_map<std::string, uint64_t>& manifest) {
+  std::vector<char> bytes;
+  if (!readFile(asset.source, bytes)) {
+    std::cout << "ERROR! couldn't read the asset: " << asset.source << std::endl;
+    return;
+  }
+  asset.hash = hashAsset(bytes);
+  auto previous = manifest.find(asset.relativePath);
+  if (previous != manifest.end() && previous->second == asset.hash && fs::exists(asset.output)) {
+    asset.result = BakeResult::Skipped;
+    return;
+  }
+  if (asset.image) {
+    asset.result = bakeImage(bytes, asset.output) ? BakeResult::Baked : BakeResult::Failed;
+  } else {
+    asset.result = writeFileAtomically(asset.output, bytes) ? BakeResult::Copied : BakeResult::Failed;
+  }
+  if (asset.result == BakeResult::Failed) {
+    std::cout << "ERROR! couldn't bake the asset: " << asset.source << std::endl;
+  }
+}
+
+std::unordered_map<std::string, uint64_t> readManifest(const fs::path& path) {
+  std::unordered_map<std::string, uint64_t> manifest;
+  std::ifstream in(path);
+  std::string hash, relativePath;
+  while (in >> hash && std::getline(in >> std::ws, relativePath)) {
+    manifest[relativePath] = std::stoull(hash, nullptr, 16);
+  }
+  return manifest;
+}
+
+bool writeManifest(const fs::path& path, const std::vector<Asset>& assets) {
+  std::string text;
+  char hash[17];
+  for (const Asset& asset : assets) {
+    // failed assets are left out so the next run retries them
+    if (asset.result != BakeResult::Failed) {
+      snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)asset.hash);
+      text += std::string(hash) + " " + asset.relativePath + "\n";
+    }
+  }
+  return writeFileAtomically(path, std::vector<char>(text.begin(), text.end()));
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    std::cout << "usage: asset_baker <source dir> <output dir>" << std::endl;
+    return 1;
+  }
+  auto start = std::chrono::steady_clock::now();
+  fs::path sourceDir = argv[1], outputDir = argv[2];
+  std::error_code error;
+  if (!fs::is_directory(sourceDir, error)) {
+    std::cout << "ERROR! not a directory: " << sourceDir << std::endl;
+    return 1;
+  }
+
+  std::vector<Asset> assets;
+  for (const fs::directory_entry& entry : fs::recursive_directory_iterator(sourceDir)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    Asset asset;
+    asset.source = entry.path();
+    fs::path relative = fs::relative(entry.path(), sourceDir);
+    asset.relativePath = relative.generic_string();
+    asset.image = isImagePath(relative);
+    asset.output = outputDir / (asset.image ? fs::path(relative).replace_extension(".gtex") : relative);
+    // created up front so the workers never race on directories
+    fs::create_directories(asset.output.parent_path(), error);
+    assets.push_back(asset);
+  }
+  std::unordered_map<std::string, uint64_t> manifest = readManifest(outputDir / BAKE_MANIFEST);
+
+  unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency());
+  workerCount = std::min<unsigned int>(workerCount, std::max<size_t>(1, assets.size()));
+  std::atomic<size_t> nextAsset{0};
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < workerCount; i++) {
+    workers.emplace_back([&] {
+      // containers store rows bottom-up, like the runtime used to load them
+      stbi_set_flip_vertically_on_load_thread(true);
+      for (size_t index = nextAsset++; index < assets.size(); index = nextAsset++) {
+        bakeAsset(assets[index], manifest);
+      }
+    });
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+
+  int counts[4] = {};
+  for (const Asset& asset : assets) {
+    counts[(int)asset.result]++;
+  }
+  if (!writeManifest(outputDir / BAKE_MANIFEST, assets)) {
+    std::cout << "ERROR! couldn't write the bake manifest in: " << outputDir << std::endl;
+    return 1;
+  }
+  std::cout << "baked " << sourceDir.string() << ": " << counts[(int)BakeResult::Baked] << " images, "
+    << counts[(int)BakeResult::Copied] << " copied, " << counts[(int)BakeResult::Skipped] << " unchanged, "
+    << counts[(int)BakeResult::Failed] << " failed in "
+    << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms on "
+    << workerCount << " threads" << std::endl;
+  return counts[(int)BakeResult::Failed] > 0 ? 1 : 0;
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "asset_pack_format.hpp"
+
+// Packs the files a demo reads at runtime into a single .gpak (see
+// asset_pack_format.hpp) so it maps one file at launch instead of opening
+// each shader and texture on its own. Names are the paths relative to
+// <root dir>, which is the directory the demo runs from.
+//
+//   asset_packer <out.gpak> <root dir> <subdir>...
+
+namespace fs = std::filesystem;
+
+struct PackedFile {
+  std::string name;
+  fs::path path;
+  uint64_t size;
+};
+
+uint64_t alignOffset(uint64_t offset) {
+  return (offset + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    std::cout << "usage: asset_packer <out.gpak> <root dir> <subdir>..." << std::endl;
+    return 1;
+  }
+  auto start = std::chrono::steady_clock::now();
+  fs::path packPath = argv[1], rootDir = argv[2];
+  std::error_code error;
+
+  std::vector<PackedFile> files;
+  for (int i = 3; i < argc; i++) {
+    fs::path dir = rootDir / argv[i];
+    if (!fs::is_directory(dir, error)) {
+      std::cout << "ERROR! not a directory: " << dir << std::endl;
+      return 1;
+    }
+    // symlinked directories (the demos link shaders/) are followed
+    for (const fs::directory_entry& entry :
+         fs::recursive_directory_iterator(dir, fs::directory_options::follow_directory_symlink)) {
+      // bake bookkeeping and half written outputs are not assets
+      if (!entry.is_regular_file() || entry.path().filename().string()[0] == '.' || entry.path().extension() == ".tmp") {
+        continue;
+      }
+      std::string name = fs::relative(entry.path(), rootDir).lexically_normal().generic_string();
+      files.push_back({name, entry.path(), entry.file_size()});
+    }
+  }
+  // the runtime binary searches the index
+  std::sort(files.begin(), files.end(), [](const PackedFile& a, const PackedFile& b) { return a.name < b.name; });
+
+  AssetPackHeader header = {{'G', 'P', 'A', 'K'}, ASSET_PACK_VERSION, (uint32_t)files.size(), 0, 0, 0};
+  std::vector<AssetPackEntry> entries(files.size());
+  std::string names;
+  header.indexOffset = sizeof(header);
+  header.namesOffset = header.indexOffset + entries.size() * sizeof(AssetPackEntry);
+  for (size_t i = 0; i < files.size(); i++) {
+    entries[i].nameOffset = names.size();
+    entries[i].nameLength = (uint32_t)files[i].name.size();
+    names += files[i].name;
+  }
+  uint64_t offset = header.namesOffset + names.size();
+  for (size_t i = 0; i < files.size(); i++) {
+    entries[i].dataOffset = alignOffset(offset);
+    entries[i].dataSize = files[i].size;
+    offset = entries[i].dataOffset + entries[i].dataSize + 1;
+  }
+
+  // written to a temporary name first so a running demo never maps a
+  // half written pack
+  fs::path tmpPath = packPath;
+  tmpPath += ".tmp";
+  {
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+      std::cout << "ERROR! couldn't write the asset pack: " << tmpPath << std::endl;
+      return 1;
+    }
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)entries.data(), entries.size() * sizeof(AssetPackEntry));
+    out.write(names.data(), names.size());
+    uint64_t written = header.namesOffset + names.size();
+    std::vector<char> bytes;
+    for (size_t i = 0; i < files.size(); i++) {
+      std::ifstream in(files[i].path, std::ios::binary);
+      bytes.resize(files[i].size);
+      if (!in.read(bytes.data(), bytes.size())) {
+        std::cout << "ERROR! couldn't read the asset: " << files[i].path << std::endl;
+        return 1;
+      }
+      // padding up to the blob, then the blob and its null byte
+      bytes.push_back(0);
+      out.write(std::string(entries[i].dataOffset - written, '\0').data(), entries[i].dataOffset - written);
+      out.write(bytes.data(), bytes.size());
+      written = entries[i].dataOffset + bytes.size();
+    }
+    if (!out.good()) {
+      std::cout << "ERROR! couldn't write the asset pack: " << tmpPath << std::endl;
+      return 1;
+    }
+  }
+  fs::rename(tmpPath, packPath, error);
+  if (error) {
+    std::cout << "ERROR! couldn't write the asset pack: " << packPath << std::endl;
+    return 1;
+  }
+  std::cout << "packed " << files.size() << " files into " << packPath.string() << " (" << offset / 1024 << " KiB) in "
+    << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+  return 0;
+}
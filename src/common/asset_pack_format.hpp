@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+// Asset pack (.gpak): a header, an index of entries sorted bytewise by
+// name (the asset's path relative to the program, e.g.
+// "shaders/sdf.glsl"), the names themselves, then the blobs. Each blob
+// starts on an ASSET_PACK_ALIGNMENT boundary and is followed by a null
+// byte that its size does not count, so text can be used in place. The
+// whole file is mmapped once and assets are handed out as views into it.
+const uint32_t ASSET_PACK_VERSION = 1;
+const uint32_t ASSET_PACK_ALIGNMENT = 64;
+
+struct AssetPackHeader {
+  char magic[4];         // "GPAK"
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t reserved;
+  uint64_t indexOffset;  // entryCount AssetPackEntry records
+  uint64_t namesOffset;
+};
+struct AssetPackEntry {
+  uint64_t nameOffset;   // from namesOffset, not null terminated
+  uint32_t nameLength;
+  uint32_t reserved;
+  uint64_t dataOffset;   // from the start of the file
+  uint64_t dataSize;
+};
+static_assert(sizeof(AssetPackHeader) == 32, "on-disk header layout");
+static_assert(sizeof(AssetPackEntry) == 32, "on-disk index layout");
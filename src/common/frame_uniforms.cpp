@@ -0,0 +1,21 @@
+#include <glad/glad.h>
+#include "frame_uniforms.hpp"
+#include "gl_state.hpp"
+
+FrameUniformBuffer::FrameUniformBuffer() {
+  glGenBuffers(1, &bufferId);
+  glState.bindBuffer(GL_UNIFORM_BUFFER, bufferId);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+  glState.bindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, bufferId);
+  glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+FrameUniformBuffer::~FrameUniformBuffer() {
+  glState.deleteBuffers(1, &bufferId);
+}
+
+void FrameUniformBuffer::update(const FrameUniforms& data) {
+  glState.bindBuffer(GL_UNIFORM_BUFFER, bufferId);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &data);
+  glState.bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+
+// Binding point of the FrameData block. Shader binds the block of every
+// program that declares it here, so one buffer feeds all programs.
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+// CPU mirror of the std140 block shared by the shaders:
+//
+//   layout (std140) uniform FrameData {
+//     mat4 view;
+//     mat4 projection;
+//     vec3 camPos;
+//     float time;   // packs into camPos' 4th component
+//     mat3 camRot;  // each column padded to a vec4
+//   };
+struct FrameUniforms {
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec3 camPos;
+  float time;
+  glm::vec4 camRot[3];
+
+  void setCamRot(const glm::mat3& rot) {
+    for (int i = 0; i < 3; i++) {
+      camRot[i] = glm::vec4(rot[i], 0.0f);
+    }
+  }
+};
+static_assert(offsetof(FrameUniforms, view) == 0, "std140 offset of view");
+static_assert(offsetof(FrameUniforms, projection) == 64, "std140 offset of projection");
+static_assert(offsetof(FrameUniforms, camPos) == 128, "std140 offset of camPos");
+static_assert(offsetof(FrameUniforms, time) == 140, "std140 offset of time");
+static_assert(offsetof(FrameUniforms, camRot) == 144, "std140 offset of camRot");
+static_assert(sizeof(FrameUniforms) == 192, "std140 size of FrameData");
+
+// The uniform buffer behind FrameData, bound once to FRAME_UNIFORMS_BINDING.
+// update() is the only per-frame write regardless of program or draw count.
+class FrameUniformBuffer {
+  public:
+    FrameUniformBuffer();
+    ~FrameUniformBuffer();
+    FrameUniformBuffer(const FrameUniformBuffer&) = delete;
+    FrameUniformBuffer& operator=(const FrameUniformBuffer&) = delete;
+    void update(const FrameUniforms& data);
+  private:
+    GLuint bufferId;
+};
@@ -0,0 +1,51 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "gl_extensions.hpp"
+
+GLExtensions glExt;
+
+PFNGLGETPROGRAMBINARYPROC ext_glGetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC ext_glProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC ext_glProgramParameteri = nullptr;
+PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR = nullptr;
+PFNGLTEXSTORAGE2DPROC ext_glTexStorage2D = nullptr;
+PFNGLTEXSTORAGE3DPROC ext_glTexStorage3D = nullptr;
+PFNGLBUFFERSTORAGEPROC ext_glBufferStorage = nullptr;
+
+bool hasGLVersion(int major, int minor) {
+  return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+void loadGLExtensions() {
+  if (hasGLVersion(4, 1) || glfwExtensionSupported("GL_ARB_get_program_binary")) {
+    ext_glGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)glfwGetProcAddress("glGetProgramBinary");
+    ext_glProgramBinary = (PFNGLPROGRAMBINARYPROC)glfwGetProcAddress("glProgramBinary");
+    ext_glProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)glfwGetProcAddress("glProgramParameteri");
+    // a driver may expose the API but support zero binary formats
+    GLint formatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    glExt.programBinary = ext_glGetProgramBinary && ext_glProgramBinary && ext_glProgramParameteri && formatCount > 0;
+  }
+
+  if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+    ext_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+  } else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+    ext_glMaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+  }
+  if (ext_glMaxShaderCompilerThreadsKHR) {
+    // let the driver pick how many compiler threads to use
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    glExt.parallelShaderCompile = true;
+  }
+
+  if (hasGLVersion(4, 2) || glfwExtensionSupported("GL_ARB_texture_storage")) {
+    ext_glTexStorage2D = (PFNGLTEXSTORAGE2DPROC)glfwGetProcAddress("glTexStorage2D");
+    ext_glTexStorage3D = (PFNGLTEXSTORAGE3DPROC)glfwGetProcAddress("glTexStorage3D");
+    glExt.textureStorage = ext_glTexStorage2D && ext_glTexStorage3D;
+  }
+
+  if (hasGLVersion(4, 4) || glfwExtensionSupported("GL_ARB_buffer_storage")) {
+    ext_glBufferStorage = (PFNGLBUFFERSTORAGEPROC)glfwGetProcAddress("glBufferStorage");
+    glExt.bufferStorage = ext_glBufferStorage != nullptr;
+  }
+}
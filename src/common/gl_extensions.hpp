@@ -0,0 +1,59 @@
+#pragma once
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// glad was generated for plain GL 3.3 core, so entry points from newer
+// versions/extensions are loaded here by hand. Call loadGLExtensions()
+// right after gladLoadGLLoader; a function is only usable when its flag
+// in glExt is set.
+
+// GL_ARB_get_program_binary (core in 4.1)
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+extern PFNGLGETPROGRAMBINARYPROC ext_glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC ext_glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC ext_glProgramParameteri;
+#define glGetProgramBinary ext_glGetProgramBinary
+#define glProgramBinary ext_glProgramBinary
+#define glProgramParameteri ext_glProgramParameteri
+
+// GL_KHR_parallel_shader_compile / GL_ARB_parallel_shader_compile
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+extern PFNGLMAXSHADERCOMPILERTHREADSKHRPROC ext_glMaxShaderCompilerThreadsKHR;
+#define glMaxShaderCompilerThreadsKHR ext_glMaxShaderCompilerThreadsKHR
+
+// GL_ARB_texture_storage (core in 4.2)
+#define GL_TEXTURE_IMMUTABLE_FORMAT 0x912F
+typedef void (APIENTRYP PFNGLTEXSTORAGE2DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height);
+typedef void (APIENTRYP PFNGLTEXSTORAGE3DPROC)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth);
+extern PFNGLTEXSTORAGE2DPROC ext_glTexStorage2D;
+extern PFNGLTEXSTORAGE3DPROC ext_glTexStorage3D;
+#define glTexStorage2D ext_glTexStorage2D
+#define glTexStorage3D ext_glTexStorage3D
+
+// GL_ARB_buffer_storage (core in 4.4)
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#define GL_BUFFER_IMMUTABLE_STORAGE 0x821F
+#define GL_BUFFER_STORAGE_FLAGS 0x8220
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+extern PFNGLBUFFERSTORAGEPROC ext_glBufferStorage;
+#define glBufferStorage ext_glBufferStorage
+
+struct GLExtensions {
+  bool programBinary = false;
+  bool parallelShaderCompile = false;
+  bool textureStorage = false;
+  bool bufferStorage = false;
+};
+extern GLExtensions glExt;
+
+void loadGLExtensions();
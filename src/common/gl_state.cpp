@@ -0,0 +1,301 @@
+#include <cstddef>
+#include <sstream>
+#include "gl_state.hpp"
+
+GLStateCache glState;
+
+namespace {
+const GLenum BUFFER_TARGET_LIST[] = {
+  GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+  GL_PIXEL_PACK_BUFFER, GL_PIXEL_UNPACK_BUFFER, GL_COPY_WRITE_BUFFER,
+};
+const GLenum TEXTURE_TARGET_LIST[] = {GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP};
+const GLenum CAPABILITY_LIST[] = {GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_STENCIL_TEST};
+const int ELEMENT_ARRAY = 1;
+
+template <size_t N>
+int indexOf(const GLenum (&list)[N], GLenum value) {
+  for (size_t i = 0; i < N; i++) {
+    if (list[i] == value) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+}
+
+const char* GLStateCache::kindName(Kind kind) {
+  const char* names[] = {"program", "vertex array", "buffer", "texture", "framebuffer", "fixed function"};
+  return names[kind];
+}
+
+uint64_t GLStateCache::Counters::totalIssued() const {
+  uint64_t sum = 0;
+  for (uint64_t count : issued) {
+    sum += count;
+  }
+  return sum;
+}
+
+uint64_t GLStateCache::Counters::totalFiltered() const {
+  uint64_t sum = 0;
+  for (uint64_t count : filtered) {
+    sum += count;
+  }
+  return sum;
+}
+
+std::string GLStateCache::summary(const Counters& counters, uint64_t frames) {
+  frames = frames ? frames : 1;
+  std::ostringstream out;
+  out << (double)counters.totalIssued() / frames << " issued, " << (double)counters.totalFiltered() / frames
+    << " filtered per frame (";
+  const char* separator = "";
+  for (int kind = 0; kind < KIND_COUNT; kind++) {
+    if (counters.issued[kind] || counters.filtered[kind]) {
+      out << separator << kindName((Kind)kind) << " " << (double)counters.issued[kind] / frames << "/"
+        << (double)counters.filtered[kind] / frames;
+      separator = ", ";
+    }
+  }
+  out << ")";
+  return out.str();
+}
+
+// Counts the call and says whether to drop it.
+bool GLStateCache::filter(Kind kind, bool redundant) {
+  if (redundant) {
+    currentFrame.filtered[kind]++;
+  } else {
+    currentFrame.issued[kind]++;
+  }
+  return redundant;
+}
+
+void GLStateCache::useProgram(GLuint newProgram) {
+  if (filter(PROGRAM, program == newProgram)) {
+    return;
+  }
+  glUseProgram(newProgram);
+  program = newProgram;
+}
+
+void GLStateCache::bindVertexArray(GLuint newVertexArray) {
+  if (filter(VERTEX_ARRAY, vertexArray == newVertexArray)) {
+    return;
+  }
+  glBindVertexArray(newVertexArray);
+  vertexArray = newVertexArray;
+  buffers[ELEMENT_ARRAY] = UNKNOWN;
+}
+
+void GLStateCache::bindBuffer(GLenum target, GLuint buffer) {
+  int slot = indexOf(BUFFER_TARGET_LIST, target);
+  if (filter(BUFFER, slot >= 0 && buffers[slot] == buffer)) {
+    return;
+  }
+  glBindBuffer(target, buffer);
+  if (slot >= 0) {
+    buffers[slot] = buffer;
+  }
+}
+
+void GLStateCache::bindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+  filter(BUFFER, false);
+  glBindBufferBase(target, index, buffer);
+  int slot = indexOf(BUFFER_TARGET_LIST, target);
+  if (slot >= 0) {
+    buffers[slot] = buffer;
+  }
+}
+
+void GLStateCache::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+  filter(BUFFER, false);
+  glBindBufferRange(target, index, buffer, offset, size);
+  int slot = indexOf(BUFFER_TARGET_LIST, target);
+  if (slot >= 0) {
+    buffers[slot] = buffer;
+  }
+}
+
+void GLStateCache::activeTexture(GLenum unit) {
+  if (filter(TEXTURE, activeUnit == unit)) {
+    return;
+  }
+  glActiveTexture(unit);
+  activeUnit = unit;
+}
+
+void GLStateCache::bindTexture(GLenum target, GLuint texture) {
+  int slot = indexOf(TEXTURE_TARGET_LIST, target);
+  int unit = activeUnit == UNKNOWN ? -1 : (int)(activeUnit - GL_TEXTURE0);
+  bool tracked = slot >= 0 && unit >= 0 && unit < TEXTURE_UNITS;
+  if (filter(TEXTURE, tracked && textures[unit][slot] == texture)) {
+    return;
+  }
+  glBindTexture(target, texture);
+  if (tracked) {
+    textures[unit][slot] = texture;
+  } else if (slot >= 0 && activeUnit == UNKNOWN) {
+    // landed on some unit
+    for (GLuint (&unitTextures)[TEXTURE_TARGETS] : textures) {
+      unitTextures[slot] = UNKNOWN;
+    }
+  }
+}
+
+void GLStateCache::bindFramebuffer(GLenum target, GLuint framebuffer) {
+  bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+  bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+  if (filter(FRAMEBUFFER, (!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer))) {
+    return;
+  }
+  glBindFramebuffer(target, framebuffer);
+  if (draw) {
+    drawFramebuffer = framebuffer;
+  }
+  if (read) {
+    readFramebuffer = framebuffer;
+  }
+}
+
+void GLStateCache::enable(GLenum capability) {
+  int slot = indexOf(CAPABILITY_LIST, capability);
+  if (filter(FIXED_FUNCTION, slot >= 0 && capabilities[slot] == 1)) {
+    return;
+  }
+  glEnable(capability);
+  if (slot >= 0) {
+    capabilities[slot] = 1;
+  }
+}
+
+void GLStateCache::disable(GLenum capability) {
+  int slot = indexOf(CAPABILITY_LIST, capability);
+  if (filter(FIXED_FUNCTION, slot >= 0 && capabilities[slot] == 0)) {
+    return;
+  }
+  glDisable(capability);
+  if (slot >= 0) {
+    capabilities[slot] = 0;
+  }
+}
+
+void GLStateCache::blendFunc(GLenum sourceFactor, GLenum destinationFactor) {
+  if (filter(FIXED_FUNCTION, blendSource == sourceFactor && blendDestination == destinationFactor)) {
+    return;
+  }
+  glBlendFunc(sourceFactor, destinationFactor);
+  blendSource = sourceFactor;
+  blendDestination = destinationFactor;
+}
+
+void GLStateCache::depthFunc(GLenum func) {
+  if (filter(FIXED_FUNCTION, depthCompare == func)) {
+    return;
+  }
+  glDepthFunc(func);
+  depthCompare = func;
+}
+
+void GLStateCache::depthMask(GLboolean flag) {
+  if (filter(FIXED_FUNCTION, depthWrite == (flag ? 1 : 0))) {
+    return;
+  }
+  glDepthMask(flag);
+  depthWrite = flag ? 1 : 0;
+}
+
+void GLStateCache::polygonMode(GLenum face, GLenum mode) {
+  // core profiles only take GL_FRONT_AND_BACK
+  if (filter(FIXED_FUNCTION, face == GL_FRONT_AND_BACK && polygonFill == mode)) {
+    return;
+  }
+  glPolygonMode(face, mode);
+  polygonFill = face == GL_FRONT_AND_BACK ? mode : UNKNOWN;
+}
+
+// A program in use is only flagged for deletion and stays in use, so its
+// name can't come back while cached.
+void GLStateCache::deleteProgram(GLuint deleted) {
+  glDeleteProgram(deleted);
+}
+
+void GLStateCache::deleteVertexArrays(GLsizei count, const GLuint* vertexArrays) {
+  glDeleteVertexArrays(count, vertexArrays);
+  for (GLsizei i = 0; i < count; i++) {
+    if (vertexArrays[i] == vertexArray) {
+      vertexArray = 0;
+      buffers[ELEMENT_ARRAY] = UNKNOWN;
+    }
+  }
+}
+
+void GLStateCache::deleteBuffers(GLsizei count, const GLuint* deleted) {
+  glDeleteBuffers(count, deleted);
+  for (GLsizei i = 0; i < count; i++) {
+    for (GLuint& buffer : buffers) {
+      if (buffer == deleted[i]) {
+        buffer = 0;
+      }
+    }
+  }
+}
+
+void GLStateCache::deleteTextures(GLsizei count, const GLuint* deleted) {
+  glDeleteTextures(count, deleted);
+  for (GLsizei i = 0; i < count; i++) {
+    for (GLuint (&unitTextures)[TEXTURE_TARGETS] : textures) {
+      for (GLuint& texture : unitTextures) {
+        if (texture == deleted[i]) {
+          texture = 0;
+        }
+      }
+    }
+  }
+}
+
+void GLStateCache::deleteFramebuffers(GLsizei count, const GLuint* framebuffers) {
+  glDeleteFramebuffers(count, framebuffers);
+  for (GLsizei i = 0; i < count; i++) {
+    if (framebuffers[i] == drawFramebuffer) {
+      drawFramebuffer = 0;
+    }
+    if (framebuffers[i] == readFramebuffer) {
+      readFramebuffer = 0;
+    }
+  }
+}
+
+void GLStateCache::invalidate() {
+  program = UNKNOWN;
+  vertexArray = UNKNOWN;
+  for (GLuint& buffer : buffers) {
+    buffer = UNKNOWN;
+  }
+  activeUnit = UNKNOWN;
+  for (GLuint (&unitTextures)[TEXTURE_TARGETS] : textures) {
+    for (GLuint& texture : unitTextures) {
+      texture = UNKNOWN;
+    }
+  }
+  drawFramebuffer = UNKNOWN;
+  readFramebuffer = UNKNOWN;
+  for (int8_t& capability : capabilities) {
+    capability = -1;
+  }
+  blendSource = blendDestination = UNKNOWN;
+  depthCompare = UNKNOWN;
+  depthWrite = -1;
+  polygonFill = UNKNOWN;
+}
+
+void GLStateCache::endFrame() {
+  for (int kind = 0; kind < KIND_COUNT; kind++) {
+    allFrames.issued[kind] += currentFrame.issued[kind];
+    allFrames.filtered[kind] += currentFrame.filtered[kind];
+  }
+  previousFrame = currentFrame;
+  currentFrame = {};
+  frameCount++;
+}
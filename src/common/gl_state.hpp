@@ -0,0 +1,91 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+
+// Shadow copy of the GL binding and fixed-function state the demo
+// changes, so setting what is already set never reaches the driver. The
+// calls mirror the GL functions they replace. Everything that binds,
+// enables or deletes has to go through glState, otherwise the copy goes
+// stale; code that can't (a library, say) calls invalidate() afterwards.
+//
+// Every call counts as issued or filtered, per kind of state; endFrame()
+// closes a frame's counts so the cost of a frame's state changes can be
+// compared as scenes grow.
+class GLStateCache {
+  public:
+    enum Kind { PROGRAM, VERTEX_ARRAY, BUFFER, TEXTURE, FRAMEBUFFER, FIXED_FUNCTION, KIND_COUNT };
+    static const char* kindName(Kind kind);
+
+    struct Counters {
+      uint64_t issued[KIND_COUNT] = {};
+      uint64_t filtered[KIND_COUNT] = {};
+      uint64_t totalIssued() const;
+      uint64_t totalFiltered() const;
+    };
+
+    static const int TEXTURE_UNITS = 16;
+
+    GLStateCache() { invalidate(); }
+
+    void useProgram(GLuint program);
+    // also switches the GL_ELEMENT_ARRAY_BUFFER binding, which belongs to the VAO
+    void bindVertexArray(GLuint vertexArray);
+    void bindBuffer(GLenum target, GLuint buffer);
+    // indexed bindings always go through, they move the generic binding too
+    void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+    void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    void activeTexture(GLenum unit);
+    // on the active unit, as glBindTexture
+    void bindTexture(GLenum target, GLuint texture);
+    void bindFramebuffer(GLenum target, GLuint framebuffer);
+    void enable(GLenum capability);
+    void disable(GLenum capability);
+    void blendFunc(GLenum sourceFactor, GLenum destinationFactor);
+    void depthFunc(GLenum func);
+    void depthMask(GLboolean flag);
+    void polygonMode(GLenum face, GLenum mode);
+
+    // deleting a bound object unbinds it, GL falls back to 0
+    void deleteProgram(GLuint program);
+    void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays);
+    void deleteBuffers(GLsizei count, const GLuint* buffers);
+    void deleteTextures(GLsizei count, const GLuint* textures);
+    void deleteFramebuffers(GLsizei count, const GLuint* framebuffers);
+
+    // forgets everything, the next call of each kind goes through
+    void invalidate();
+    void endFrame();
+    const Counters& lastFrame() const { return previousFrame; }
+    const Counters& total() const { return allFrames; }
+    uint64_t frames() const { return frameCount; }
+    // "N issued, M filtered per frame (program i/f, ...)" over `frames` frames
+    static std::string summary(const Counters& counters, uint64_t frames = 1);
+
+  private:
+    static const GLuint UNKNOWN = ~0u;
+    // the binding targets and capabilities tracked, others always go through
+    static const int BUFFER_TARGETS = 6;
+    static const int TEXTURE_TARGETS = 4;
+    static const int CAPABILITIES = 5;
+
+    bool filter(Kind kind, bool redundant);
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint buffers[BUFFER_TARGETS];
+    GLenum activeUnit;
+    GLuint textures[TEXTURE_UNITS][TEXTURE_TARGETS];
+    GLuint drawFramebuffer;
+    GLuint readFramebuffer;
+    int8_t capabilities[CAPABILITIES];  // -1 unknown
+    GLenum blendSource, blendDestination;
+    GLenum depthCompare;
+    int8_t depthWrite;
+    GLenum polygonFill;
+
+    Counters currentFrame, previousFrame, allFrames;
+    uint64_t frameCount = 0;
+};
+
+extern GLStateCache glState;
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cmath>
+#include "mip_chain.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const int LINEAR_TO_SRGB_STEPS = 4096;
+
+struct SrgbTables {
+  float toLinear[256];
+  unsigned char fromLinear[LINEAR_TO_SRGB_STEPS];
+
+  SrgbTables() {
+    for (int i = 0; i < 256; i++) {
+      float c = i / 255.0f;
+      toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    for (int i = 0; i < LINEAR_TO_SRGB_STEPS; i++) {
+      float l = i / (float)(LINEAR_TO_SRGB_STEPS - 1);
+      float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+      fromLinear[i] = (unsigned char)std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f);
+    }
+  }
+};
+
+// built on first use, thread-safe as a function local static
+const SrgbTables& srgbTables() {
+  static const SrgbTables tables;
+  return tables;
+}
+
+LinearImage decodeSrgb(const unsigned char* pixels, uint32_t width, uint32_t height, int channels) {
+  const SrgbTables& tables = srgbTables();
+  LinearImage image;
+  image.width = width;
+  image.height = height;
+  image.texels.resize((size_t)width * height * 4);
+  for (size_t i = 0; i < (size_t)width * height; i++) {
+    const unsigned char* src = pixels + i * channels;
+    float* dst = &image.texels[i * 4];
+    dst[0] = tables.toLinear[src[0]];
+    dst[1] = tables.toLinear[src[1]];
+    dst[2] = tables.toLinear[src[2]];
+    dst[3] = channels == 4 ? src[3] / 255.0f : 1.0f;
+  }
+  return image;
+}
+
+LinearImage downsampleLinear(const LinearImage& image) {
+  LinearImage level;
+  level.width = std::max(1u, image.width / 2);
+  level.height = std::max(1u, image.height / 2);
+  level.texels.resize((size_t)level.width * level.height * 4);
+  const float* src = image.texels.data();
+  float* dst = level.texels.data();
+  for (uint32_t y = 0; y < level.height; y++) {
+    const float* row0 = src + (size_t)std::min(2 * y, image.height - 1) * image.width * 4;
+    const float* row1 = src + (size_t)std::min(2 * y + 1, image.height - 1) * image.width * 4;
+    for (uint32_t x = 0; x < level.width; x++) {
+      uint32_t x0 = std::min(2 * x, image.width - 1) * 4, x1 = std::min(2 * x + 1, image.width - 1) * 4;
+      float* out = dst + ((size_t)y * level.width + x) * 4;
+#ifdef __SSE2__
+      // one texel is exactly one register, so all four channels filter at once
+      __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+        _mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+      _mm_storeu_ps(out, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+      for (int c = 0; c < 4; c++) {
+        out[c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+      }
+#endif
+    }
+  }
+  return level;
+}
+
+std::vector<unsigned char> encodeSrgb(const LinearImage& image, int channels) {
+  const SrgbTables& tables = srgbTables();
+  std::vector<unsigned char> pixels((size_t)image.width * image.height * channels);
+  for (size_t i = 0; i < (size_t)image.width * image.height; i++) {
+    const float* src = &image.texels[i * 4];
+    unsigned char* dst = &pixels[i * channels];
+    int steps[4];
+#ifdef __SSE2__
+    const __m128 scale = _mm_setr_ps(LINEAR_TO_SRGB_STEPS - 1, LINEAR_TO_SRGB_STEPS - 1, LINEAR_TO_SRGB_STEPS - 1, 255.0f);
+    __m128 clamped = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    _mm_storeu_si128((__m128i*)steps, _mm_cvtps_epi32(_mm_mul_ps(clamped, scale)));
+#else
+    for (int c = 0; c < 4; c++) {
+      steps[c] = (int)std::lround(std::clamp(src[c], 0.0f, 1.0f) * (c == 3 ? 255.0f : LINEAR_TO_SRGB_STEPS - 1));
+    }
+#endif
+    dst[0] = tables.fromLinear[steps[0]];
+    dst[1] = tables.fromLinear[steps[1]];
+    dst[2] = tables.fromLinear[steps[2]];
+    if (channels == 4) {
+      dst[3] = (unsigned char)steps[3];
+    }
+  }
+  return pixels;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// One mip level in linear light, four floats (RGBA) per texel. Images
+// are filtered in this form so averaging happens on light intensities
+// instead of on sRGB encoded bytes, which would darken every level.
+struct LinearImage {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<float> texels;
+};
+
+// sRGB encoded 8-bit pixels (3 or 4 channels, alpha stays linear) to
+// linear RGBA; 3-channel images get an alpha of 1.
+LinearImage decodeSrgb(const unsigned char* pixels, uint32_t width, uint32_t height, int channels);
+// 2x2 box filter down to the next level, SSE when the target has it.
+// Odd and 1-pixel dimensions reuse the last row/column.
+LinearImage downsampleLinear(const LinearImage& image);
+// Back to tightly packed 8-bit sRGB with `channels` channels.
+std::vector<unsigned char> encodeSrgb(const LinearImage& image, int channels);
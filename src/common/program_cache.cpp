@@ -0,0 +1,146 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "gl_extensions.hpp"
+#include "program_cache.hpp"
+#include "gl_state.hpp"
+
+const char* PROGRAM_CACHE_DIR = "shader_cache";
+const uint32_t PROGRAM_CACHE_MAGIC = 0x31425047; // "GPB1"
+
+ProgramCacheStats programCacheCounts;
+
+// FNV-1a, the terminating null is hashed too so "ab"+"c" != "a"+"bc"
+uint64_t hashCacheText(uint64_t hash, const char* text) {
+  do {
+    hash = (hash ^ (uint8_t)*text) * 1099511628211ull;
+  } while (*text++);
+  return hash;
+}
+
+std::string programCachePath(const std::string& key) {
+  return std::string(PROGRAM_CACHE_DIR) + "/" + key + ".bin";
+}
+
+std::string programCacheKey(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource) {
+  uint64_t hash = 14695981039346656037ull;
+  hash = hashCacheText(hash, vertexShaderSource);
+  hash = hashCacheText(hash, fragmentShaderSource);
+  hash = hashCacheText(hash, (const char*)glGetString(GL_VENDOR));
+  hash = hashCacheText(hash, (const char*)glGetString(GL_RENDERER));
+  hash = hashCacheText(hash, (const char*)glGetString(GL_VERSION));
+  char key[17];
+  snprintf(key, sizeof(key), "%016llx", (unsigned long long)hash);
+  return key;
+}
+
+GLuint loadCachedProgram(const std::string& key) {
+  if (!glExt.programBinary) {
+    return 0;
+  }
+  std::string path = programCachePath(key);
+  std::ifstream in(path, std::ios::binary);
+  if (!in.is_open()) {
+    programCacheCounts.misses++;
+    return 0;
+  }
+  uint32_t magic = 0;
+  GLenum format = 0;
+  in.read((char*)&magic, sizeof(magic));
+  in.read((char*)&format, sizeof(format));
+  if (!in || magic != PROGRAM_CACHE_MAGIC) {
+    programCacheCounts.misses++;
+    return 0;
+  }
+  std::vector<char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (binary.empty()) {
+    programCacheCounts.misses++;
+    return 0;
+  }
+
+  GLuint shaderProgramId = glCreateProgram();
+  glProgramBinary(shaderProgramId, format, binary.data(), binary.size());
+  int success;
+  glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
+  if (!success) {
+    // stale or foreign binary, drop it and let the caller compile from source
+    glState.deleteProgram(shaderProgramId);
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    programCacheCounts.misses++;
+    return 0;
+  }
+  programCacheCounts.hits++;
+  return shaderProgramId;
+}
+
+void storeCachedProgram(GLuint shaderProgramId, const std::string& key) {
+  if (!glExt.programBinary) {
+    return;
+  }
+  GLint length = 0;
+  glGetProgramiv(shaderProgramId, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(shaderProgramId, length, &length, &format, binary.data());
+
+  std::error_code ec;
+  std::filesystem::create_directories(PROGRAM_CACHE_DIR, ec);
+  std::string path = programCachePath(key);
+  std::string tmpPath = path + ".tmp";
+  std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    std::cout << "WARNING! couldn't write the program cache: " << tmpPath << std::endl;
+    return;
+  }
+  out.write((const char*)&PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+  out.write((const char*)&format, sizeof(format));
+  out.write(binary.data(), length);
+  out.close();
+  // rename so a concurrently starting demo never reads a half written file
+  std::filesystem::rename(tmpPath, path, ec);
+}
+
+const ProgramCacheStats& programCacheStats() {
+  return programCacheCounts;
+}
+
+void reportTimeToFirstFrame(const char* demo, double ms) {
+  std::cout << "time to first frame: " << ms << " ms";
+  if (programCacheCounts.hits + programCacheCounts.misses == 0) {
+    std::cout << " (no program binary cache)" << std::endl;
+    return;
+  }
+  bool warm = programCacheCounts.misses == 0;
+  bool cold = programCacheCounts.hits == 0;
+  std::cout << ", " << (warm ? "warm" : cold ? "cold" : "partly cached") << " (" << programCacheCounts.hits << "/"
+    << programCacheCounts.hits + programCacheCounts.misses << " programs from the binary cache)";
+
+  // "<cold ms> <warm ms>", a negative time for one not measured yet
+  std::string path = std::string(PROGRAM_CACHE_DIR) + "/" + demo + ".first_frame";
+  double coldMs = -1.0, warmMs = -1.0;
+  std::ifstream in(path);
+  in >> coldMs >> warmMs;
+  in.close();
+  double otherMs = warm ? coldMs : warmMs;
+  if ((warm || cold) && otherMs >= 0.0) {
+    std::cout << ", last " << (warm ? "cold" : "warm") << " start " << otherMs << " ms";
+  }
+  std::cout << std::endl;
+  if (warm || cold) {
+    (warm ? warmMs : coldMs) = ms;
+    std::error_code ec;
+    std::filesystem::create_directories(PROGRAM_CACHE_DIR, ec);
+    std::ofstream out(path, std::ios::trunc);
+    out << coldMs << " " << warmMs << std::endl;
+  }
+}
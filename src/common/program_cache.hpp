@@ -0,0 +1,23 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+
+// On-disk cache of linked programs in the driver's binary format, kept
+// under shader_cache/ in the working directory. Keys cover both sources
+// and the GL vendor/renderer/version strings, so a driver update simply
+// misses. Delete the directory to measure a cold start.
+std::string programCacheKey(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource);
+// returns 0 when there is no entry or the driver rejects the binary
+GLuint loadCachedProgram(const std::string& key);
+void storeCachedProgram(GLuint shaderProgramId, const std::string& key);
+
+struct ProgramCacheStats {
+  int hits = 0;
+  int misses = 0;
+};
+// lookups since startup; all zero when the driver has no binary formats
+const ProgramCacheStats& programCacheStats();
+// Prints the time to first frame and whether every program came from the
+// cache (warm) or none did (cold). The last cold and warm times of `demo`
+// are kept under shader_cache/, so a warm start also prints the cold one.
+void reportTimeToFirstFrame(const char* demo, double ms);
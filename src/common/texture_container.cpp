@@ -0,0 +1,186 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "gl_extensions.hpp"
+#include "texture_container.hpp"
+#include "gl_state.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Bytes of one tightly packed `width` x `height` level, 0 for a format
+// the loader doesn't know the size of.
+uint64_t containerLevelBytes(const TextureContainerHeader& header, uint32_t width, uint32_t height) {
+  if (header.type != GL_UNSIGNED_BYTE) {
+    return 0;
+  }
+  uint64_t channels;
+  if (header.format == GL_RGB && (header.internalFormat == GL_RGB8 || header.internalFormat == GL_SRGB8)) {
+    channels = 3;
+  } else if (header.format == GL_RGBA && (header.internalFormat == GL_RGBA8 || header.internalFormat == GL_SRGB8_ALPHA8)) {
+    channels = 4;
+  } else {
+    return 0;
+  }
+  return (uint64_t)width * height * channels;
+}
+
+bool validateTextureContainer(const TextureContainer& container) {
+  if (container.size < sizeof(TextureContainerHeader)) {
+    return false;
+  }
+  const TextureContainerHeader* header = container.header;
+  if (memcmp(header->magic, "GTEX", 4) != 0 || header->version != TEXTURE_CONTAINER_VERSION
+      || header->levelCount == 0 || header->levelCount > 32) {
+    return false;
+  }
+  if (sizeof(TextureContainerHeader) + header->levelCount * sizeof(TextureContainerLevel) > container.size) {
+    return false;
+  }
+  for (uint32_t i = 0; i < header->levelCount; i++) {
+    const TextureContainerLevel& level = container.levels[i];
+    // each level is half the one before, rounded down but at least 1,
+    // and nothing comes after 1x1
+    if (i == 0 && (level.width != header->width || level.height != header->height || level.width == 0 || level.height == 0)) {
+      return false;
+    }
+    if (i > 0) {
+      const TextureContainerLevel& previous = container.levels[i - 1];
+      if ((previous.width == 1 && previous.height == 1) || level.width != std::max(1u, previous.width / 2)
+          || level.height != std::max(1u, previous.height / 2)) {
+        return false;
+      }
+    }
+    // written as a subtraction so a huge offset or size can't wrap around
+    if (level.offset % TEXTURE_CONTAINER_ALIGNMENT != 0 || level.offset > container.size
+        || level.size > container.size - level.offset) {
+      return false;
+    }
+    if (level.size == 0 || level.size != containerLevelBytes(*header, level.width, level.height)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool openTextureContainer(const std::string& path, TextureContainer& container) {
+  container = TextureContainer();
+#ifdef __linux__
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  // the whole file is about to be read front to back
+  madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+  madvise(mapped, st.st_size, MADV_WILLNEED);
+  if (!viewTextureContainer((const unsigned char*)mapped, st.st_size, container)) {
+    std::cout << "ERROR! malformed texture container: " << path << std::endl;
+    munmap(mapped, st.st_size);
+    return false;
+  }
+  container.mapped = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool viewTextureContainer(const unsigned char* data, size_t size, TextureContainer& container) {
+  container = TextureContainer();
+  container.data = data;
+  container.size = size;
+  container.header = (const TextureContainerHeader*)data;
+  container.levels = (const TextureContainerLevel*)(data + sizeof(TextureContainerHeader));
+  if (!validateTextureContainer(container)) {
+    container = TextureContainer();
+    return false;
+  }
+  return true;
+}
+
+void closeTextureContainer(TextureContainer& container) {
+#ifdef __linux__
+  if (container.mapped) {
+    munmap((void*)container.data, container.size);
+  }
+#endif
+  container = TextureContainer();
+}
+
+void uploadTextureContainer(GLuint texture, const TextureContainer& container, uint32_t firstLevel) {
+  const TextureContainerHeader* header = container.header;
+  bool compressed = header->format == 0;
+  firstLevel = std::min(firstLevel, header->levelCount - 1);
+  uint32_t levelCount = header->levelCount - firstLevel;
+  GLint unpackAlignment;
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackAlignment);
+  glState.bindTexture(GL_TEXTURE_2D, texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (glExt.textureStorage) {
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, header->internalFormat,
+      container.levels[firstLevel].width, container.levels[firstLevel].height);
+  } else {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+  }
+  for (uint32_t i = 0; i < levelCount; i++) {
+    const TextureContainerLevel& level = container.levels[firstLevel + i];
+    const unsigned char* levelData = container.data + level.offset;
+    if (glExt.textureStorage && compressed) {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, header->internalFormat, level.size, levelData);
+    } else if (glExt.textureStorage) {
+      glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, header->format, header->type, levelData);
+    } else if (compressed) {
+      glCompressedTexImage2D(GL_TEXTURE_2D, i, header->internalFormat, level.width, level.height, 0, level.size, levelData);
+    } else {
+      glTexImage2D(GL_TEXTURE_2D, i, header->internalFormat, level.width, level.height, 0, header->format, header->type, levelData);
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, unpackAlignment);
+}
+
+std::vector<unsigned char> downsampleTextureLevel(const unsigned char* pixels, uint32_t width, uint32_t height, int channels,
+  uint32_t& levelWidth, uint32_t& levelHeight) {
+  uint32_t w = std::max(1u, width / 2), h = std::max(1u, height / 2);
+  std::vector<unsigned char> dst((size_t)w * h * channels);
+  for (uint32_t y = 0; y < h; y++) {
+    for (uint32_t x = 0; x < w; x++) {
+      // clamp so odd and 1-pixel dimensions reuse the last row/column
+      uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+      uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+      for (int c = 0; c < channels; c++) {
+        unsigned int sum = pixels[(y0 * width + x0) * channels + c] + pixels[(y0 * width + x1) * channels + c]
+          + pixels[(y1 * width + x0) * channels + c] + pixels[(y1 * width + x1) * channels + c];
+        dst[(y * w + x) * channels + c] = (sum + 2) / 4;
+      }
+    }
+  }
+  levelWidth = w;
+  levelHeight = h;
+  return dst;
+}
+
+std::string textureContainerPath(const std::string& imgPath) {
+  size_t dot = imgPath.find_last_of('.');
+  size_t slash = imgPath.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return imgPath + ".gtex";
+  }
+  return imgPath.substr(0, dot) + ".gtex";
+}
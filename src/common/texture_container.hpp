@@ -0,0 +1,52 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "texture_container_format.hpp"
+
+// A read-only mapping of a container file.
+struct TextureContainer {
+  const unsigned char* data = nullptr;
+  size_t size = 0;
+  const TextureContainerHeader* header = nullptr;
+  const TextureContainerLevel* levels = nullptr;
+  bool mapped = false;  // owns the mapping, false for a view into other memory
+};
+
+// Maps and validates `path`. Returns false (and leaves `container` empty)
+// when the file is missing or malformed.
+bool openTextureContainer(const std::string& path, TextureContainer& container);
+// Validates a container that is already in memory, e.g. inside an asset
+// pack. `data` must outlive the container.
+bool viewTextureContainer(const unsigned char* data, size_t size, TextureContainer& container);
+void closeTextureContainer(TextureContainer& container);
+// Uploads every level from `firstLevel` down into `texture`, using
+// immutable glTexStorage2D storage when the driver has it. Skipping levels
+// loads the texture at reduced resolution. Must run on the GL thread.
+void uploadTextureContainer(GLuint texture, const TextureContainer& container, uint32_t firstLevel = 0);
+
+// Box filters tightly packed 8-bit pixels down to the next mip level; odd
+// and 1-pixel dimensions reuse the last row/column.
+std::vector<unsigned char> downsampleTextureLevel(const unsigned char* pixels, uint32_t width, uint32_t height, int channels,
+  uint32_t& levelWidth, uint32_t& levelHeight);
+
+// The levels of an uncompressed container, base level first, each one
+// tightly packed 8-bit pixels with `channels` (3 or 4) channels.
+struct TextureMipChain {
+  int channels = 0;
+  std::vector<TextureContainerLevel> table;  // offsets are laid out on serializing
+  std::vector<std::vector<unsigned char>> levels;
+};
+
+// The mip chain every container gets, down to 1x1: sRGB encoded `pixels`
+// are filtered in linear light (see mip_chain.hpp) so levels don't darken.
+TextureMipChain buildTextureMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, int channels);
+// Header, level table and levels, each level aligned to
+// TEXTURE_CONTAINER_ALIGNMENT; the whole file in memory.
+std::vector<char> serializeTextureContainer(const TextureMipChain& chain);
+// Writes an uncompressed container for tightly packed 8-bit pixels with
+// 3 or 4 channels, with the chain from buildTextureMipChain.
+bool writeTextureContainer(const std::string& path, const unsigned char* pixels, int width, int height, int channels);
+// "assets/container.jpg" -> "assets/container.gtex"
+std::string textureContainerPath(const std::string& imgPath);
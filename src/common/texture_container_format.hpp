@@ -0,0 +1,33 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+
+// Precompiled texture file (.gtex): a fixed header, a table with one entry
+// per mip level, then the level data, each level starting on a
+// TEXTURE_CONTAINER_ALIGNMENT boundary. Rows are tightly packed and
+// bottom-up (already flipped like stbi_set_flip_vertically_on_load). The
+// file is mmapped and every level is handed to GL straight from the
+// mapping, so loading is pure I/O: no decode and no mip generation.
+const uint32_t TEXTURE_CONTAINER_VERSION = 1;
+const uint32_t TEXTURE_CONTAINER_ALIGNMENT = 64;
+
+struct TextureContainerHeader {
+  char magic[4];             // "GTEX"
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levelCount;
+  // sized, e.g. GL_RGB8 or a compressed format; the loader rejects formats
+  // whose level size it can't check (see containerLevelBytes)
+  uint32_t internalFormat;
+  uint32_t format;           // GL_RGB/GL_RGBA, 0 when the levels are compressed
+  uint32_t type;             // GL_UNSIGNED_BYTE, 0 when the levels are compressed
+};
+struct TextureContainerLevel {
+  uint64_t offset;           // from the start of the file
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+};
+static_assert(sizeof(TextureContainerHeader) == 32, "on-disk header layout");
+static_assert(sizeof(TextureContainerLevel) == 24, "on-disk level table layout");
@@ -0,0 +1,60 @@
+#include <glad/glad.h>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "mip_chain.hpp"
+#include "texture_container.hpp"
+
+// Everything here is free of GL calls, asset_baker compiles this file in
+// without linking common.
+
+uint64_t alignContainerOffset(uint64_t offset) {
+  return (offset + TEXTURE_CONTAINER_ALIGNMENT - 1) / TEXTURE_CONTAINER_ALIGNMENT * TEXTURE_CONTAINER_ALIGNMENT;
+}
+
+TextureMipChain buildTextureMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, int channels) {
+  TextureMipChain chain;
+  chain.channels = channels;
+  chain.levels.emplace_back(pixels, pixels + (size_t)width * height * channels);
+  chain.table.push_back({0, chain.levels[0].size(), width, height});
+  LinearImage linear = decodeSrgb(pixels, width, height, channels);
+  while (linear.width > 1 || linear.height > 1) {
+    linear = downsampleLinear(linear);
+    chain.levels.push_back(encodeSrgb(linear, channels));
+    chain.table.push_back({0, chain.levels.back().size(), linear.width, linear.height});
+  }
+  return chain;
+}
+
+std::vector<char> serializeTextureContainer(const TextureMipChain& chain) {
+  std::vector<TextureContainerLevel> table = chain.table;
+  TextureContainerHeader header = {{'G', 'T', 'E', 'X'}, TEXTURE_CONTAINER_VERSION, table[0].width, table[0].height,
+    (uint32_t)table.size(), (uint32_t)(chain.channels == 4 ? GL_RGBA8 : GL_RGB8),
+    (uint32_t)(chain.channels == 4 ? GL_RGBA : GL_RGB), GL_UNSIGNED_BYTE};
+  uint64_t offset = sizeof(header) + table.size() * sizeof(TextureContainerLevel);
+  for (TextureContainerLevel& level : table) {
+    level.offset = alignContainerOffset(offset);
+    offset = level.offset + level.size;
+  }
+  std::vector<char> file(offset, 0);
+  memcpy(file.data(), &header, sizeof(header));
+  memcpy(file.data() + sizeof(header), table.data(), table.size() * sizeof(TextureContainerLevel));
+  for (size_t i = 0; i < table.size(); i++) {
+    memcpy(file.data() + table[i].offset, chain.levels[i].data(), chain.levels[i].size());
+  }
+  return file;
+}
+
+bool writeTextureContainer(const std::string& path, const unsigned char* pixels, int width, int height, int channels) {
+  if (channels != 3 && channels != 4) {
+    return false;
+  }
+  std::vector<char> file = serializeTextureContainer(buildTextureMipChain(pixels, width, height, channels));
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return false;
+  }
+  out.write(file.data(), file.size());
+  return out.good();
+}
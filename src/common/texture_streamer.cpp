@@ -0,0 +1,396 @@
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "texture_streamer.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+
+TextureStreamer::TextureStreamer(unsigned int workerCount) {
+  if (workerCount == 0) {
+    // leave one core to the render thread
+    workerCount = std::max(1u, std::thread::hardware_concurrency() - 1);
+  }
+  for (unsigned int i = 0; i < workerCount; i++) {
+    workers.emplace_back(&TextureStreamer::workerLoop, this);
+  }
+  for (PixelBuffer& pixelBuffer : pixelBuffers) {
+    glGenBuffers(1, &pixelBuffer.bufferId);
+  }
+}
+
+TextureStreamer::~TextureStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeWorkers.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (Job& job : decodedJobs) {
+    stbi_image_free(job.pixels);
+    closeTextureContainer(job.container);
+  }
+}
+
+GLuint TextureStreamer::request(const std::string& imgPath, int skipLevels) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glState.bindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // a single 1x1 level is already a complete mip chain
+  const unsigned char placeholder[4] = {128, 128, 128, 255};
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    Job job;
+    job.texture = texture;
+    job.path = imgPath;
+    job.requestTime = Clock::now();
+    job.skipLevels = skipLevels;
+    pendingJobs.push_back(job);
+    jobsInFlight++;
+  }
+  wakeWorkers.notify_one();
+  return texture;
+}
+
+void TextureStreamer::setBlobLookup(BlobLookup lookup) {
+  blobLookup = lookup;
+}
+
+// The baked container next to `imgPath`, from the blob lookup or mapped.
+bool TextureStreamer::openContainer(const std::string& imgPath, TextureContainer& container) const {
+  std::string containerPath = textureContainerPath(imgPath);
+  std::span<const unsigned char> blob = blobLookup ? blobLookup(containerPath) : std::span<const unsigned char>();
+  if (!blob.empty()) {
+    return viewTextureContainer(blob.data(), blob.size(), container);
+  }
+  return openTextureContainer(containerPath, container);
+}
+
+unsigned char* TextureStreamer::loadImage(const std::string& imgPath, int& width, int& height, int& channels, int wantChannels) const {
+  std::span<const unsigned char> blob = blobLookup ? blobLookup(imgPath) : std::span<const unsigned char>();
+  if (!blob.empty()) {
+    return stbi_load_from_memory(blob.data(), (int)blob.size(), &width, &height, &channels, wantChannels);
+  }
+  return stbi_load(imgPath.c_str(), &width, &height, &channels, wantChannels);
+}
+
+bool TextureStreamer::imageInfo(const std::string& imgPath, int& width, int& height, int& channels) const {
+  std::span<const unsigned char> blob = blobLookup ? blobLookup(imgPath) : std::span<const unsigned char>();
+  if (!blob.empty()) {
+    return stbi_info_from_memory(blob.data(), (int)blob.size(), &width, &height, &channels);
+  }
+  return stbi_info(imgPath.c_str(), &width, &height, &channels);
+}
+
+// Layers are sized to the largest image. The array gets a full mip chain
+// but starts with its base level on the 1x1 mip, filled grey, and only
+// drops to level 0 once the last layer is uploaded and mipmapped.
+GLuint TextureStreamer::requestArray(const std::vector<std::string>& imgPaths, std::vector<ArrayLayer>& layers) {
+  // only the headers are read here, the decode still happens on a worker
+  std::vector<int> widths(imgPaths.size(), 1), heights(imgPaths.size(), 1);
+  int layerWidth = 1, layerHeight = 1;
+  for (size_t i = 0; i < imgPaths.size(); i++) {
+    TextureContainer container;
+    int channels;
+    if (openContainer(imgPaths[i], container)) {
+      widths[i] = container.header->width;
+      heights[i] = container.header->height;
+      closeTextureContainer(container);
+    } else if (!imageInfo(imgPaths[i], widths[i], heights[i], channels)) {
+      std::cout << "ERROR! couldn't read the texture image header: " << imgPaths[i] << std::endl;
+    }
+    layerWidth = std::max(layerWidth, widths[i]);
+    layerHeight = std::max(layerHeight, heights[i]);
+  }
+  GLsizei layerCount = (GLsizei)imgPaths.size();
+  GLsizei levelCount = 1;
+  while ((std::max(layerWidth, layerHeight) >> levelCount) > 0) {
+    levelCount++;
+  }
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glState.bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  if (glExt.textureStorage) {
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, GL_RGBA8, layerWidth, layerHeight, layerCount);
+  } else {
+    for (GLsizei level = 0; level < levelCount; level++) {
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, std::max(1, layerWidth >> level),
+        std::max(1, layerHeight >> level), layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+  }
+  std::vector<unsigned char> placeholder(4 * layerCount, 128);
+  for (GLsizei i = 0; i < layerCount; i++) {
+    placeholder[4 * i + 3] = 255;
+  }
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, levelCount - 1, 0, 0, 0, 1, 1, layerCount, GL_RGBA, GL_UNSIGNED_BYTE, placeholder.data());
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, levelCount - 1);
+  pendingArrayLayers[texture] = layerCount;
+
+  layers.clear();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < imgPaths.size(); i++) {
+      layers.push_back({(int)i, {(float)widths[i] / layerWidth, (float)heights[i] / layerHeight}});
+      Job job;
+      job.texture = texture;
+      job.path = imgPaths[i];
+      job.requestTime = Clock::now();
+      job.layer = (int)i;
+      job.layerWidth = layerWidth;
+      job.layerHeight = layerHeight;
+      pendingJobs.push_back(job);
+      jobsInFlight++;
+    }
+  }
+  wakeWorkers.notify_all();
+  return texture;
+}
+
+// Copies an RGBA image into the bottom-left of a layer sized buffer and
+// repeats its last column and row into the padding, so bilinear taps and
+// mips along the image edge never pull in unrelated texels.
+static unsigned char* padToLayer(unsigned char* pixels, int width, int height, int layerWidth, int layerHeight) {
+  // allocated with malloc so stbi_image_free can release it like any decode
+  unsigned char* padded = (unsigned char*)malloc((size_t)layerWidth * layerHeight * 4);
+  for (int y = 0; y < layerHeight; y++) {
+    const unsigned char* srcRow = pixels + (size_t)std::min(y, height - 1) * width * 4;
+    unsigned char* dstRow = padded + (size_t)y * layerWidth * 4;
+    memcpy(dstRow, srcRow, (size_t)width * 4);
+    for (int x = width; x < layerWidth; x++) {
+      memcpy(dstRow + x * 4, srcRow + (width - 1) * 4, 4);
+    }
+  }
+  stbi_image_free(pixels);
+  return padded;
+}
+
+// Level 0 of an uncompressed 8-bit container, widened to RGBA. The mips
+// are rebuilt for the whole array once every layer is in.
+static unsigned char* containerToRgba(const TextureContainer& container, int& width, int& height) {
+  const TextureContainerHeader* header = container.header;
+  if (header->type != GL_UNSIGNED_BYTE || (header->format != GL_RGB && header->format != GL_RGBA)) {
+    return nullptr;
+  }
+  int channels = header->format == GL_RGBA ? 4 : 3;
+  width = header->width;
+  height = header->height;
+  const unsigned char* src = container.data + container.levels[0].offset;
+  unsigned char* pixels = (unsigned char*)malloc((size_t)width * height * 4);
+  for (size_t i = 0; i < (size_t)width * height; i++) {
+    memcpy(pixels + i * 4, src + i * channels, channels);
+    if (channels == 3) {
+      pixels[i * 4 + 3] = 255;
+    }
+  }
+  return pixels;
+}
+
+void TextureStreamer::workerLoop() {
+  stbi_set_flip_vertically_on_load_thread(true);
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeWorkers.wait(lock, [this] { return stopping || !pendingJobs.empty(); });
+      if (stopping) {
+        return;
+      }
+      job = pendingJobs.front();
+      pendingJobs.pop_front();
+    }
+    Clock::time_point start = Clock::now();
+    if (job.layer >= 0) {
+      // every layer shares one format, so decode straight to RGBA
+      if (openContainer(job.path, job.container)) {
+        job.pixels = containerToRgba(job.container, job.width, job.height);
+        closeTextureContainer(job.container);
+      } else {
+        job.pixels = loadImage(job.path, job.width, job.height, job.channels, 4);
+      }
+      job.channels = 4;
+      if (job.pixels && (job.width > job.layerWidth || job.height > job.layerHeight)) {
+        // the file changed since requestArray() read its header
+        stbi_image_free(job.pixels);
+        job.pixels = nullptr;
+      } else if (job.pixels && (job.width != job.layerWidth || job.height != job.layerHeight)) {
+        job.pixels = padToLayer(job.pixels, job.width, job.height, job.layerWidth, job.layerHeight);
+        job.width = job.layerWidth;
+        job.height = job.layerHeight;
+      }
+    } else if (!openContainer(job.path, job.container)) {
+      job.pixels = loadImage(job.path, job.width, job.height, job.channels, 0);
+      for (int i = 0; job.pixels && i < job.skipLevels && (job.width > 1 || job.height > 1); i++) {
+        uint32_t width, height;
+        std::vector<unsigned char> level = downsampleTextureLevel(job.pixels, job.width, job.height, job.channels, width, height);
+        // malloc, like stb_image itself, so stbi_image_free still releases it
+        stbi_image_free(job.pixels);
+        job.pixels = (unsigned char*)malloc(level.size());
+        memcpy(job.pixels, level.data(), level.size());
+        job.width = width;
+        job.height = height;
+      }
+    }
+    job.decodeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    decodedJobs.push_back(job);
+  }
+}
+
+void TextureStreamer::update() {
+  std::deque<Job> ready;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (decodedJobs.empty()) {
+      return;
+    }
+    ready.swap(decodedJobs);
+  }
+
+  GLint activeUnit, boundTexture, boundArray;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+  glState.activeTexture(GL_TEXTURE0);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &boundArray);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+  while (!ready.empty() && upload(ready.front())) {
+    ready.pop_front();
+  }
+
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glState.bindTexture(GL_TEXTURE_2D, boundTexture);
+  glState.bindTexture(GL_TEXTURE_2D_ARRAY, boundArray);
+  glState.activeTexture(activeUnit);
+
+  // whatever did not fit in this frame's buffers goes first next frame
+  std::lock_guard<std::mutex> lock(mutex);
+  decodedJobs.insert(decodedJobs.begin(), ready.begin(), ready.end());
+}
+
+static size_t mipChainBytes(int width, int height, int bytesPerPixel) {
+  size_t bytes = 0;
+  while (true) {
+    bytes += (size_t)width * height * bytesPerPixel;
+    if (width == 1 && height == 1) {
+      return bytes;
+    }
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+  }
+}
+
+// Returns false when the next pixel buffer is still being read by the GPU.
+bool TextureStreamer::upload(Job& job) {
+  if (job.container.data) {
+    uploadTextureContainer(job.texture, job.container, job.skipLevels);
+    size_t bytes = 0;
+    for (uint32_t i = std::min<uint32_t>(job.skipLevels, job.container.header->levelCount - 1); i < job.container.header->levelCount; i++) {
+      bytes += job.container.levels[i].size;
+    }
+    closeTextureContainer(job.container);
+    complete(job, false, true, bytes);
+    return true;
+  }
+  if (!job.pixels) {
+    std::cout << "ERROR! couldn't load the texture image: " << job.path << std::endl;
+    if (job.layer >= 0) {
+      // the layer stays grey, but the rest of the array still comes in
+      finishArrayLayer(job);
+    }
+    complete(job, true, false, 0);
+    return true;
+  }
+
+  PixelBuffer& pixelBuffer = pixelBuffers[nextPixelBuffer];
+  if (pixelBuffer.fence) {
+    if (glClientWaitSync(pixelBuffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      return false;
+    }
+    glDeleteSync(pixelBuffer.fence);
+    pixelBuffer.fence = nullptr;
+  }
+  nextPixelBuffer = (nextPixelBuffer + 1) % PIXEL_BUFFER_COUNT;
+
+  GLsizeiptr size = (GLsizeiptr)job.width * job.height * job.channels;
+  bool failed = false;
+  glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer.bufferId);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  if (mapped) {
+    memcpy(mapped, job.pixels, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    if (job.layer >= 0) {
+      glState.bindTexture(GL_TEXTURE_2D_ARRAY, job.texture);
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, job.layer, job.width, job.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    } else {
+      GLenum imgFmt = job.channels == 4 ? GL_RGBA : GL_RGB;
+      glState.bindTexture(GL_TEXTURE_2D, job.texture);
+      glTexImage2D(GL_TEXTURE_2D, 0, imgFmt, job.width, job.height, 0, imgFmt, GL_UNSIGNED_BYTE, (void*)0);
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
+  } else {
+    std::cout << "ERROR! couldn't map the pixel buffer for: " << job.path << std::endl;
+    failed = true;
+  }
+  glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  stbi_image_free(job.pixels);
+  job.pixels = nullptr;
+  pixelBuffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  if (job.layer >= 0) {
+    finishArrayLayer(job);
+  }
+  complete(job, failed, false, failed ? 0 : mipChainBytes(job.width, job.height, job.channels));
+  return true;
+}
+
+void TextureStreamer::complete(const Job& job, bool failed, bool baked, size_t bytes) {
+  Completion completion = {job.path, job.texture, failed, bytes, baked, job.decodeMs,
+    std::chrono::duration<double, std::milli>(Clock::now() - job.requestTime).count()};
+  if (!failed) {
+    std::cout << "texture " << completion.path << (baked ? ": mapped " : ": decode ") << completion.decodeMs
+      << " ms, ready after " << completion.readyMs << " ms" << std::endl;
+  }
+  completions.push_back(completion);
+  std::lock_guard<std::mutex> lock(mutex);
+  jobsInFlight--;
+}
+
+std::vector<TextureStreamer::Completion> TextureStreamer::takeCompletions() {
+  std::vector<Completion> taken;
+  taken.swap(completions);
+  return taken;
+}
+
+// Once the last layer of an array is in, build its mips and let sampling
+// start from level 0. Expects unit 0 to be active.
+void TextureStreamer::finishArrayLayer(const Job& job) {
+  auto it = pendingArrayLayers.find(job.texture);
+  if (--it->second > 0) {
+    return;
+  }
+  pendingArrayLayers.erase(it);
+  glState.bindTexture(GL_TEXTURE_2D_ARRAY, job.texture);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+  glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+}
+
+bool TextureStreamer::idle() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return jobsInFlight == 0;
+}
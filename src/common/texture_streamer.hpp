@@ -0,0 +1,109 @@
+#pragma once
+#include <glad/glad.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "texture_container.hpp"
+
+// Loads textures without blocking the render thread. request() returns a
+// texture name right away, backed by a 1x1 grey placeholder; worker
+// threads decode the image with stb_image and update() (called once per
+// frame on the GL thread) uploads finished images through a ring of pixel
+// buffer objects into that same texture name, so existing bindings pick
+// the real image up without any change at the call site.
+// When a baked .gtex container sits next to the image, the worker only
+// maps it and its levels are uploaded straight from the mapping.
+// requestArray() packs several images into the layers of one
+// GL_TEXTURE_2D_ARRAY, so a whole set of materials is bound once and draws
+// only pick a layer. The array samples grey until every layer is in.
+class TextureStreamer {
+  public:
+    // Where an image landed in a texture array: images smaller than the
+    // layer sit in its bottom-left corner, scale the UVs by uvScale.
+    struct ArrayLayer {
+      int layer;
+      float uvScale[2];
+    };
+    // Bytes of `path` when something other than the file system holds it
+    // (an asset pack), empty to read the file. Called from worker threads.
+    using BlobLookup = std::function<std::span<const unsigned char>(const std::string& path)>;
+    // Posted once per request (once per layer for an array) when it is
+    // done, whether or not the image made it in.
+    struct Completion {
+      std::string path;
+      GLuint texture;
+      bool failed;      // couldn't be read or uploaded, `texture` keeps the placeholder
+      size_t bytes;     // level 0 and its mips as uploaded, before any driver padding
+      bool baked;       // loaded from a .gtex container
+      double decodeMs;  // time spent in stbi_load (or mapping the container) on a worker
+      double readyMs;   // request() until the upload was issued
+    };
+
+    TextureStreamer(unsigned int workerCount = 0);
+    ~TextureStreamer();
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // skipLevels > 0 loads the image that many mip levels down, at a
+    // quarter of the memory per level
+    GLuint request(const std::string& imgPath, int skipLevels = 0);
+    GLuint requestArray(const std::vector<std::string>& imgPaths, std::vector<ArrayLayer>& layers);
+    // Set before the first request.
+    void setBlobLookup(BlobLookup lookup);
+    void update();
+    bool idle();
+    // Hands over the completions posted since the last call; they queue up
+    // until someone takes them.
+    std::vector<Completion> takeCompletions();
+
+  private:
+    using Clock = std::chrono::steady_clock;
+    struct Job {
+      GLuint texture;
+      std::string path;
+      Clock::time_point requestTime;
+      unsigned char* pixels = nullptr;
+      int width = 0, height = 0, channels = 0;
+      double decodeMs = 0.0;
+      TextureContainer container;
+      int skipLevels = 0;
+      int layer = -1;  // >= 0 for an array layer, decoded to RGBA at the layer size
+      int layerWidth = 0, layerHeight = 0;
+    };
+    struct PixelBuffer {
+      GLuint bufferId = 0;
+      GLsync fence = nullptr;
+    };
+    static const int PIXEL_BUFFER_COUNT = 3;
+
+    bool openContainer(const std::string& imgPath, TextureContainer& container) const;
+    unsigned char* loadImage(const std::string& imgPath, int& width, int& height, int& channels, int wantChannels) const;
+    bool imageInfo(const std::string& imgPath, int& width, int& height, int& channels) const;
+    void workerLoop();
+    bool upload(Job& job);
+    void complete(const Job& job, bool failed, bool baked, size_t bytes);
+    void finishArrayLayer(const Job& job);
+
+    BlobLookup blobLookup;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::deque<Job> pendingJobs;
+    std::deque<Job> decodedJobs;
+    unsigned int jobsInFlight = 0;
+    bool stopping = false;
+
+    PixelBuffer pixelBuffers[PIXEL_BUFFER_COUNT];
+    int nextPixelBuffer = 0;
+    // array texture name -> layers still to upload, touched on the GL thread only
+    std::unordered_map<GLuint, int> pendingArrayLayers;
+    // touched on the GL thread only
+    std::vector<Completion> completions;
+};
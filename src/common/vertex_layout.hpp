@@ -0,0 +1,248 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+
+// Vertex formats described once, next to the struct they describe:
+//
+//   struct Vertex {
+//     Float<3> aPos;
+//     Half<2> aTexCoord;
+//   };
+//   constexpr auto vertexLayout = makeVertexLayout<Vertex>({
+//     VERTEX_ATTRIBUTE(Vertex, aPos, "aPos"),
+//     VERTEX_ATTRIBUTE(Vertex, aTexCoord, "aTexCoord"),
+//   });
+//
+// Locations follow the list order. setupVertexAttributes() issues the
+// glVertexAttribPointer calls, with strides and offsets taken from the
+// struct itself, and withVertexInputs() writes the matching GLSL `in`
+// declarations into a shader source at compile time. A layout that does
+// not cover every byte of its struct exactly once, in member order, does
+// not compile.
+
+// Storage types of the attribute formats. Brace elision keeps vertex
+// arrays as flat as a float[] was: {0.5f, 0.5f, 0.0f, 1.0f, 1.0f}.
+template <int N> struct Float {
+  float v[N];
+  float& operator[](int i) { return v[i]; }
+  const float& operator[](int i) const { return v[i]; }
+};
+// GL_HALF_FLOAT, the bits of an IEEE half each
+template <int N> struct Half {
+  uint16_t v[N];
+  uint16_t& operator[](int i) { return v[i]; }
+  const uint16_t& operator[](int i) const { return v[i]; }
+};
+// [-32767, 32767] read as [-1, 1]
+template <int N> struct SNorm16 {
+  int16_t v[N];
+  int16_t& operator[](int i) { return v[i]; }
+  const int16_t& operator[](int i) const { return v[i]; }
+};
+// [0, 255] read as [0, 1], e.g. colours
+template <int N> struct UNorm8 {
+  uint8_t v[N];
+  uint8_t& operator[](int i) { return v[i]; }
+  const uint8_t& operator[](int i) const { return v[i]; }
+};
+// GL_INT_2_10_10_10_REV: signed normalized xyz in 10 bits each and w in
+// 2, e.g. normals and tangents in 4 bytes
+struct SNorm2101010 {
+  uint32_t bits;
+};
+
+constexpr SNorm2101010 packSNorm2101010(float x, float y, float z, float w = 0.0f) {
+  auto pack = [](float value, int bits) {
+    int32_t max = (1 << (bits - 1)) - 1;
+    value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+    int32_t q = (int32_t)(value * max + (value < 0.0f ? -0.5f : 0.5f));
+    return (uint32_t)q & ((1u << bits) - 1);
+  };
+  return {pack(x, 10) | pack(y, 10) << 10 | pack(z, 10) << 20 | pack(w, 2) << 30};
+}
+
+constexpr const char* glslFloatType(int components) {
+  const char* types[] = {"float", "vec2", "vec3", "vec4"};
+  return types[components - 1];
+}
+
+// How a member type is fed to GL. Specialize for types of your own, e.g.
+// glm vectors, with the same four members.
+template <typename T> struct VertexAttributeTraits;
+template <> struct VertexAttributeTraits<float> {
+  static constexpr GLint components = 1;
+  static constexpr GLenum type = GL_FLOAT;
+  static constexpr GLboolean normalized = GL_FALSE;
+  static constexpr const char* glslType = "float";
+};
+template <int N> struct VertexAttributeTraits<Float<N>> {
+  static constexpr GLint components = N;
+  static constexpr GLenum type = GL_FLOAT;
+  static constexpr GLboolean normalized = GL_FALSE;
+  static constexpr const char* glslType = glslFloatType(N);
+};
+template <int N> struct VertexAttributeTraits<Half<N>> {
+  static constexpr GLint components = N;
+  static constexpr GLenum type = GL_HALF_FLOAT;
+  static constexpr GLboolean normalized = GL_FALSE;
+  static constexpr const char* glslType = glslFloatType(N);
+};
+template <int N> struct VertexAttributeTraits<SNorm16<N>> {
+  static constexpr GLint components = N;
+  static constexpr GLenum type = GL_SHORT;
+  static constexpr GLboolean normalized = GL_TRUE;
+  static constexpr const char* glslType = glslFloatType(N);
+};
+template <int N> struct VertexAttributeTraits<UNorm8<N>> {
+  static constexpr GLint components = N;
+  static constexpr GLenum type = GL_UNSIGNED_BYTE;
+  static constexpr GLboolean normalized = GL_TRUE;
+  static constexpr const char* glslType = glslFloatType(N);
+};
+template <> struct VertexAttributeTraits<SNorm2101010> {
+  static constexpr GLint components = 4;
+  static constexpr GLenum type = GL_INT_2_10_10_10_REV;
+  static constexpr GLboolean normalized = GL_TRUE;
+  static constexpr const char* glslType = "vec4";
+};
+
+struct VertexAttribute {
+  const char* name;  // of the GLSL input
+  size_t offset;
+  size_t size;
+  GLint components;
+  GLenum type;
+  GLboolean normalized;
+  const char* glslType;
+};
+
+template <typename T>
+constexpr VertexAttribute vertexAttribute(const char* name, size_t offset) {
+  using Traits = VertexAttributeTraits<T>;
+  return {name, offset, sizeof(T), Traits::components, Traits::type, Traits::normalized, Traits::glslType};
+}
+
+#define VERTEX_ATTRIBUTE(Vertex, member, glslName) \
+  vertexAttribute<decltype(Vertex::member)>(glslName, offsetof(Vertex, member))
+
+// Never defined: reaching a call while evaluating a consteval function
+// makes that a compile error, which quotes `reason`.
+void vertexLayoutError(const char* reason);
+
+template <typename Vertex, size_t N>
+struct VertexLayout {
+  VertexAttribute attributes[N];
+  static constexpr size_t count = N;
+  static constexpr GLsizei stride = sizeof(Vertex);
+};
+
+template <typename Vertex, size_t N>
+consteval VertexLayout<Vertex, N> makeVertexLayout(const VertexAttribute (&attributes)[N]) {
+  VertexLayout<Vertex, N> layout = {};
+  size_t end = 0;
+  for (size_t i = 0; i < N; i++) {
+    if (attributes[i].offset != end) {
+      vertexLayoutError("attributes must be listed in member order and cover the whole vertex, padding included");
+    }
+    if (attributes[i].offset % 4 != 0) {
+      vertexLayoutError("attribute offsets must be 4-byte aligned");
+    }
+    end = attributes[i].offset + attributes[i].size;
+    layout.attributes[i] = attributes[i];
+  }
+  if (end != sizeof(Vertex)) {
+    vertexLayoutError("attributes must cover the whole vertex");
+  }
+  return layout;
+}
+
+// Points locations firstLocation, firstLocation + 1... at the attributes
+// of vertices starting `bufferOffset` bytes into the bound GL_ARRAY_BUFFER,
+// recorded in the bound VAO. A divisor of 1 makes them per instance.
+template <typename Vertex, size_t N>
+void setupVertexAttributes(const VertexLayout<Vertex, N>& layout, GLuint firstLocation = 0, GLuint divisor = 0,
+  size_t bufferOffset = 0) {
+  for (size_t i = 0; i < N; i++) {
+    const VertexAttribute& attribute = layout.attributes[i];
+    GLuint location = firstLocation + (GLuint)i;
+    glVertexAttribPointer(location, attribute.components, attribute.type, attribute.normalized, layout.stride,
+      (void*)(bufferOffset + attribute.offset));
+    glEnableVertexAttribArray(location);
+    glVertexAttribDivisor(location, divisor);
+  }
+}
+
+// A GLSL source built at compile time, use c_str() where a const char*
+// source went before.
+const size_t GLSL_SOURCE_CAPACITY = 4096;
+struct GlslSource {
+  char text[GLSL_SOURCE_CAPACITY] = {};
+  size_t length = 0;
+
+  constexpr void append(const char* s, size_t n) {
+    if (length + n >= GLSL_SOURCE_CAPACITY) {
+      vertexLayoutError("shader source over GLSL_SOURCE_CAPACITY");
+    }
+    for (size_t i = 0; i < n; i++) {
+      text[length++] = s[i];
+    }
+  }
+  constexpr void append(const char* s) {
+    size_t n = 0;
+    while (s[n]) {
+      n++;
+    }
+    append(s, n);
+  }
+  constexpr void append(unsigned int value) {
+    char digits[10];
+    int n = 0;
+    do {
+      digits[n++] = (char)('0' + value % 10);
+      value /= 10;
+    } while (value);
+    while (n) {
+      append(&digits[--n], 1);
+    }
+  }
+  const char* c_str() const { return text; }
+};
+
+// `source` with a `layout (location = ...) in ...;` line for every
+// attribute of `layouts` added after its #version line. Locations count
+// on from one layout to the next, e.g. vertex then instance attributes.
+template <typename... Layouts>
+consteval GlslSource withVertexInputs(const char* source, const Layouts&... layouts) {
+  GlslSource out;
+  const char* body = source;
+  while (*body == '\n') {
+    body++;
+  }
+  const char* version = "#version";
+  for (int i = 0; version[i]; i++) {
+    if (body[i] != version[i]) {
+      vertexLayoutError("the shader source has to start with its #version line");
+    }
+  }
+  while (*body && *body != '\n') {
+    body++;
+  }
+  out.append(source, body - source);
+  out.append("\n");
+  unsigned int location = 0;
+  auto appendInputs = [&](const auto& layout) {
+    for (const VertexAttribute& attribute : layout.attributes) {
+      out.append("layout (location = ");
+      out.append(location++);
+      out.append(") in ");
+      out.append(attribute.glslType);
+      out.append(" ");
+      out.append(attribute.name);
+      out.append(";\n");
+    }
+  };
+  (appendInputs(layouts), ...);
+  out.append(body);
+  return out;
+}
@@ -0,0 +1,11 @@
+#include "avx_kernels.hpp"
+
+bool cpuHasAvx() {
+#ifdef HAVE_AVX_KERNELS
+  // also checks that the OS saves the YMM registers
+  static const bool hasAvx = __builtin_cpu_supports("avx");
+  return hasAvx;
+#else
+  return false;
+#endif
+}
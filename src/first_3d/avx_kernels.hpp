@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// The AVX paths of the SIMD kernels. They live in the *_avx.cpp files,
+// the only ones built with -mavx (on x86 only, where HAVE_AVX_KERNELS is
+// defined), and may only be called once cpuHasAvx() said yes. Arguments
+// are plain pointers: an inline glm or std function instantiated in an
+// -mavx file can be the copy the linker keeps for the whole program, so
+// those files use neither.
+//
+// Each kernel handles a multiple of 8 items from `first` and returns where
+// it stopped; the caller's scalar loop does the rest.
+
+bool cpuHasAvx();
+
+// frustum_culling_avx.cpp, `planes` is Frustum::planes as 6 x 4 floats
+size_t cullSpheresAvx(const float* planes, const float* centerX, const float* centerY, const float* centerZ,
+  const float* radius, size_t first, size_t end, uint32_t* out, size_t& count);
+// transforms_avx.cpp, `parent` and `out` as column-major 4x4 floats and
+// `components` the ten arrays of a TransformArrays, positionX to scaleZ
+size_t composeTransformsAvx(const float* parent, const float* const* components, const uint32_t* indices, size_t first,
+  size_t begin, size_t end, float* out);
+// clustered_lighting_avx.cpp, `boxes` the cluster box arrays minX, maxX,
+// minY, maxY, minZ, maxZ and `sphere` x, y, z and radius squared
+size_t touchClustersAvx(const float* const* boxes, const float* sphere, size_t first, size_t end, uint32_t* out,
+  size_t& count);
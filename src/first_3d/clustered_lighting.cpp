@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include "clustered_lighting.hpp"
+#include "gl_state.hpp"
+#include "avx_kernels.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void PointLights::push(const glm::vec3& position, float r, const glm::vec3& c) {
+  x.push_back(position.x);
+  y.push_back(position.y);
+  z.push_back(position.z);
+  radius.push_back(r);
+  color.push_back(c);
+}
+
+void PointLights::clear() {
+  x.clear();
+  y.clear();
+  z.clear();
+  radius.clear();
+  color.clear();
+}
+
+PointLights scatterLights(size_t count, const glm::vec3& min, const glm::vec3& max, float radius, unsigned seed) {
+  std::mt19937 random(seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  PointLights lights;
+  for (size_t i = 0; i < count; i++) {
+    glm::vec3 position = glm::mix(min, max, glm::vec3(unit(random), unit(random), unit(random)));
+    // saturated hue: one channel full, one off, one anywhere between
+    float hue = unit(random) * 6.0f;
+    int sector = (int)hue % 6;
+    float ramp = hue - std::floor(hue);
+    glm::vec3 color;
+    switch (sector) {
+      case 0: color = glm::vec3(1.0f, ramp, 0.0f); break;
+      case 1: color = glm::vec3(1.0f - ramp, 1.0f, 0.0f); break;
+      case 2: color = glm::vec3(0.0f, 1.0f, ramp); break;
+      case 3: color = glm::vec3(0.0f, 1.0f - ramp, 1.0f); break;
+      case 4: color = glm::vec3(ramp, 0.0f, 1.0f); break;
+      default: color = glm::vec3(1.0f, 0.0f, 1.0f - ramp); break;
+    }
+    lights.push(position, radius, color);
+  }
+  return lights;
+}
+
+float lightRadiusFor(size_t count, const glm::vec3& min, const glm::vec3& max) {
+  const float OVERLAP = 8.0f;
+  glm::vec3 size = max - min;
+  float volume = size.x * size.y * size.z;
+  // count spheres of 4/3 pi r^3 fill the volume OVERLAP times
+  return std::cbrt(OVERLAP * volume / (4.0f / 3.0f * 3.14159265f * std::max(count, (size_t)1)));
+}
+
+void LightClusters::setView(int width, int height, float fovy, float aspect, float near, float far) {
+  viewWidth = std::max(width, 1);
+  viewHeight = std::max(height, 1);
+  tileWidth = (viewWidth + TILES_X - 1) / TILES_X;
+  tileHeight = (viewHeight + TILES_Y - 1) / TILES_Y;
+  tanHalfY = std::tan(fovy * 0.5f);
+  tanHalfX = tanHalfY * aspect;
+  this->near = near;
+  this->far = far;
+  // slice k covers depths near * (far / near)^(k / SLICES) up to the next
+  float logRatio = std::log(far / near);
+  sliceScale = SLICES / logRatio;
+  sliceBias = -SLICES * std::log(near) / logRatio;
+
+  for (std::vector<float>* box : {&boxMinX, &boxMaxX, &boxMinY, &boxMaxY, &boxMinZ, &boxMaxZ}) {
+    box->resize(CLUSTER_COUNT);
+  }
+  for (int k = 0; k < SLICES; k++) {
+    float depth0 = near * std::pow(far / near, (float)k / SLICES);
+    float depth1 = near * std::pow(far / near, (float)(k + 1) / SLICES);
+    for (int j = 0; j < TILES_Y; j++) {
+      // tiles of the last row and column may reach past the viewport
+      float ndcY0 = std::min((float)(j * tileHeight) / viewHeight, 1.0f) * 2.0f - 1.0f;
+      float ndcY1 = std::min((float)((j + 1) * tileHeight) / viewHeight, 1.0f) * 2.0f - 1.0f;
+      for (int i = 0; i < TILES_X; i++) {
+        float ndcX0 = std::min((float)(i * tileWidth) / viewWidth, 1.0f) * 2.0f - 1.0f;
+        float ndcX1 = std::min((float)((i + 1) * tileWidth) / viewWidth, 1.0f) * 2.0f - 1.0f;
+        // the tile's frustum slice is widest at the far depth on the side
+        // away from the axis, so take the box over both depths
+        size_t c = ((size_t)k * TILES_Y + j) * TILES_X + i;
+        boxMinX[c] = std::min(ndcX0 * depth0, ndcX0 * depth1) * tanHalfX;
+        boxMaxX[c] = std::max(ndcX1 * depth0, ndcX1 * depth1) * tanHalfX;
+        boxMinY[c] = std::min(ndcY0 * depth0, ndcY0 * depth1) * tanHalfY;
+        boxMaxY[c] = std::max(ndcY1 * depth0, ndcY1 * depth1) * tanHalfY;
+        boxMinZ[c] = -depth1;
+        boxMaxZ[c] = -depth0;
+      }
+    }
+  }
+}
+
+glm::vec4 LightClusters::tileUniform() const {
+  return glm::vec4((float)tileWidth, (float)tileHeight, (float)TILES_X, (float)TILES_Y);
+}
+
+glm::vec3 LightClusters::depthUniform() const {
+  return glm::vec3(sliceScale, sliceBias, (float)SLICES);
+}
+
+namespace {
+
+struct Sphere {
+  float x, y, z, radiusSquared;
+};
+
+struct ClusterBoxes {
+  const float* minX;
+  const float* maxX;
+  const float* minY;
+  const float* maxY;
+  const float* minZ;
+  const float* maxZ;
+};
+
+}
+
+// clusters [first, end) one at a time, also the tail of the SIMD paths
+static void touchScalar(const ClusterBoxes& boxes, const Sphere& sphere, size_t first, size_t end, uint32_t* out,
+  size_t& count) {
+  for (size_t c = first; c < end; c++) {
+    float dx = std::max(std::max(boxes.minX[c] - sphere.x, sphere.x - boxes.maxX[c]), 0.0f);
+    float dy = std::max(std::max(boxes.minY[c] - sphere.y, sphere.y - boxes.maxY[c]), 0.0f);
+    float dz = std::max(std::max(boxes.minZ[c] - sphere.z, sphere.z - boxes.maxZ[c]), 0.0f);
+    out[count] = (uint32_t)c;
+    count += dx * dx + dy * dy + dz * dz <= sphere.radiusSquared;
+  }
+}
+
+#ifdef __SSE2__
+static size_t touchSse(const ClusterBoxes& boxes, const Sphere& sphere, size_t first, size_t end, uint32_t* out,
+  size_t& count) {
+  size_t n = first + ((end - first) & ~(size_t)3);
+  __m128 x = _mm_set1_ps(sphere.x), y = _mm_set1_ps(sphere.y), z = _mm_set1_ps(sphere.z);
+  __m128 radiusSquared = _mm_set1_ps(sphere.radiusSquared);
+  __m128 zero = _mm_setzero_ps();
+  for (size_t c = first; c < n; c += 4) {
+    __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.minX + c), x),
+      _mm_sub_ps(x, _mm_loadu_ps(boxes.maxX + c))), zero);
+    __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.minY + c), y),
+      _mm_sub_ps(y, _mm_loadu_ps(boxes.maxY + c))), zero);
+    __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(boxes.minZ + c), z),
+      _mm_sub_ps(z, _mm_loadu_ps(boxes.maxZ + c))), zero);
+    __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+    int mask = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, radiusSquared));
+    for (int lane = 0; lane < 4; lane++) {
+      out[count] = (uint32_t)(c + lane);
+      count += (mask >> lane) & 1;
+    }
+  }
+  return n;
+}
+#endif
+
+// Writes the clusters of [first, end) the sphere touches to `out`, which
+// needs room for all of them, and returns how many it wrote.
+static size_t touchClusters(const ClusterBoxes& boxes, const Sphere& sphere, size_t first, size_t end, uint32_t* out,
+  CullPath path) {
+  size_t count = 0;
+  size_t done = first;
+#ifdef HAVE_AVX_KERNELS
+  if (path == CullPath::Avx && cpuHasAvx()) {
+    const float* boxArrays[6] = {boxes.minX, boxes.maxX, boxes.minY, boxes.maxY, boxes.minZ, boxes.maxZ};
+    const float sphereValues[4] = {sphere.x, sphere.y, sphere.z, sphere.radiusSquared};
+    done = touchClustersAvx(boxArrays, sphereValues, first, end, out, count);
+  }
+#endif
+#ifdef __SSE2__
+  if (path == CullPath::Sse) {
+    done = touchSse(boxes, sphere, first, end, out, count);
+  }
+#endif
+  touchScalar(boxes, sphere, done, end, out, count);
+  return count;
+}
+
+// Every light narrows itself to the slices its depth range covers and the
+// tiles its box projects into, then tests the cluster boxes of each row
+// of that rectangle against its sphere. The pairs found come out light by
+// light and a counting sort by cluster turns them into the lists.
+void LightClusters::assign(const PointLights& lights, CullPath path) {
+  auto start = std::chrono::high_resolution_clock::now();
+  ClusterBoxes boxes = {boxMinX.data(), boxMaxX.data(), boxMinY.data(), boxMaxY.data(), boxMinZ.data(), boxMaxZ.data()};
+  size_t pairCount = 0;
+  auto slice = [&](float depth) {
+    return std::clamp((int)std::floor(std::log(depth) * sliceScale + sliceBias), 0, SLICES - 1);
+  };
+  auto tile = [](float ndc, int pixels, int tileSize, int tiles) {
+    return std::clamp((int)std::floor((ndc * 0.5f + 0.5f) * pixels / tileSize), 0, tiles - 1);
+  };
+
+  for (size_t l = 0; l < lights.size(); l++) {
+    float x = lights.x[l], y = lights.y[l], z = lights.z[l], r = lights.radius[l];
+    float depth0 = -(z + r), depth1 = -(z - r);
+    if (depth1 < near || depth0 > far) {
+      continue;
+    }
+    depth0 = std::max(depth0, near);
+    depth1 = std::min(depth1, far);
+    int k0 = slice(depth0), k1 = slice(depth1);
+
+    int i0 = 0, i1 = TILES_X - 1, j0 = 0, j1 = TILES_Y - 1;
+    if (-z - r > near) {
+      // the box in front of the camera projects inside the corners at
+      // its near and far depth
+      float ndcX0 = std::min((x - r) / (depth0 * tanHalfX), (x - r) / (depth1 * tanHalfX));
+      float ndcX1 = std::max((x + r) / (depth0 * tanHalfX), (x + r) / (depth1 * tanHalfX));
+      float ndcY0 = std::min((y - r) / (depth0 * tanHalfY), (y - r) / (depth1 * tanHalfY));
+      float ndcY1 = std::max((y + r) / (depth0 * tanHalfY), (y + r) / (depth1 * tanHalfY));
+      if (ndcX1 < -1.0f || ndcX0 > 1.0f || ndcY1 < -1.0f || ndcY0 > 1.0f) {
+        continue;
+      }
+      i0 = tile(ndcX0, viewWidth, tileWidth, TILES_X);
+      i1 = tile(ndcX1, viewWidth, tileWidth, TILES_X);
+      j0 = tile(ndcY0, viewHeight, tileHeight, TILES_Y);
+      j1 = tile(ndcY1, viewHeight, tileHeight, TILES_Y);
+    }
+
+    Sphere sphere = {x, y, z, r * r};
+    size_t rowLength = (size_t)(i1 - i0 + 1);
+    for (int k = k0; k <= k1; k++) {
+      for (int j = j0; j <= j1; j++) {
+        if (pairCount + rowLength > pairClusters.size()) {
+          pairClusters.resize(std::max(pairClusters.size() * 2, pairCount + rowLength));
+          pairLights.resize(pairClusters.size());
+        }
+        size_t row = ((size_t)k * TILES_Y + j) * TILES_X;
+        size_t touched = touchClusters(boxes, sphere, row + i0, row + i1 + 1, pairClusters.data() + pairCount, path);
+        std::fill_n(pairLights.data() + pairCount, touched, (uint32_t)l);
+        pairCount += touched;
+      }
+    }
+  }
+
+  // counting sort: counts, then starts, then the indices
+  clusterRanges.assign((size_t)CLUSTER_COUNT * 2, 0);
+  for (size_t p = 0; p < pairCount; p++) {
+    clusterRanges[pairClusters[p] * 2 + 1]++;
+  }
+  assignStats = Stats();
+  uint32_t offset = 0;
+  for (int c = 0; c < CLUSTER_COUNT; c++) {
+    uint32_t count = clusterRanges[c * 2 + 1];
+    clusterRanges[c * 2] = offset;
+    offset += count;
+    assignStats.occupiedClusters += count > 0;
+    assignStats.maxPerCluster = std::max(assignStats.maxPerCluster, count);
+  }
+  lightIndices.resize(pairCount);
+  for (size_t p = 0; p < pairCount; p++) {
+    uint32_t c = pairClusters[p];
+    lightIndices[clusterRanges[c * 2]++] = pairLights[p];
+  }
+  // the starts moved to the ends while filling, move them back
+  for (int c = 0; c < CLUSTER_COUNT; c++) {
+    clusterRanges[c * 2] -= clusterRanges[c * 2 + 1];
+  }
+
+  assignStats.lights = lights.size();
+  assignStats.assignments = pairCount;
+  assignStats.assignMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+ClusterLightBuffers::ClusterLightBuffers() {
+  glGenBuffers(3, buffers);
+  glGenTextures(3, textures);
+  const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+  // zeros until the first upload: every cluster there, none with lights
+  std::vector<uint32_t> zeros((size_t)LightClusters::CLUSTER_COUNT * 2, 0);
+  for (int i = 0; i < 3; i++) {
+    glState.bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, zeros.size() * sizeof(uint32_t), zeros.data(), GL_STREAM_DRAW);
+    glState.bindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+  }
+  glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+ClusterLightBuffers::~ClusterLightBuffers() {
+  glState.deleteTextures(3, textures);
+  glState.deleteBuffers(3, buffers);
+}
+
+void ClusterLightBuffers::upload(const PointLights& viewLights, const LightClusters& clusters) {
+  lightTexels.resize(viewLights.size() * 8);
+  for (size_t i = 0; i < viewLights.size(); i++) {
+    float* texel = &lightTexels[i * 8];
+    texel[0] = viewLights.x[i];
+    texel[1] = viewLights.y[i];
+    texel[2] = viewLights.z[i];
+    texel[3] = viewLights.radius[i];
+    texel[4] = viewLights.color[i].r;
+    texel[5] = viewLights.color[i].g;
+    texel[6] = viewLights.color[i].b;
+    texel[7] = 0.0f;
+  }
+  // orphaned every frame, so the driver never waits on last frame's reads
+  auto fill = [](GLuint buffer, const void* data, size_t bytes) {
+    glState.bindBuffer(GL_TEXTURE_BUFFER, buffer);
+    // an empty buffer can't back a texture on every driver, keep a texel
+    glBufferData(GL_TEXTURE_BUFFER, (GLsizeiptr)std::max(bytes, (size_t)16), nullptr, GL_STREAM_DRAW);
+    if (bytes > 0) {
+      glBufferSubData(GL_TEXTURE_BUFFER, 0, (GLsizeiptr)bytes, data);
+    }
+  };
+  fill(buffers[0], lightTexels.data(), lightTexels.size() * sizeof(float));
+  fill(buffers[1], clusters.ranges().data(), clusters.ranges().size() * sizeof(uint32_t));
+  fill(buffers[2], clusters.indices().data(), clusters.indices().size() * sizeof(uint32_t));
+  glState.bindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusterLightBuffers::bind(int firstUnit) const {
+  for (int i = 0; i < 3; i++) {
+    glState.activeTexture(GL_TEXTURE0 + firstUnit + i);
+    glState.bindTexture(GL_TEXTURE_BUFFER, textures[i]);
+  }
+  glState.activeTexture(GL_TEXTURE0);
+}
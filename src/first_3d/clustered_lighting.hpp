@@ -0,0 +1,111 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "frustum_culling.hpp"
+
+// Point lights as structure-of-arrays, in whatever space the caller
+// keeps them; LightClusters wants them in view space.
+struct PointLights {
+  std::vector<float> x, y, z, radius;
+  std::vector<glm::vec3> color;
+
+  void push(const glm::vec3& position, float r, const glm::vec3& c);
+  void clear();
+  size_t size() const { return radius.size(); }
+};
+
+// `count` lights at random in the box [min, max], random hues, each
+// reaching `radius`.
+PointLights scatterLights(size_t count, const glm::vec3& min, const glm::vec3& max, float radius, unsigned seed);
+// The radius at which `count` lights scattered over the box cover any
+// point in it about 8 times over, whatever the count.
+float lightRadiusFor(size_t count, const glm::vec3& min, const glm::vec3& max);
+
+// Clustered forward shading: the view frustum cut into TILES_X x TILES_Y
+// screen tiles and SLICES depth slices, exponentially spaced so clusters
+// stay roughly cube shaped. assign() lists, for every cluster, the lights
+// whose sphere touches its view space box, and a fragment only loops
+// over the list of the cluster it falls in, so its cost follows the
+// number of lights nearby rather than the total.
+//
+// Clusters are numbered x fastest, then y, then slice. The fragment
+// shader finds its own from gl_FragCoord and view depth:
+//
+//   tile = gl_FragCoord.xy / tileUniform().xy
+//   slice = log(-viewZ) * depthUniform().x + depthUniform().y
+class LightClusters {
+  public:
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTER_COUNT = TILES_X * TILES_Y * SLICES;
+
+    struct Stats {
+      size_t lights = 0;
+      size_t assignments = 0;      // light-cluster pairs
+      size_t occupiedClusters = 0;
+      uint32_t maxPerCluster = 0;
+      double assignMs = 0.0;
+    };
+
+    // The cluster boxes for a `width` x `height` pixel viewport and a
+    // glm::perspective(fovy, aspect, near, far) projection.
+    void setView(int width, int height, float fovy, float aspect, float near, float far);
+    bool matches(int width, int height) const { return width == viewWidth && height == viewHeight; }
+    // `lights` in view space
+    void assign(const PointLights& lights, CullPath path = bestCullPath());
+
+    // per cluster the first entry in indices() and the count
+    const std::vector<uint32_t>& ranges() const { return clusterRanges; }
+    const std::vector<uint32_t>& indices() const { return lightIndices; }
+    const Stats& stats() const { return assignStats; }
+    // pixels per tile and tiles across and down
+    glm::vec4 tileUniform() const;
+    // slice scale and bias for log(-viewZ), and the slice count
+    glm::vec3 depthUniform() const;
+
+  private:
+    int viewWidth = 0;
+    int viewHeight = 0;
+    int tileWidth = 1;
+    int tileHeight = 1;
+    float tanHalfX = 1.0f;
+    float tanHalfY = 1.0f;
+    float near = 0.1f;
+    float far = 100.0f;
+    float sliceScale = 1.0f;
+    float sliceBias = 0.0f;
+    // cluster boxes as structure-of-arrays, so one light is tested
+    // against 4 or 8 neighbouring clusters of a row at once
+    std::vector<float> boxMinX, boxMaxX, boxMinY, boxMaxY, boxMinZ, boxMaxZ;
+    std::vector<uint32_t> pairClusters;
+    std::vector<uint32_t> pairLights;
+    std::vector<uint32_t> clusterRanges;
+    std::vector<uint32_t> lightIndices;
+    Stats assignStats;
+};
+
+// The lights and cluster lists as buffer textures for the fragment
+// shader: view space position and radius, then color, per light (RGBA32F,
+// 2 texels a light), first and count per cluster (RG32UI) and the light
+// indices (R32UI). upload() replaces all three every frame. The
+// destructor deletes them, so it has to run before glfwTerminate().
+class ClusterLightBuffers {
+  public:
+    ClusterLightBuffers();
+    ~ClusterLightBuffers();
+    ClusterLightBuffers(const ClusterLightBuffers&) = delete;
+    ClusterLightBuffers& operator=(const ClusterLightBuffers&) = delete;
+
+    void upload(const PointLights& viewLights, const LightClusters& clusters);
+    // the light data, ranges and indices on `firstUnit` and the two after it
+    void bind(int firstUnit) const;
+
+  private:
+    GLuint buffers[3];
+    GLuint textures[3];
+    std::vector<float> lightTexels;
+};
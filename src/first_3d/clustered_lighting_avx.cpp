@@ -0,0 +1,35 @@
+#include "avx_kernels.hpp"
+
+#ifdef __AVX__
+#include <immintrin.h>
+
+size_t touchClustersAvx(const float* const* boxes, const float* sphere, size_t first, size_t end, uint32_t* out,
+  size_t& count) {
+  const float* minX = boxes[0];
+  const float* maxX = boxes[1];
+  const float* minY = boxes[2];
+  const float* maxY = boxes[3];
+  const float* minZ = boxes[4];
+  const float* maxZ = boxes[5];
+  size_t n = first + ((end - first) & ~(size_t)7);
+  __m256 x = _mm256_set1_ps(sphere[0]), y = _mm256_set1_ps(sphere[1]), z = _mm256_set1_ps(sphere[2]);
+  __m256 radiusSquared = _mm256_set1_ps(sphere[3]);
+  __m256 zero = _mm256_setzero_ps();
+  for (size_t c = first; c < n; c += 8) {
+    __m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minX + c), x),
+      _mm256_sub_ps(x, _mm256_loadu_ps(maxX + c))), zero);
+    __m256 dy = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minY + c), y),
+      _mm256_sub_ps(y, _mm256_loadu_ps(maxY + c))), zero);
+    __m256 dz = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minZ + c), z),
+      _mm256_sub_ps(z, _mm256_loadu_ps(maxZ + c))), zero);
+    __m256 distanceSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+      _mm256_mul_ps(dz, dz));
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(distanceSquared, radiusSquared, _CMP_LE_OQ));
+    for (int lane = 0; lane < 8; lane++) {
+      out[count] = (uint32_t)(c + lane);
+      count += (mask >> lane) & 1;
+    }
+  }
+  return n;
+}
+#endif
@@ -0,0 +1,96 @@
+#include <glad/glad.h>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include "cube_instances.hpp"
+#include "gl_state.hpp"
+
+std::vector<float> makeRoundedCube(int segments, float rounding) {
+  // per face: the normal axis and the axes u and v run along, so that
+  // u x v points outwards and the triangles wind counter-clockwise
+  const glm::vec3 faces[6][3] = {
+    {{0, 0, -1}, {-1, 0, 0}, {0, 1, 0}}, {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},
+    {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}}, {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}},
+    {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}}, {{0, 1, 0}, {1, 0, 0}, {0, 0, -1}},
+  };
+  std::vector<float> vertices;
+  auto addVertex = [&](const glm::vec3 (&face)[3], int i, int j) {
+    float u = (float)i / segments, v = (float)j / segments;
+    glm::vec3 flat = 0.5f * face[0] + (u - 0.5f) * face[1] + (v - 0.5f) * face[2];
+    glm::vec3 position = glm::mix(flat, 0.5f * glm::normalize(flat), rounding);
+    float vertex[] = {position.x, position.y, position.z, u, v};
+    vertices.insert(vertices.end(), vertex, vertex + 5);
+  };
+  for (const glm::vec3 (&face)[3] : faces) {
+    for (int j = 0; j < segments; j++) {
+      for (int i = 0; i < segments; i++) {
+        addVertex(face, i, j);
+        addVertex(face, i + 1, j);
+        addVertex(face, i + 1, j + 1);
+        addVertex(face, i + 1, j + 1);
+        addVertex(face, i, j + 1);
+        addVertex(face, i, j);
+      }
+    }
+  }
+  return vertices;
+}
+
+std::vector<CubeInstance> makeCubeInstances(const glm::vec3* fixedPositions, int fixedCount, int count) {
+  std::vector<CubeInstance> cubes(count);
+  // a cube of cubes 1.5 units apart, its front face just behind the fixed ones
+  int side = (int)std::ceil(std::cbrt((double)count));
+  float spacing = 1.5f;
+  glm::vec3 origin = glm::vec3(-0.5f * spacing * (side - 1), -0.5f * spacing * (side - 1), -20.0f);
+  for (int i = 0; i < count; i++) {
+    if (i < fixedCount) {
+      cubes[i] = {fixedPositions[i], 20.0f * (i + 5.0f)};
+      continue;
+    }
+    int cell = i - fixedCount;
+    glm::vec3 gridCell = glm::vec3(cell % side, cell / side % side, -(cell / (side * side)));
+    // spins cycle through the same range as the fixed cubes
+    cubes[i] = {origin + gridCell * spacing, 20.0f * (cell % 16 + 5.0f)};
+  }
+  return cubes;
+}
+
+uint32_t cubeMaterial(uint32_t cube) {
+  return (cube * 7 + cube / 5) % CUBE_MATERIAL_COUNT;
+}
+
+glm::mat4 cubeModelMatrix(const glm::mat4& scene, const CubeInstance& cube, float time) {
+  glm::mat4 model = glm::translate(scene, cube.position);
+  return glm::rotate(model, glm::radians(cube.spin * time), CUBE_SPIN_AXIS);
+}
+
+CubeInstanceBuffer::CubeInstanceBuffer(GLuint VAO, GLuint location) : VAO(VAO), location(location) {
+  glGenBuffers(1, &bufferId);
+  pointAttribute(bufferId, 0);
+}
+
+void CubeInstanceBuffer::pointAttribute(GLuint buffer, GLintptr offset) {
+  glState.bindVertexArray(VAO);
+  glState.bindBuffer(GL_ARRAY_BUFFER, buffer);
+  // advances once per cube instead of once per vertex
+  setupVertexAttributes(cubeInstanceLayout, location, 1, offset);
+  glState.bindVertexArray(0);
+  glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void CubeInstanceBuffer::upload(const std::vector<CubeInstance>& cubes) {
+  glState.bindBuffer(GL_ARRAY_BUFFER, bufferId);
+  glBufferData(GL_ARRAY_BUFFER, cubes.size() * sizeof(CubeInstance), cubes.data(), GL_STATIC_DRAW);
+  glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+  pointAttribute(bufferId, 0);
+  instanceCount = (GLsizei)cubes.size();
+}
+
+void CubeInstanceBuffer::source(GLuint buffer, GLintptr offset, GLsizei count) {
+  pointAttribute(buffer, offset);
+  instanceCount = count;
+}
+
+void CubeInstanceBuffer::draw(GLsizei indexCount, size_t firstIndex) const {
+  glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)(firstIndex * sizeof(uint16_t)),
+    instanceCount);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "vertex_layout.hpp"
+
+template <> struct VertexAttributeTraits<glm::vec3> {
+  static constexpr GLint components = 3;
+  static constexpr GLenum type = GL_FLOAT;
+  static constexpr GLboolean normalized = GL_FALSE;
+  static constexpr const char* glslType = "vec3";
+};
+
+// The cube every path draws, as an unindexed triangle list of position
+// and uv (5 floats a vertex): each face a `segments` x `segments` grid
+// with the face's whole texture on it, pulled towards a sphere by
+// `rounding` (0 flat, 1 a sphere) so distant cubes have detail a LOD can
+// drop. Stays inside CUBE_BOUNDING_RADIUS.
+std::vector<float> makeRoundedCube(int segments, float rounding);
+
+// What varies from cube to cube. The spin axis and the scene tilt are
+// shared, so 16 bytes per cube are enough for the instanced path, which
+// builds the model transform in the vertex shader from these and `time`.
+struct CubeInstance {
+  glm::vec3 position;
+  float spin;  // degrees per second around CUBE_SPIN_AXIS
+};
+constexpr auto cubeInstanceLayout = makeVertexLayout<CubeInstance>({
+  VERTEX_ATTRIBUTE(CubeInstance, position, "aInstancePos"),
+  VERTEX_ATTRIBUTE(CubeInstance, spin, "aInstanceSpin"),
+});
+
+const glm::vec3 CUBE_SPIN_AXIS = glm::vec3(1.0f, 0.3f, 0.5f);
+// half the diagonal of the unit cube, bounds it at any rotation
+const float CUBE_BOUNDING_RADIUS = 0.8660254f;
+
+// What a cube looks like in the one draw per cube path: which of the two
+// cube programs draws it, which layers of the material list it mixes and,
+// for the blended ones, its opacity.
+struct CubeMaterial {
+  uint32_t program;  // 0 plain, 1 striped
+  int baseLayer;
+  int overlayLayer;
+  float opacity;
+};
+const CubeMaterial CUBE_MATERIALS[] = {
+  {0, 0, 1, 1.0f},
+  {0, 1, 0, 1.0f},
+  {1, 0, 0, 1.0f},
+  {1, 1, 1, 1.0f},
+  {0, 0, 1, 0.5f},
+  {1, 1, 0, 0.4f},
+};
+const uint32_t CUBE_MATERIAL_COUNT = sizeof(CUBE_MATERIALS) / sizeof(CUBE_MATERIALS[0]);
+// neighbouring cubes mostly get different ones
+uint32_t cubeMaterial(uint32_t cube);
+
+// The first `fixedCount` cubes sit at `fixedPositions` and spin as the
+// scene always did; the rest fill a grid behind them, sized to `count`.
+std::vector<CubeInstance> makeCubeInstances(const glm::vec3* fixedPositions, int fixedCount, int count);
+
+// What the per-cube path sends as "model" for one cube.
+glm::mat4 cubeModelMatrix(const glm::mat4& scene, const CubeInstance& cube, float time);
+
+// Per-instance vertex attributes fed from a buffer of CubeInstance, added to
+// an existing VAO so the cube vertices are shared with the per-cube path.
+// cubeInstanceLayout takes `location` and the one after it.
+class CubeInstanceBuffer {
+  public:
+    CubeInstanceBuffer(GLuint VAO, GLuint location);
+    CubeInstanceBuffer(const CubeInstanceBuffer&) = delete;
+    CubeInstanceBuffer& operator=(const CubeInstanceBuffer&) = delete;
+    // into the buffer's own store, for cube lists that stay put
+    void upload(const std::vector<CubeInstance>& cubes);
+    // points the attribute at `count` records that start at `offset` in
+    // `buffer` instead, e.g. this frame's StreamBuffer allocation
+    void source(GLuint buffer, GLintptr offset, GLsizei count);
+    // every cube in one call, expects the VAO with its 16-bit index buffer
+    // to be bound; `firstIndex` picks a detail level's range
+    void draw(GLsizei indexCount, size_t firstIndex = 0) const;
+    GLsizei count() const { return instanceCount; }
+  private:
+    void pointAttribute(GLuint buffer, GLintptr offset);
+
+    GLuint VAO;
+    GLuint location;
+    GLuint bufferId;
+    GLsizei instanceCount = 0;
+};
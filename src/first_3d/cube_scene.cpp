@@ -0,0 +1,130 @@
+#include <algorithm>
+#include "cube_scene.hpp"
+
+CubeScene::CubeScene(std::vector<CubeInstance> cubes, const glm::mat4& scene)
+  : allCubes(std::move(cubes)), scene(scene), spinAxis(glm::normalize(CUBE_SPIN_AXIS)) {
+  // cubes only spin in place, so their world space bounds never change
+  for (const CubeInstance& cube : allCubes) {
+    bounds.push(glm::vec3(scene * glm::vec4(cube.position, 1.0f)), CUBE_BOUNDING_RADIUS);
+    transforms.push(cube.position, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
+  }
+  culled.resize(allCubes.size());
+  levels.resize(allCubes.size());
+  chunkLevels.resize((allCubes.size() + CHUNK_SIZE - 1) / CHUNK_SIZE);
+  chunkVisible.resize(chunkLevels.size());
+  chunkOccluded.resize(chunkLevels.size());
+  visibleCubes.resize(allCubes.size());
+}
+
+// The coarsest level within the error budget, or `current` while that is
+// still within it and the coarser choice is not clearly better.
+static int selectLevel(const CubeScene::LodSelection& lod, float distance, int current) {
+  float pixelsPerError = lod.pixelsPerUnit / std::max(distance, 1e-3f);
+  int level = 0;
+  while (level + 1 < lod.levelCount && lod.levelErrors[level + 1] * pixelsPerError <= lod.maxPixelError) {
+    level++;
+  }
+  current = std::min(current, lod.levelCount - 1);
+  if (level > current && lod.levelErrors[level] * pixelsPerError > lod.maxPixelError * (1.0f - lod.hysteresis)) {
+    return current;
+  }
+  return level;
+}
+
+size_t CubeScene::update(JobSystem& jobs, const Frustum* frustum, const DepthPyramid* occluders, const LodSelection* lod,
+  float time, CubeInstance* instances) {
+  bool occlusion = occluders && !occluders->empty();
+  if (!instances) {
+    modelMatrices.resize(allCubes.size());
+  }
+  JobSystem::Job* cull = jobs.parallelFor(chunkLevels.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t chunk = begin; chunk < end; chunk++) {
+      size_t first = chunk * CHUNK_SIZE;
+      size_t last = std::min(allCubes.size(), first + CHUNK_SIZE);
+      size_t count;
+      if (frustum) {
+        count = cullSpheres(*frustum, bounds, first, last, &culled[first]);
+      } else {
+        for (size_t i = first; i < last; i++) {
+          culled[i] = (uint32_t)i;
+        }
+        count = last - first;
+      }
+      chunkOccluded[chunk] = 0;
+      if (occlusion) {
+        // compacted in place, the order stays ascending
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+          uint32_t cube = culled[first + i];
+          glm::vec3 center = glm::vec3(bounds.centerX[cube], bounds.centerY[cube], bounds.centerZ[cube]);
+          glm::vec3 extent = glm::vec3(bounds.radius[cube]);
+          culled[first + kept] = cube;
+          kept += occluders->boxVisible(center - extent, center + extent);
+        }
+        chunkOccluded[chunk] = count - kept;
+        count = kept;
+      }
+      chunkVisible[chunk] = count;
+      std::array<size_t, MAX_LODS>& levelCounts = chunkLevels[chunk];
+      levelCounts.fill(0);
+      for (size_t i = 0; i < count; i++) {
+        uint32_t cube = culled[first + i];
+        if (lod) {
+          // to the nearest point of the bounds, so the error is never underestimated
+          glm::vec3 center = glm::vec3(bounds.centerX[cube], bounds.centerY[cube], bounds.centerZ[cube]);
+          float distance = glm::length(center - lod->camera) - bounds.radius[cube];
+          levels[cube] = (uint8_t)selectLevel(*lod, distance, levels[cube]);
+        } else {
+          levels[cube] = 0;
+        }
+        levelCounts[levels[cube]]++;
+      }
+    }
+  });
+  visibleCount = 0;
+  occludedCount = 0;
+  JobSystem::Job* offsets = jobs.add([&] {
+    for (int level = 0; level < MAX_LODS; level++) {
+      levelStarts[level] = visibleCount;
+      for (std::array<size_t, MAX_LODS>& levelCounts : chunkLevels) {
+        size_t offset = visibleCount;
+        visibleCount += levelCounts[level];
+        levelCounts[level] = offset;
+      }
+    }
+    levelStarts[MAX_LODS] = visibleCount;
+    for (size_t occluded : chunkOccluded) {
+      occludedCount += occluded;
+    }
+  }, {cull});
+  JobSystem::Job* fill = jobs.parallelFor(chunkLevels.size(), 1, [&](size_t begin, size_t end) {
+    for (size_t chunk = begin; chunk < end; chunk++) {
+      size_t first = chunk * CHUNK_SIZE;
+      std::array<size_t, MAX_LODS> starts = chunkLevels[chunk];
+      std::array<size_t, MAX_LODS> next = starts;
+      for (size_t i = 0; i < chunkVisible[chunk]; i++) {
+        uint32_t cube = culled[first + i];
+        size_t slot = next[levels[cube]]++;
+        visibleCubes[slot] = cube;
+        if (instances) {
+          // the 16 byte record, not a composed matrix: a mat4 would stream
+          // 4x the bytes per cube, while the instanced VS rebuilds the
+          // rotation from spin and time in a few ALU ops
+          instances[slot] = allCubes[cube];
+        } else {
+          // the same spin cubeModelMatrix() gives; ranges touch only their own cubes
+          transforms.setRotation(cube, glm::angleAxis(glm::radians(allCubes[cube].spin * time), spinAxis));
+        }
+      }
+      if (!instances) {
+        for (int level = 0; level < MAX_LODS; level++) {
+          std::span<const uint32_t> levelCubes(visibleCubes.data() + starts[level], next[level] - starts[level]);
+          composeTransforms(scene, transforms, levelCubes, modelMatrices.data() + starts[level]);
+        }
+      }
+    }
+  }, {offsets});
+  jobs.wait(fill);
+  jobs.reset();
+  return visibleCount;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "cube_instances.hpp"
+#include "frustum_culling.hpp"
+#include "job_system.hpp"
+#include "occlusion_culling.hpp"
+#include "transforms.hpp"
+
+// The CPU side of a frame of cubes, run as a job graph:
+//
+//   cull ranges -> offsets -> fill ranges
+//
+// Every range of CHUNK_SIZE cubes is culled into its own slice of a
+// scratch list, against the frustum and then, for the survivors, the
+// bounding box of their sphere against a depth pyramid, and picks each
+// survivor's detail level. One small job turns the per-range, per-level
+// counts into offsets, then every range copies its visible cubes to
+// their final place, grouped by level: the indices, plus either the
+// instance records (instanced path, written straight into the mapped
+// instance buffer) or the animated model matrices (one draw per cube
+// path). Those come from the cubes' TransformArrays: a range writes its
+// visible cubes' spin for the frame as quaternions, then composes their
+// matrices 4 or 8 at a time.
+class CubeScene {
+  public:
+    static const size_t CHUNK_SIZE = 16384;
+    static const int MAX_LODS = 4;
+
+    // How update() picks a cube's level: the coarsest whose error,
+    // projected to pixels at the cube's distance, is at most
+    // maxPixelError. A cube goes finer as soon as its level gets worse
+    // than that, but coarser only once the coarser level is better by
+    // `hysteresis` of it, so cubes near a switching distance don't flicker.
+    struct LodSelection {
+      float levelErrors[MAX_LODS];  // in cube units, finest first
+      int levelCount;
+      glm::vec3 camera;
+      float pixelsPerUnit;  // at distance 1: viewport height / (2 tan(fovy / 2))
+      float maxPixelError = 1.0f;
+      float hysteresis = 0.25f;
+    };
+
+    CubeScene(std::vector<CubeInstance> cubes, const glm::mat4& scene);
+
+    // `frustum` null draws everything, `occluders` null or empty skips
+    // the occlusion test, `lod` null draws every cube at level 0. With
+    // `instances` set (room for every cube) the visible records go there,
+    // otherwise models() is filled for `time`. Returns the visible count.
+    size_t update(JobSystem& jobs, const Frustum* frustum, const DepthPyramid* occluders, const LodSelection* lod,
+      float time, CubeInstance* instances);
+
+    const std::vector<CubeInstance>& cubes() const { return allCubes; }
+    // as of the last update(), by level, then in ascending cube order
+    std::span<const uint32_t> visible() const { return {visibleCubes.data(), visibleCount}; }
+    // level l is visible()[lodStarts()[l], lodStarts()[l + 1]), and the
+    // same range of models() and of the instance records
+    const std::array<size_t, MAX_LODS + 1>& lodStarts() const { return levelStarts; }
+    // in the frustum but hidden, as of the last update()
+    size_t occluded() const { return occludedCount; }
+    std::span<const glm::mat4> models() const { return {modelMatrices.data(), modelMatrices.empty() ? 0 : visibleCount}; }
+
+  private:
+    std::vector<CubeInstance> allCubes;
+    glm::mat4 scene;
+    SphereBounds bounds;
+    TransformArrays transforms;
+    glm::vec3 spinAxis;
+    std::vector<uint32_t> culled;       // CHUNK_SIZE slots per range
+    std::vector<uint8_t> levels;        // every cube's, kept for the hysteresis
+    // per range, count then offset of each level
+    std::vector<std::array<size_t, MAX_LODS>> chunkLevels;
+    std::vector<size_t> chunkVisible;   // after culling, per range
+    std::vector<size_t> chunkOccluded;
+    std::vector<uint32_t> visibleCubes;  // sized for every cube
+    size_t visibleCount = 0;
+    std::array<size_t, MAX_LODS + 1> levelStarts = {};
+    size_t occludedCount = 0;
+    std::vector<glm::mat4> modelMatrices;
+};
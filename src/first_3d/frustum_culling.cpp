@@ -0,0 +1,136 @@
+#include <cmath>
+#include "frustum_culling.hpp"
+#include "avx_kernels.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+Frustum extractFrustum(const glm::mat4& viewProjection) {
+  // glm is column-major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+  auto row = [&](int i) {
+    return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+  };
+  Frustum frustum;
+  frustum.planes[0] = row(3) + row(0);
+  frustum.planes[1] = row(3) - row(0);
+  frustum.planes[2] = row(3) + row(1);
+  frustum.planes[3] = row(3) - row(1);
+  frustum.planes[4] = row(3) + row(2);
+  frustum.planes[5] = row(3) - row(2);
+  for (glm::vec4& plane : frustum.planes) {
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+void SphereBounds::push(const glm::vec3& center, float r) {
+  centerX.push_back(center.x);
+  centerY.push_back(center.y);
+  centerZ.push_back(center.z);
+  radius.push_back(r);
+}
+
+void SphereBounds::clear() {
+  centerX.clear();
+  centerY.clear();
+  centerZ.clear();
+  radius.clear();
+}
+
+const char* cullPathName(CullPath path) {
+  switch (path) {
+    case CullPath::Sse: return "SSE";
+    case CullPath::Avx: return "AVX";
+    default: return "scalar";
+  }
+}
+
+bool cullPathAvailable(CullPath path) {
+  switch (path) {
+#ifdef __SSE2__
+    case CullPath::Sse: return true;
+#endif
+    case CullPath::Avx: return cpuHasAvx();
+    case CullPath::Scalar: return true;
+    default: return false;
+  }
+}
+
+CullPath bestCullPath() {
+  if (cpuHasAvx()) {
+    return CullPath::Avx;
+  }
+#if defined(__SSE2__)
+  return CullPath::Sse;
+#else
+  return CullPath::Scalar;
+#endif
+}
+
+// spheres [first, end) one at a time, also the tail of the SIMD paths
+static void cullSpheresScalar(const Frustum& frustum, const SphereBounds& bounds, size_t first, size_t end,
+  uint32_t* out, size_t& count) {
+  for (size_t i = first; i < end; i++) {
+    bool inside = true;
+    for (const glm::vec4& plane : frustum.planes) {
+      float distance = plane.x * bounds.centerX[i] + plane.y * bounds.centerY[i] + plane.z * bounds.centerZ[i] + plane.w;
+      inside &= distance > -bounds.radius[i];
+    }
+    out[count] = (uint32_t)i;
+    count += inside;
+  }
+}
+
+#ifdef __SSE2__
+static size_t cullSpheresSse(const Frustum& frustum, const SphereBounds& bounds, size_t first, size_t end,
+  uint32_t* out, size_t& count) {
+  size_t n = first + ((end - first) & ~(size_t)3);
+  for (size_t i = first; i < n; i += 4) {
+    __m128 x = _mm_loadu_ps(&bounds.centerX[i]);
+    __m128 y = _mm_loadu_ps(&bounds.centerY[i]);
+    __m128 z = _mm_loadu_ps(&bounds.centerZ[i]);
+    __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[i]));
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const glm::vec4& plane : frustum.planes) {
+      __m128 distance = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+        _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+      inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, negRadius));
+    }
+    // compaction: every lane is written, only the visible ones advance
+    int mask = _mm_movemask_ps(inside);
+    for (int lane = 0; lane < 4; lane++) {
+      out[count] = (uint32_t)(i + lane);
+      count += (mask >> lane) & 1;
+    }
+  }
+  return n;
+}
+#endif
+
+size_t cullSpheres(const Frustum& frustum, const SphereBounds& bounds, size_t first, size_t end, uint32_t* out,
+  CullPath path) {
+  size_t count = 0;
+  size_t done = first;
+#ifdef HAVE_AVX_KERNELS
+  if (path == CullPath::Avx && cpuHasAvx()) {
+    done = cullSpheresAvx(&frustum.planes[0].x, bounds.centerX.data(), bounds.centerY.data(), bounds.centerZ.data(),
+      bounds.radius.data(), first, end, out, count);
+  }
+#endif
+#ifdef __SSE2__
+  if (path == CullPath::Sse) {
+    done = cullSpheresSse(frustum, bounds, first, end, out, count);
+  }
+#endif
+  cullSpheresScalar(frustum, bounds, done, end, out, count);
+  return count;
+}
+
+size_t cullSpheres(const Frustum& frustum, const SphereBounds& bounds, std::vector<uint32_t>& visible, CullPath path) {
+  // sized for the worst case up front, the paths store unconditionally
+  visible.resize(bounds.size());
+  visible.resize(cullSpheres(frustum, bounds, 0, bounds.size(), visible.data(), path));
+  return visible.size();
+}
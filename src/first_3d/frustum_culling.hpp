@@ -0,0 +1,41 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The six planes of a view frustum, normals pointing inwards and
+// normalized, so plane.xyz . p + plane.w is the signed distance of p.
+struct Frustum {
+  glm::vec4 planes[6];  // left, right, bottom, top, near, far
+};
+
+// Planes of the clip volume of `viewProjection` (projection * view), in
+// the space the matrix takes points from.
+Frustum extractFrustum(const glm::mat4& viewProjection);
+
+// Bounding spheres as structure-of-arrays, so the SIMD paths load 4 or 8
+// objects' worth of one component at a time.
+struct SphereBounds {
+  std::vector<float> centerX, centerY, centerZ, radius;
+
+  void push(const glm::vec3& center, float r);
+  void clear();
+  size_t size() const { return radius.size(); }
+};
+
+enum class CullPath { Scalar, Sse, Avx };
+const char* cullPathName(CullPath path);
+// whether this build compiled the path in and this CPU runs it
+bool cullPathAvailable(CullPath path);
+// the widest available path
+CullPath bestCullPath();
+
+// Replaces `visible` with the indices, in ascending order, of the spheres
+// that are at least partly inside `frustum`, and returns their count.
+size_t cullSpheres(const Frustum& frustum, const SphereBounds& bounds, std::vector<uint32_t>& visible,
+  CullPath path = bestCullPath());
+// The same for spheres [first, end) only, into `out`, which needs room
+// for end - first indices even if fewer are visible.
+size_t cullSpheres(const Frustum& frustum, const SphereBounds& bounds, size_t first, size_t end, uint32_t* out,
+  CullPath path = bestCullPath());
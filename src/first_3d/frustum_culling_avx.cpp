@@ -0,0 +1,29 @@
+#include "avx_kernels.hpp"
+
+#ifdef __AVX__
+#include <immintrin.h>
+
+size_t cullSpheresAvx(const float* planes, const float* centerX, const float* centerY, const float* centerZ,
+  const float* radius, size_t first, size_t end, uint32_t* out, size_t& count) {
+  size_t n = first + ((end - first) & ~(size_t)7);
+  for (size_t i = first; i < n; i += 8) {
+    __m256 x = _mm256_loadu_ps(centerX + i);
+    __m256 y = _mm256_loadu_ps(centerY + i);
+    __m256 z = _mm256_loadu_ps(centerZ + i);
+    __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+    __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const float* plane = planes; plane < planes + 6 * 4; plane += 4) {
+      __m256 distance = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane[0])), _mm256_mul_ps(y, _mm256_set1_ps(plane[1]))),
+        _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane[2])), _mm256_set1_ps(plane[3])));
+      inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_GT_OQ));
+    }
+    int mask = _mm256_movemask_ps(inside);
+    for (int lane = 0; lane < 8; lane++) {
+      out[count] = (uint32_t)(i + lane);
+      count += (mask >> lane) & 1;
+    }
+  }
+  return n;
+}
+#endif
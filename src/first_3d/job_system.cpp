@@ -0,0 +1,181 @@
+#include "job_system.hpp"
+
+namespace {
+// which JobSystem queue the current thread owns, and the job it is running
+thread_local const JobSystem* currentSystem = nullptr;
+thread_local unsigned int currentQueueIndex = 0;
+thread_local JobSystem::Job* currentJob = nullptr;
+}
+
+JobSystem::JobSystem(unsigned int workerCount) {
+  for (unsigned int i = 0; i <= workerCount; i++) {
+    queues.push_back(std::make_unique<WorkQueue>());
+  }
+  for (unsigned int i = 1; i <= workerCount; i++) {
+    workers.emplace_back(&JobSystem::workerLoop, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  wakeWorkers.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+JobSystem::Job* JobSystem::allocate() {
+  std::lock_guard<std::mutex> lock(poolMutex);
+  if (poolUsed == pool.size()) {
+    pool.emplace_back();
+  }
+  Job* job = &pool[poolUsed++];
+  job->work = nullptr;
+  job->parent = nullptr;
+  job->unfinished = 1;
+  job->blockers = 1;  // held until add() saw every dependency
+  job->finished = false;
+  job->continuations.clear();
+  return job;
+}
+
+JobSystem::Job* JobSystem::add(std::function<void()> work, std::initializer_list<Job*> dependencies) {
+  Job* job = allocate();
+  job->work = std::move(work);
+  if (currentJob) {
+    job->parent = currentJob;
+    currentJob->unfinished++;
+  }
+  for (Job* dependency : dependencies) {
+    std::lock_guard<std::mutex> lock(dependency->mutex);
+    if (!dependency->finished) {
+      dependency->continuations.push_back(job);
+      job->blockers++;
+    }
+  }
+  if (--job->blockers == 0) {
+    push(job);
+  }
+  return job;
+}
+
+JobSystem::Job* JobSystem::parallelFor(size_t count, size_t grain, std::function<void(size_t begin, size_t end)> work,
+  std::initializer_list<Job*> dependencies) {
+  grain = std::max<size_t>(1, grain);
+  // the ranges are added by a job of their own, so they all wait on
+  // `dependencies` through it and it only finishes after the last range
+  return add([this, count, grain, work = std::move(work)] {
+    const std::function<void(size_t, size_t)>* rangeWork = &work;
+    for (size_t begin = 0; begin < count; begin += grain) {
+      size_t end = std::min(count, begin + grain);
+      add([rangeWork, begin, end] { (*rangeWork)(begin, end); });
+    }
+  }, dependencies);
+}
+
+void JobSystem::push(Job* job) {
+  WorkQueue& queue = *queues[currentQueue()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(job);
+  }
+  queuedJobs++;
+  // taken so a worker between its empty check and its sleep can't miss this
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  wakeWorkers.notify_one();
+}
+
+JobSystem::Job* JobSystem::findJob(unsigned int queueIndex) {
+  {
+    WorkQueue& own = *queues[queueIndex];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      Job* job = own.jobs.back();
+      own.jobs.pop_back();
+      queuedJobs--;
+      return job;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); i++) {
+    WorkQueue& victim = *queues[(queueIndex + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      Job* job = victim.jobs.front();
+      victim.jobs.pop_front();
+      queuedJobs--;
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+void JobSystem::run(Job* job) {
+  Job* outerJob = currentJob;
+  currentJob = job;
+  if (job->work) {
+    job->work();
+  }
+  currentJob = outerJob;
+  finish(job);
+}
+
+void JobSystem::finish(Job* job) {
+  if (--job->unfinished > 0) {
+    return;
+  }
+  // read first, once `finished` is set the owner may recycle the job
+  Job* parent = job->parent;
+  std::vector<Job*> ready;
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->finished = true;
+    ready.swap(job->continuations);
+  }
+  for (Job* continuation : ready) {
+    if (--continuation->blockers == 0) {
+      push(continuation);
+    }
+  }
+  if (parent) {
+    finish(parent);
+  }
+}
+
+unsigned int JobSystem::currentQueue() const {
+  return currentSystem == this ? currentQueueIndex : 0;
+}
+
+void JobSystem::wait(Job* job) {
+  unsigned int queueIndex = currentQueue();
+  while (!job->finished) {
+    if (Job* next = findJob(queueIndex)) {
+      run(next);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::reset() {
+  std::lock_guard<std::mutex> lock(poolMutex);
+  poolUsed = 0;
+}
+
+void JobSystem::workerLoop(unsigned int queueIndex) {
+  currentSystem = this;
+  currentQueueIndex = queueIndex;
+  while (true) {
+    if (Job* job = findJob(queueIndex)) {
+      run(job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    wakeWorkers.wait(lock, [this] { return queuedJobs > 0 || stopping; });
+    if (stopping) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing scheduler for the per-frame CPU work. Every thread, the
+// one that owns the JobSystem included, has its own deque: it pushes and
+// pops at the back, so it keeps working on what it just split off while
+// the data is still in cache, and idle threads steal from the front of
+// someone else's, which takes the oldest and usually largest piece.
+//
+// A frame builds its graph with add() and parallelFor(), naming the jobs
+// each one has to wait for, then wait()s on the last one. The owning
+// thread runs jobs while it waits instead of blocking. Jobs live until
+// reset(), which the owner calls once nothing is in flight any more.
+class JobSystem {
+  public:
+    struct Job;
+
+    // `workerCount` threads besides the owner, 0 runs everything inside wait()
+    explicit JobSystem(unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned int threadCount() const { return (unsigned int)queues.size(); }
+
+    // Runs `work` once every job in `dependencies` finished. Safe to call
+    // from inside a job, a job added there also holds back the one that
+    // added it from finishing.
+    Job* add(std::function<void()> work, std::initializer_list<Job*> dependencies = {});
+    // Runs `work` over [0, count) in ranges of at most `grain`, each its
+    // own job. The returned job finishes once every range did.
+    Job* parallelFor(size_t count, size_t grain, std::function<void(size_t begin, size_t end)> work,
+      std::initializer_list<Job*> dependencies = {});
+    // Runs jobs on the calling thread until `job` finished.
+    void wait(Job* job);
+    // Recycles every job added so far. Owner thread only, nothing in flight.
+    void reset();
+
+  private:
+    struct WorkQueue {
+      std::mutex mutex;
+      std::deque<Job*> jobs;
+    };
+
+    Job* allocate();
+    void push(Job* job);
+    Job* findJob(unsigned int queueIndex);
+    void run(Job* job);
+    void finish(Job* job);
+    unsigned int currentQueue() const;
+    void workerLoop(unsigned int queueIndex);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;  // [0] is the owner's
+    std::vector<std::thread> workers;
+    std::mutex poolMutex;
+    std::deque<Job> pool;  // deque so handed out jobs never move
+    size_t poolUsed = 0;
+
+    std::atomic<int> queuedJobs{0};
+    std::mutex sleepMutex;
+    std::condition_variable wakeWorkers;
+    bool stopping = false;
+};
+
+struct JobSystem::Job {
+  std::function<void()> work;
+  Job* parent = nullptr;
+  std::atomic<int> unfinished{0};  // the job itself plus the children it added
+  std::atomic<int> blockers{0};    // dependencies that did not finish yet
+  std::atomic<bool> finished{false};
+  std::mutex mutex;                // guards continuations against finishing
+  std::vector<Job*> continuations;
+};
@@ -1,25 +1,83 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
-#include <stb_image.h>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#include <algorithm>
+#include <array>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/constants.hpp>
 #include "shader.hpp"
+#include "texture_streamer.hpp"
+#include "frame_uniforms.hpp"
+#include "gl_extensions.hpp"
+#include "program_cache.hpp"
 #include "shader_sources.hpp"
+#include "cube_instances.hpp"
+#include "frustum_culling.hpp"
+#include "cube_scene.hpp"
+#include "job_system.hpp"
+#include "stream_buffer.hpp"
+#include "mesh_optimizer.hpp"
+#include "gl_state.hpp"
+#include "render_queue.hpp"
+#include "transforms.hpp"
+#include "occlusion_culling.hpp"
+#include "clustered_lighting.hpp"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
+float aspectRatio(int width, int height);
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
 
-GLuint loadTexture(const char* imgPath);
-
-
-
-int main() {
+void benchUniforms(GLFWwindow* window, Shader& shader, GLuint VAO, GLsizei indexCount, size_t firstIndex);
+void benchInstancing(GLFWwindow* window, Shader& shader, Shader& instancedShader, GLuint VAO, GLsizei indexCount,
+  size_t firstIndex, CubeInstanceBuffer& instanceBuffer, const glm::vec3* fixedPositions, int fixedCount, const glm::mat4& scene);
+void benchCulling();
+void benchSceneUpdate();
+void benchMeshOptimizer();
+void benchDrawSort();
+void benchTransforms();
+void benchLights(GLFWwindow* window, Shader& instancedShader, GLuint VAO, GLsizei indexCount, size_t firstIndex,
+  CubeInstanceBuffer& instanceBuffer, const glm::vec3* fixedPositions, int fixedCount, const glm::mat4& scene);
+void cubeFieldBounds(const std::vector<CubeInstance>& cubes, const glm::mat4& scene, glm::vec3& min, glm::vec3& max);
+void setClusterUniforms(Shader& shader, const LightClusters& clusters);
+int runDemo(GLFWwindow* window, int argc, char** argv, std::chrono::steady_clock::time_point startTime);
+
+
+int main(int argc, char** argv) {
+  auto startTime = std::chrono::steady_clock::now();
+  if (argc > 1 && strcmp(argv[1], "--bench-culling") == 0) {
+    benchCulling();
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "--bench-update") == 0) {
+    benchSceneUpdate();
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "--bench-mesh") == 0) {
+    benchMeshOptimizer();
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "--bench-sort") == 0) {
+    benchDrawSort();
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "--bench-transforms") == 0) {
+    benchTransforms();
+    return 0;
+  }
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -42,60 +100,65 @@ int main() {
       std::cout << "Failed to initialize GLAD" << std::endl;
       return -1;
   }
+  loadGLExtensions();
+
+  int result = runDemo(window, argc, argv, startTime);
+  glfwTerminate();
+  return result;
+}
+
+// Everything owning GL objects is a local in here, so it is all destroyed
+// while the context is still alive; main only terminates GLFW after this
+// returns.
+int runDemo(GLFWwindow* window, int argc, char** argv, std::chrono::steady_clock::time_point startTime) {
+  // --cubes <count> sets how many cubes are drawn, --instanced draws them all in one call,
+  // --no-cull submits the ones outside the view too, --threads <count> caps the scene update threads,
+  // --no-sort submits the per-cube draws in scene order instead of by sort key,
+  // --no-occlusion skips the test against the depth of a frame or two ago,
+  // --no-lod draws every cube with the full detail mesh, --lights <count> sets how many point
+  // lights move through the cubes (0 leaves them unlit)
+  int cubeCount = 10;
+  bool instanced = false;
+  bool cullCubes = true;
+  bool occlusionCull = true;
+  bool useLods = true;
+  bool sortDraws = true;
+  int lightCount = 64;
+  unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--cubes") == 0 && i + 1 < argc) {
+      cubeCount = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--instanced") == 0) {
+      instanced = true;
+    } else if (strcmp(argv[i], "--no-cull") == 0) {
+      cullCubes = false;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threadCount = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--no-sort") == 0) {
+      sortDraws = false;
+    } else if (strcmp(argv[i], "--no-occlusion") == 0) {
+      occlusionCull = false;
+    } else if (strcmp(argv[i], "--no-lod") == 0) {
+      useLods = false;
+    } else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) {
+      lightCount = std::max(0, atoi(argv[++i]));
+    }
+  }
+
+  Shader shader(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+  Shader stripedShader(vertexShaderSource.c_str(), stripedFragmentShaderSource.c_str());
+  Shader instancedShader(instancedVertexShaderSource.c_str(), fragmentShaderSource.c_str());
+  // textures show a placeholder until their worker decode and upload finish
+  TextureStreamer textureStreamer;
+  std::vector<TextureStreamer::ArrayLayer> materialLayers;
+  GLuint materialsId = textureStreamer.requestArray({"assets/container.jpg", "assets/awesomeface.png"}, materialLayers);
+  const TextureStreamer::ArrayLayer& baseMaterial = materialLayers[0];
+  const TextureStreamer::ArrayLayer& overlayMaterial = materialLayers[1];
+
+  // bound once, draws only pick layers
+  glState.activeTexture(GL_TEXTURE0);
+  glState.bindTexture(GL_TEXTURE_2D_ARRAY, materialsId);
 
-  Shader shader(vertexShaderSource, fragmentShaderSource);
-  GLuint texture1Id = loadTexture("assets/container.jpg");
-  GLuint texture2Id = loadTexture("assets/awesomeface.png");
-
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture1Id);
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, texture2Id);
-
-  float vertices[] = {
-    // position           texture coord
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-    0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-    0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-    -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-    -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-  };
   glm::vec3 cubePositions[] = {
     glm::vec3( 0.0f,  0.0f,  0.0f), 
     glm::vec3( 2.0f,  5.0f, -15.0f), 
@@ -110,78 +173,374 @@ int main() {
   };
  
 
+  // indexed, cache ordered, simplified into coarser levels over the same
+  // vertices, then shrunk to 12 bytes a vertex; the levels sit one after
+  // another in the index buffer
+  std::vector<float> vertices = makeRoundedCube(16, 0.3f);
+  size_t unindexedCount = vertices.size() / 5;
+  IndexedMesh cubeMesh = indexMesh(vertices.data(), unindexedCount, 5);
+  optimizeVertexCache(cubeMesh.indices, cubeMesh.vertexCount());
+  optimizeVertexFetch(cubeMesh);
+  std::vector<MeshLod> cubeLods = buildMeshLods(cubeMesh, CubeScene::MAX_LODS);
+  QuantizedMesh packedCube = quantizeMesh(cubeMesh);
+  GLsizei lodIndexCounts[CubeScene::MAX_LODS] = {};
+  size_t lodFirstIndices[CubeScene::MAX_LODS] = {};
+  for (size_t level = 0; level < cubeLods.size(); level++) {
+    lodFirstIndices[level] = level == 0 ? 0 : packedCube.indices.size();
+    lodIndexCounts[level] = (GLsizei)cubeLods[level].indices.size();
+    if (level > 0) {
+      packedCube.indices.insert(packedCube.indices.end(), cubeLods[level].indices.begin(), cubeLods[level].indices.end());
+    }
+  }
+  std::cout << "cube mesh: " << unindexedCount << " -> " << cubeMesh.vertexCount() << " vertices, ACMR 3 -> "
+    << computeAcmr(cubeMesh.indices, cubeMesh.vertexCount()) << ", " << 5 * sizeof(float) << " -> "
+    << sizeof(QuantizedVertex) << " bytes/vertex" << std::endl;
+  std::cout << "cube LODs:";
+  for (const MeshLod& lod : cubeLods) {
+    std::cout << " " << lod.indices.size() / 3 << " triangles (error " << lod.error << ")";
+  }
+  std::cout << std::endl;
+
   GLuint VBO, EBO, VAO;
   glGenVertexArrays(1, &VAO);
   glGenBuffers(1, &VBO);
   glGenBuffers(1, &EBO);
 
-  glBindVertexArray(VAO);
-
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-  // glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
-
-
-  
-  glEnable(GL_DEPTH_TEST);
-
+  glState.bindVertexArray(VAO);
+
+  glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, packedCube.vertices.size() * sizeof(QuantizedVertex), packedCube.vertices.data(), GL_STATIC_DRAW);
+  glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, packedCube.indices.size() * sizeof(uint16_t), packedCube.indices.data(), GL_STATIC_DRAW);
+
+  // snorm positions come out in [-1, 1], the shaders scale them back by positionScale
+  setupVertexAttributes(quantizedVertexLayout);
+
+  glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+  glState.bindVertexArray(0);
+
+  // the instanced path reads CubeInstance records from attributes 2 and 3 of the same VAO
+  CubeInstanceBuffer instanceBuffer(VAO, 2);
+  std::vector<CubeInstance> cubes = makeCubeInstances(cubePositions, 10, cubeCount);
+  instanceBuffer.upload(cubes);
+  // the tilt every cube shares
+  glm::mat4 sceneTransform = glm::rotate(glm::mat4(1.0f), glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+  CubeScene cubeScene(cubes, sceneTransform);
+  JobSystem jobs(threadCount - 1);
+
+  glState.enable(GL_DEPTH_TEST);
+
+  // lights spread through the cubes about 8 deep, each frame moved into
+  // view space and sorted into the clusters; the clusters follow the
+  // framebuffer size
+  glm::vec3 lightMin, lightMax;
+  cubeFieldBounds(cubes, sceneTransform, lightMin, lightMax);
+  PointLights worldLights = scatterLights((size_t)lightCount, lightMin, lightMax,
+    lightRadiusFor((size_t)lightCount, lightMin, lightMax), 1);
+  PointLights viewLights;
+  LightClusters lightClusters;
+  lightClusters.setView(SCR_WIDTH, SCR_HEIGHT, glm::radians(45.0f), (float)SCR_WIDTH / SCR_HEIGHT, 0.1f, 100.0f);
+  ClusterLightBuffers lightBuffers;
+  lightBuffers.bind(1);
+
+  for (Shader* cubeShader : {&shader, &stripedShader, &instancedShader}) {
+    cubeShader->use();
+    // the material array sits on GL_TEXTURE0
+    cubeShader->uniform<GL_SAMPLER_2D_ARRAY>("materials").set(0);
+    cubeShader->uniform<GL_INT_VEC2>("materialLayers").set(baseMaterial.layer, overlayMaterial.layer);
+    cubeShader->uniform<GL_FLOAT_VEC4>("materialUvScale").set(baseMaterial.uvScale[0], baseMaterial.uvScale[1],
+      overlayMaterial.uvScale[0], overlayMaterial.uvScale[1]);
+    cubeShader->uniform<GL_FLOAT_VEC3>("positionScale").set(packedCube.positionScale[0], packedCube.positionScale[1],
+      packedCube.positionScale[2]);
+    cubeShader->uniform<GL_FLOAT>("opacity").set(1.0f);
+    // the light cluster buffers sit on GL_TEXTURE1 to GL_TEXTURE3
+    cubeShader->uniform<GL_SAMPLER_BUFFER>("lightData").set(1);
+    cubeShader->uniform<GL_UNSIGNED_INT_SAMPLER_BUFFER>("clusterRanges").set(2);
+    cubeShader->uniform<GL_UNSIGNED_INT_SAMPLER_BUFFER>("lightIndices").set(3);
+    cubeShader->uniform<GL_FLOAT>("ambient").set(lightCount > 0 ? 0.3f : 1.0f);
+    setClusterUniforms(*cubeShader, lightClusters);
+  }
+  instancedShader.use();
+  instancedShader.uniform<GL_FLOAT_MAT4>("model").set(glm::value_ptr(sceneTransform));
+  glm::vec3 spinAxis = glm::normalize(CUBE_SPIN_AXIS);
+  instancedShader.uniform<GL_FLOAT_VEC3>("spinAxis").set(spinAxis.x, spinAxis.y, spinAxis.z);
   shader.use();
-  // mapping uniform to the GL_TEXTUREX
-  shader.setUniform1i("texture1Data", 0);
-  shader.setUniform1i("texture2Data", 1);
 
-  glm::mat4 projection = glm::mat4(1.0f);
-  projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / SCR_HEIGHT, 0.1f, 100.0f);
-  shader.setUnifromMatrix4fv("projection", glm::value_ptr(projection));
+  FrameUniformBuffer frameUniformBuffer;
+  FrameUniforms frameUniforms = {};
+  int framebufferWidth, framebufferHeight;
+  glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+  frameUniforms.projection = glm::perspective(glm::radians(45.0f), aspectRatio(framebufferWidth, framebufferHeight),
+    0.1f, 100.0f);
+  frameUniforms.setCamRot(glm::mat3(1.0f));
+
+  if (argc > 1 && strcmp(argv[1], "--bench-uniforms") == 0) {
+    frameUniforms.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    frameUniformBuffer.update(frameUniforms);
+    benchUniforms(window, shader, VAO, lodIndexCounts[cubeLods.size() - 1], lodFirstIndices[cubeLods.size() - 1]);
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "--bench-instancing") == 0) {
+    frameUniforms.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    frameUniforms.time = 1.0f;
+    frameUniformBuffer.update(frameUniforms);
+    benchInstancing(window, shader, instancedShader, VAO, lodIndexCounts[cubeLods.size() - 1],
+      lodFirstIndices[cubeLods.size() - 1], instanceBuffer, cubePositions, 10, sceneTransform);
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "--bench-lights") == 0) {
+    frameUniforms.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    frameUniforms.time = 1.0f;
+    frameUniformBuffer.update(frameUniforms);
+    benchLights(window, instancedShader, VAO, lodIndexCounts[0], lodFirstIndices[0], instanceBuffer, cubePositions, 10,
+      sceneTransform);
+    return 0;
+  }
 
+  // the per-cube path picks its program by CubeMaterial::program
+  struct CubeProgram {
+    Shader* shader;
+    Uniform<GL_FLOAT_MAT4> model;
+    Uniform<GL_INT_VEC2> materialLayers;
+    Uniform<GL_FLOAT_VEC4> materialUvScale;
+    Uniform<GL_FLOAT> opacity;
+  };
+  CubeProgram cubePrograms[2];
+  Shader* perCubeShaders[] = {&shader, &stripedShader};
+  for (int i = 0; i < 2; i++) {
+    cubePrograms[i] = {perCubeShaders[i], perCubeShaders[i]->uniform<GL_FLOAT_MAT4>("model"),
+      perCubeShaders[i]->uniform<GL_INT_VEC2>("materialLayers"),
+      perCubeShaders[i]->uniform<GL_FLOAT_VEC4>("materialUvScale"), perCubeShaders[i]->uniform<GL_FLOAT>("opacity")};
+  }
+  RenderQueue renderQueue;
+  DepthReadback depthReadback;
+  DepthPyramid depthPyramid;
+
+  // per frame: FrameData and the visible instance list, written in place
+  GLint uniformAlignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+  StreamBuffer streamBuffer(sizeof(FrameUniforms) + uniformAlignment + cubes.size() * sizeof(CubeInstance));
+  std::cout << "stream buffer: " << (streamBuffer.persistent() ? "persistently mapped" : "mapped per frame") << std::endl;
+
+  bool firstFrame = true;
+  int reportFrames = 0;
+  size_t reportVisible = 0;
+  size_t reportOccluded = 0;
+  size_t reportTriangles = 0;
+  size_t titleVisible = ~(size_t)0;
+  double reportUpdateSeconds = 0.0;
+  double reportAssignMs = 0.0;
+  auto reportStart = std::chrono::steady_clock::now();
   while (!glfwWindowShouldClose(window)) {
     processInput(window);
+    textureStreamer.update();
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    shader.use();
-
     // camera/view transform
     glm::mat4 view = glm::mat4(1.0f);
     glm::vec3 camPos = glm::vec3(0.0f, 0.0f, 3.0f);
     glm::vec3 camCenter = glm::vec3(0.0f, 0.0f, 0.0f);
     glm::vec3 camUp = glm::vec3(0.0f, 1.0f, 0.0f);
-    camPos.z += sin(glfwGetTime()) * 2.0f;
-    camPos.y -= sin(glfwGetTime()) * 2.0f;
+    float time = glfwGetTime();
+    camPos.z += sin(time) * 2.0f;
+    camPos.y -= sin(time) * 2.0f;
     view = glm::lookAt(camPos, camCenter, camUp);
-    shader.setUnifromMatrix4fv("view", glm::value_ptr(view));
+    // the viewport follows the framebuffer, so the projection has to too
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    frameUniforms.projection = glm::perspective(glm::radians(45.0f), aspectRatio(framebufferWidth, framebufferHeight),
+      0.1f, 100.0f);
+    frameUniforms.view = view;
+    frameUniforms.camPos = camPos;
+    frameUniforms.time = time;
+    streamBuffer.beginFrame();
+    StreamBuffer::Allocation frameData = streamBuffer.push(frameUniforms, uniformAlignment);
+    glState.bindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, streamBuffer.id(), frameData.offset, sizeof(FrameUniforms));
+
+    // culling and the instance list or model matrices, spread over every thread
+    auto updateStart = std::chrono::steady_clock::now();
+    Frustum frustum = extractFrustum(frameUniforms.projection * view);
+    if (occlusionCull) {
+      depthReadback.collect(depthPyramid);
+    }
+    const DepthPyramid* occluders = occlusionCull ? &depthPyramid : nullptr;
+    CubeScene::LodSelection lodSelection;
+    lodSelection.levelCount = (int)cubeLods.size();
+    for (size_t level = 0; level < cubeLods.size(); level++) {
+      lodSelection.levelErrors[level] = cubeLods[level].error;
+    }
+    lodSelection.camera = camPos;
+    lodSelection.pixelsPerUnit = framebufferHeight / (2.0f * tanf(glm::radians(45.0f) / 2.0f));
+    const CubeScene::LodSelection* lod = useLods ? &lodSelection : nullptr;
+    GLintptr instanceOffset = 0;
+    if (instanced) {
+      StreamBuffer::Allocation instances = streamBuffer.allocate(cubes.size() * sizeof(CubeInstance));
+      cubeScene.update(jobs, cullCubes ? &frustum : nullptr, occluders, lod, time, (CubeInstance*)instances.data);
+      instanceOffset = instances.offset;
+    } else {
+      cubeScene.update(jobs, cullCubes ? &frustum : nullptr, occluders, lod, time, nullptr);
+    }
+    streamBuffer.commit();
+    reportUpdateSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - updateStart).count();
+    if (cubeScene.visible().size() != titleVisible) {
+      titleVisible = cubeScene.visible().size();
+      std::string title = "First 3D scene - " + std::to_string(titleVisible) + "/" + std::to_string(cubes.size()) + " cubes visible";
+      glfwSetWindowTitle(window, title.c_str());
+    }
 
-    glBindVertexArray(VAO);
-    for (int i=0; i<10; i++) {
-      glm::mat4 model = glm::mat4(1.0f);
-      model = glm::rotate(model, glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-      float angle = 20.0f * (i + 5.0) * glfwGetTime(); 
-      model = glm::translate(model, cubePositions[i]);
-      model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-      shader.setUnifromMatrix4fv("model", glm::value_ptr(model));
-      glDrawArrays(GL_TRIANGLES, 0, 36);
+    if (!lightClusters.matches(framebufferWidth, framebufferHeight)) {
+      lightClusters.setView(framebufferWidth, framebufferHeight, glm::radians(45.0f),
+        aspectRatio(framebufferWidth, framebufferHeight), 0.1f, 100.0f);
+      for (Shader* cubeShader : {&shader, &stripedShader, &instancedShader}) {
+        cubeShader->use();
+        setClusterUniforms(*cubeShader, lightClusters);
+      }
+    }
+    viewLights.clear();
+    for (size_t i = 0; i < worldLights.size(); i++) {
+      glm::vec3 position = glm::vec3(worldLights.x[i], worldLights.y[i] + 0.5f * sinf(time * 1.3f + i * 0.37f),
+        worldLights.z[i]);
+      viewLights.push(glm::vec3(view * glm::vec4(position, 1.0f)), worldLights.radius[i], worldLights.color[i]);
+    }
+    lightClusters.assign(viewLights);
+    lightBuffers.upload(viewLights, lightClusters);
+    reportAssignMs += lightClusters.stats().assignMs;
+
+    glState.bindVertexArray(VAO);
+    const std::array<size_t, CubeScene::MAX_LODS + 1>& lodStarts = cubeScene.lodStarts();
+    size_t frameTriangles = 0;
+    for (int level = 0; level < CubeScene::MAX_LODS; level++) {
+      frameTriangles += (lodStarts[level + 1] - lodStarts[level]) * lodIndexCounts[level] / 3;
+    }
+    if (instanced) {
+      // one draw per level, each over its own run of the instance records
+      instancedShader.use();
+      for (int level = 0; level < CubeScene::MAX_LODS; level++) {
+        GLsizei levelCubes = (GLsizei)(lodStarts[level + 1] - lodStarts[level]);
+        if (levelCubes == 0) {
+          continue;
+        }
+        instanceBuffer.source(streamBuffer.id(), instanceOffset + lodStarts[level] * sizeof(CubeInstance), levelCubes);
+        instanceBuffer.draw(lodIndexCounts[level], lodFirstIndices[level]);
+      }
+    } else {
+      // a key per visible cube; opaque cubes go front to back within their
+      // program and material, blended ones back to front after them
+      std::span<const glm::mat4> models = cubeScene.models();
+      std::span<const uint32_t> visible = cubeScene.visible();
+      // the key's vertex array field carries the detail level, whose index
+      // range is the geometry the draw binds
+      renderQueue.clear();
+      for (uint32_t level = 0; level < CubeScene::MAX_LODS; level++) {
+        for (size_t i = lodStarts[level]; i < lodStarts[level + 1]; i++) {
+          uint32_t material = cubeMaterial(visible[i]);
+          const CubeMaterial& look = CUBE_MATERIALS[material];
+          RenderPass pass = look.opacity < 1.0f ? RENDER_PASS_BLENDED : RENDER_PASS_OPAQUE;
+          float depth = glm::length(glm::vec3(models[i][3]) - camPos);
+          renderQueue.push({pass, look.program, material, level, depth}, (uint32_t)i);
+        }
+      }
+      renderQueue.sort();
+
+      int pass = -1;
+      int program = -1;
+      int material = -1;
+      for (const RenderQueue::Item& item : sortDraws ? renderQueue.sorted() : renderQueue.items()) {
+        DrawKeyFields fields = decodeDrawKey(item.key);
+        if ((int)fields.pass != pass) {
+          pass = fields.pass;
+          if (pass == RENDER_PASS_BLENDED) {
+            glState.enable(GL_BLEND);
+            glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glState.depthMask(GL_FALSE);
+          } else {
+            glState.disable(GL_BLEND);
+            glState.depthMask(GL_TRUE);
+          }
+        }
+        const CubeProgram& cubeProgram = cubePrograms[fields.program];
+        if ((int)fields.program != program) {
+          program = fields.program;
+          cubeProgram.shader->use();
+          material = -1;
+        }
+        if ((int)fields.material != material) {
+          material = fields.material;
+          const TextureStreamer::ArrayLayer& base = materialLayers[CUBE_MATERIALS[material].baseLayer];
+          const TextureStreamer::ArrayLayer& overlay = materialLayers[CUBE_MATERIALS[material].overlayLayer];
+          cubeProgram.materialLayers.set(base.layer, overlay.layer);
+          cubeProgram.materialUvScale.set(base.uvScale[0], base.uvScale[1], overlay.uvScale[0], overlay.uvScale[1]);
+          cubeProgram.opacity.set(CUBE_MATERIALS[material].opacity);
+        }
+        cubeProgram.model.set(glm::value_ptr(models[item.draw]));
+        glDrawElements(GL_TRIANGLES, lodIndexCounts[fields.vertexArray], GL_UNSIGNED_SHORT,
+          (void*)(lodFirstIndices[fields.vertexArray] * sizeof(uint16_t)));
+      }
+      // glClear only clears depth while it is writable
+      glState.disable(GL_BLEND);
+      glState.depthMask(GL_TRUE);
     }
 
-    glBindVertexArray(0);
+    glState.bindVertexArray(0);
+    if (occlusionCull) {
+      depthReadback.capture(framebufferWidth, framebufferHeight, frameUniforms.projection * view);
+    }
+    streamBuffer.endFrame();
 
     glfwSwapBuffers(window);
+    glState.endFrame();
+    if (firstFrame) {
+      firstFrame = false;
+      glFinish();
+      reportTimeToFirstFrame("first_3d",
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+    }
+    reportFrames++;
+    reportVisible += cubeScene.visible().size();
+    reportOccluded += cubeScene.occluded();
+    reportTriangles += frameTriangles;
+    double reportSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - reportStart).count();
+    if (reportSeconds >= 2.0) {
+      std::cout << cubeCount << " cubes, " << (instanced ? "instanced" : "one draw per cube") << ": "
+        << reportSeconds * 1000.0 / reportFrames << " ms/frame, "
+        << reportUpdateSeconds * 1000.0 / reportFrames << " ms/update on " << jobs.threadCount() << " threads, "
+        << 100.0 * reportVisible / ((double)reportFrames * cubes.size()) << "% visible, "
+        << 100.0 * reportOccluded / ((double)reportFrames * cubes.size()) << "% occluded, "
+        << streamBuffer.stats().fenceWaits << " fence waits (" << streamBuffer.stats().fenceWaitMs << " ms) in "
+        << streamBuffer.stats().frames << " frames" << std::endl;
+      const std::array<size_t, CubeScene::MAX_LODS + 1>& lodStarts = cubeScene.lodStarts();
+      std::cout << "  triangles: " << reportTriangles / reportFrames << "/frame, cubes per LOD (last frame):";
+      for (int level = 0; level < CubeScene::MAX_LODS; level++) {
+        std::cout << " " << lodStarts[level + 1] - lodStarts[level];
+      }
+      std::cout << std::endl;
+      std::cout << "  state calls: " << GLStateCache::summary(glState.lastFrame()) << std::endl;
+      const LightClusters::Stats& lightStats = lightClusters.stats();
+      std::cout << "  lights: " << lightStats.lights << ", " << reportAssignMs / reportFrames << " ms/assign ("
+        << cullPathName(bestCullPath()) << "), " << lightStats.assignments << " in " << lightStats.occupiedClusters
+        << "/" << LightClusters::CLUSTER_COUNT << " clusters, up to " << lightStats.maxPerCluster
+        << " per cluster (last frame)" << std::endl;
+      if (!instanced) {
+        const RenderQueue::Stats& drawStats = renderQueue.stats();
+        std::cout << "  draw state changes: " << drawStats.unsorted.total() << " in scene order, "
+          << drawStats.sorted.total() << " sorted (" << drawStats.draws << " draws, " << drawStats.radixPasses
+          << " radix passes), submitting " << (sortDraws ? "sorted" : "in scene order") << std::endl;
+      }
+      reportFrames = 0;
+      reportVisible = 0;
+      reportOccluded = 0;
+      reportTriangles = 0;
+      reportUpdateSeconds = 0.0;
+      reportAssignMs = 0.0;
+      reportStart = std::chrono::steady_clock::now();
+    }
     glfwPollEvents();
   }
 
-  glDeleteBuffers(1, &VBO);
-  glDeleteVertexArrays(1, &VAO);
-
-  glfwTerminate();
+  glState.deleteBuffers(1, &VBO);
+  glState.deleteBuffers(1, &EBO);
+  glState.deleteVertexArrays(1, &VAO);
   return 0;
 }
 
@@ -194,27 +553,403 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
   glViewport(0, 0, width, height);
 }
 
+// width over height, 1 for the 0x0 framebuffer of a minimized window
+float aspectRatio(int width, int height) {
+  return height > 0 ? (float)width / height : 1.0f;
+}
+
+// Draws BENCH_DRAWS cubes per frame and times only the CPU side of the
+// submission loop, once per way of resolving the "model" uniform.
+// Expects the FrameData buffer to hold a valid view/projection already.
+// Draws `indexCount` indices from `firstIndex`, a coarse level of the cube
+// keeps the GPU out of the way.
+void benchUniforms(GLFWwindow* window, Shader& shader, GLuint VAO, GLsizei indexCount, size_t firstIndex) {
+  const int BENCH_DRAWS = 10000;
+  const int BENCH_FRAMES = 60;
+  const char* modes[] = {"glGetUniformLocation per set", "reflected name lookup", "pre-resolved handle"};
+  Uniform<GL_FLOAT_MAT4> modelUniform = shader.uniform<GL_FLOAT_MAT4>("model");
+  glState.bindVertexArray(VAO);
+
+  for (int mode = 0; mode < 3; mode++) {
+    double submitSeconds = 0.0;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < BENCH_DRAWS; i++) {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -0.001f * i));
+        if (mode == 0) {
+          glUniformMatrix4fv(glGetUniformLocation(shader.id(), "model"), 1, GL_FALSE, glm::value_ptr(model));
+        } else if (mode == 1) {
+          shader.setUnifromMatrix4fv("model", glm::value_ptr(model));
+        } else {
+          modelUniform.set(glm::value_ptr(model));
+        }
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)(firstIndex * sizeof(uint16_t)));
+      }
+      submitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      glfwSwapBuffers(window);
+      glfwPollEvents();
+    }
+    double msPerFrame = submitSeconds * 1000.0 / BENCH_FRAMES;
+    std::cout << modes[mode] << ": " << msPerFrame << " ms/frame submit, "
+      << msPerFrame * 1e6 / BENCH_DRAWS << " ns/draw (" << BENCH_DRAWS << " draws/frame)" << std::endl;
+  }
+  glState.bindVertexArray(0);
+}
+
+
+// Draws 1k to 1M cubes per frame, once with a "model" upload and a draw
+// per cube and once instanced, and reports the average frame time. Vsync
+// is off and the clock stops after glFinish, so the GPU side counts too.
+// Expects the FrameData buffer to hold a valid view/projection/time and
+// `instancedShader` to have `scene` as its "model" already.
+void benchInstancing(GLFWwindow* window, Shader& shader, Shader& instancedShader, GLuint VAO, GLsizei indexCount,
+  size_t firstIndex, CubeInstanceBuffer& instanceBuffer, const glm::vec3* fixedPositions, int fixedCount, const glm::mat4& scene) {
+  const int CUBE_COUNTS[] = {1000, 10000, 100000, 1000000};
+  const double BENCH_SECONDS = 1.0;
+  const int MIN_FRAMES = 3;
+  const int MAX_FRAMES = 300;
+  const char* paths[] = {"one draw per cube", "instanced"};
+  Uniform<GL_FLOAT_MAT4> modelUniform = shader.uniform<GL_FLOAT_MAT4>("model");
+  glfwSwapInterval(0);
+  glState.bindVertexArray(VAO);
+
+  for (int cubeCount : CUBE_COUNTS) {
+    std::vector<CubeInstance> cubes = makeCubeInstances(fixedPositions, fixedCount, cubeCount);
+    instanceBuffer.upload(cubes);
+    double msPerFrame[2];
+    for (int path = 0; path < 2; path++) {
+      (path == 0 ? shader : instancedShader).use();
+      glFinish();
+      int frames = 0;
+      auto start = std::chrono::steady_clock::now();
+      double seconds = 0.0;
+      while ((seconds < BENCH_SECONDS || frames < MIN_FRAMES) && frames < MAX_FRAMES) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if (path == 0) {
+          for (const CubeInstance& cube : cubes) {
+            modelUniform.set(glm::value_ptr(cubeModelMatrix(scene, cube, 1.0f)));
+            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)(firstIndex * sizeof(uint16_t)));
+          }
+        } else {
+          instanceBuffer.draw(indexCount, firstIndex);
+        }
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+        frames++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      }
+      glFinish();
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      msPerFrame[path] = seconds * 1000.0 / frames;
+    }
+    std::cout << cubeCount << " cubes: " << paths[0] << " " << msPerFrame[0] << " ms/frame, "
+      << paths[1] << " " << msPerFrame[1] << " ms/frame (" << msPerFrame[0] / msPerFrame[1] << "x)" << std::endl;
+  }
+  glState.bindVertexArray(0);
+}
+
+// Culls 1M spheres scattered around the default camera with every path
+// this build has, and reports objects tested per second. No GL needed.
+void benchCulling() {
+  const size_t BENCH_OBJECTS = 1000000;
+  const int BENCH_RUNS = 50;
+  SphereBounds bounds;
+  srand(1);
+  auto random = [](float range) { return ((float)rand() / RAND_MAX * 2.0f - 1.0f) * range; };
+  for (size_t i = 0; i < BENCH_OBJECTS; i++) {
+    bounds.push(glm::vec3(random(100.0f), random(100.0f), random(100.0f)), 0.1f + (float)rand() / RAND_MAX);
+  }
+  glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / SCR_HEIGHT, 0.1f, 100.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = extractFrustum(projection * view);
+
+  std::vector<uint32_t> visible;
+  for (CullPath path : {CullPath::Scalar, CullPath::Sse, CullPath::Avx}) {
+    if (!cullPathAvailable(path)) {
+      std::cout << cullPathName(path) << ": not compiled in" << std::endl;
+      continue;
+    }
+    cullSpheres(frustum, bounds, visible, path);
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < BENCH_RUNS; run++) {
+      cullSpheres(frustum, bounds, visible, path);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << cullPathName(path) << ": " << BENCH_OBJECTS * BENCH_RUNS / seconds / 1e6 << " M objects/s, "
+      << visible.size() << "/" << BENCH_OBJECTS << " visible" << std::endl;
+  }
+}
+
+// Runs the CubeScene update for 1M cubes on 1, 2, 4... threads up to the
+// core count, culling against the default camera and building model
+// matrices, and reports the time per update. No GL needed.
+void benchSceneUpdate() {
+  const int BENCH_CUBES = 1000000;
+  const int BENCH_RUNS = 20;
+  glm::mat4 scene = glm::rotate(glm::mat4(1.0f), glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+  CubeScene cubeScene(makeCubeInstances(nullptr, 0, BENCH_CUBES), scene);
+  // wide enough that most of the field is in view and every matrix is built
+  glm::mat4 projection = glm::perspective(glm::radians(120.0f), (float)SCR_WIDTH / SCR_HEIGHT, 0.1f, 1000.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 60.0f), glm::vec3(0.0f, 0.0f, -60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum = extractFrustum(projection * view);
+
+  unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+  double singleThreadMs = 0.0;
+  for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+    JobSystem jobs(threads - 1);
+    cubeScene.update(jobs, &frustum, nullptr, nullptr, 0.0f, nullptr);
+    auto start = std::chrono::steady_clock::now();
+    for (int run = 0; run < BENCH_RUNS; run++) {
+      cubeScene.update(jobs, &frustum, nullptr, nullptr, run / 60.0f, nullptr);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / BENCH_RUNS;
+    if (threads == 1) {
+      singleThreadMs = ms;
+    }
+    std::cout << threads << " threads: " << ms << " ms/update (" << singleThreadMs / ms << "x), "
+      << cubeScene.visible().size() << "/" << BENCH_CUBES << " visible" << std::endl;
+    if (threads == maxThreads) {
+      break;
+    }
+  }
+}
+
+// Runs the mesh pipeline on a 64x128 UV sphere (16k triangles) given as
+// an unindexed triangle list in shuffled order, the way an unoptimized
+// export often looks, and reports each step. No GL needed.
+void benchMeshOptimizer() {
+  const int RINGS = 64;
+  const int SEGMENTS = 128;
+  std::vector<float> vertices;
+  auto addVertex = [&](int ring, int segment) {
+    float theta = glm::pi<float>() * ring / RINGS;
+    float phi = 2.0f * glm::pi<float>() * segment / SEGMENTS;
+    float vertex[] = {sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi),
+      (float)segment / SEGMENTS, (float)ring / RINGS};
+    vertices.insert(vertices.end(), vertex, vertex + 5);
+  };
+  std::vector<int> quads(RINGS * SEGMENTS);
+  for (int i = 0; i < RINGS * SEGMENTS; i++) {
+    quads[i] = i;
+  }
+  srand(1);
+  for (int i = RINGS * SEGMENTS - 1; i > 0; i--) {
+    std::swap(quads[i], quads[rand() % (i + 1)]);
+  }
+  for (int quad : quads) {
+    int ring = quad / SEGMENTS, segment = quad % SEGMENTS;
+    addVertex(ring, segment);
+    addVertex(ring + 1, segment);
+    addVertex(ring + 1, segment + 1);
+    addVertex(ring, segment);
+    addVertex(ring + 1, segment + 1);
+    addVertex(ring, segment + 1);
+  }
+  size_t unindexedCount = vertices.size() / 5;
+
+  auto start = std::chrono::steady_clock::now();
+  IndexedMesh mesh = indexMesh(vertices.data(), unindexedCount, 5);
+  float indexedAcmr = computeAcmr(mesh.indices, mesh.vertexCount());
+  optimizeVertexCache(mesh.indices, mesh.vertexCount());
+  optimizeVertexFetch(mesh);
+  QuantizedMesh packed = quantizeMesh(mesh);
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  size_t floatBytes = 5 * sizeof(float);
+  std::cout << "triangles: " << mesh.indices.size() / 3 << std::endl;
+  std::cout << "vertices: " << unindexedCount << " -> " << mesh.vertexCount() << std::endl;
+  std::cout << "ACMR (16 entry FIFO): unindexed 3, indexed " << indexedAcmr << ", cache ordered "
+    << computeAcmr(mesh.indices, mesh.vertexCount()) << std::endl;
+  std::cout << "bytes/vertex: " << floatBytes << " -> " << sizeof(QuantizedVertex) << std::endl;
+  std::cout << "vertex + index bytes: " << unindexedCount * floatBytes << " -> "
+    << packed.vertices.size() * sizeof(QuantizedVertex) + packed.indices.size() * sizeof(uint16_t) << std::endl;
+  std::cout << "pipeline time: " << ms << " ms" << std::endl;
+}
+
+// Sorts 1M random draw keys with the render queue's radix sort and with
+// std::sort, both on the same data, and reports the time per sort. The
+// keys mix both passes, 4 programs, 64 materials and random depths, like
+// a large scene would. No GL needed.
+void benchDrawSort() {
+  const size_t BENCH_DRAWS = 1000000;
+  const int BENCH_RUNS = 20;
+  srand(1);
+  std::vector<RenderQueue::Item> items(BENCH_DRAWS);
+  for (size_t i = 0; i < BENCH_DRAWS; i++) {
+    RenderPass pass = rand() % 8 == 0 ? RENDER_PASS_BLENDED : RENDER_PASS_OPAQUE;
+    float depth = (float)rand() / RAND_MAX * 100.0f;
+    items[i] = {makeDrawKey({pass, (uint32_t)rand() % 4, (uint32_t)rand() % 64, 0, depth}), (uint32_t)i};
+  }
+
+  std::vector<RenderQueue::Item> sorted;
+  std::vector<RenderQueue::Item> scratch;
+  int passes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    sorted = items;
+    passes = radixSortItems(sorted, scratch);
+  }
+  double radixMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / BENCH_RUNS;
+
+  std::vector<RenderQueue::Item> reference;
+  start = std::chrono::steady_clock::now();
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    reference = items;
+    std::stable_sort(reference.begin(), reference.end(),
+      [](const RenderQueue::Item& a, const RenderQueue::Item& b) { return a.key < b.key; });
+  }
+  double stdMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / BENCH_RUNS;
+
+  bool same = std::equal(sorted.begin(), sorted.end(), reference.begin(),
+    [](const RenderQueue::Item& a, const RenderQueue::Item& b) { return a.key == b.key && a.draw == b.draw; });
+  std::cout << BENCH_DRAWS << " draw keys: radix sort " << radixMs << " ms (" << passes << " passes), std::stable_sort "
+    << stdMs << " ms (" << stdMs / radixMs << "x), " << (same ? "same order" : "ORDER DIFFERS") << std::endl;
+  std::cout << "state changes: " << RenderQueue::countStateChanges(items).total() << " unsorted, "
+    << RenderQueue::countStateChanges(sorted).total() << " sorted" << std::endl;
+}
+
+// Composes 1M model matrices under the scene tilt from random positions,
+// rotations and scales, once with a glm translate * mat4_cast * scale
+// chain per transform and once with every composeTransforms() path this
+// build has, and reports transforms per second. No GL needed.
+void benchTransforms() {
+  const size_t BENCH_TRANSFORMS = 1000000;
+  const int BENCH_RUNS = 20;
+  TransformArrays transforms;
+  srand(1);
+  auto random = [](float range) { return ((float)rand() / RAND_MAX * 2.0f - 1.0f) * range; };
+  for (size_t i = 0; i < BENCH_TRANSFORMS; i++) {
+    glm::quat rotation = glm::normalize(glm::quat(random(1.0f), random(1.0f), random(1.0f), random(1.0f)));
+    transforms.push(glm::vec3(random(100.0f), random(100.0f), random(100.0f)), rotation,
+      glm::vec3(1.0f + random(0.5f), 1.0f + random(0.5f), 1.0f + random(0.5f)));
+  }
+  glm::mat4 scene = glm::rotate(glm::mat4(1.0f), glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+  std::vector<glm::mat4> reference(BENCH_TRANSFORMS);
+  std::vector<glm::mat4> models(BENCH_TRANSFORMS);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    for (size_t i = 0; i < BENCH_TRANSFORMS; i++) {
+      glm::vec3 position = glm::vec3(transforms.positionX[i], transforms.positionY[i], transforms.positionZ[i]);
+      glm::quat rotation = glm::quat(transforms.rotationW[i], transforms.rotationX[i], transforms.rotationY[i],
+        transforms.rotationZ[i]);
+      glm::vec3 scale = glm::vec3(transforms.scaleX[i], transforms.scaleY[i], transforms.scaleZ[i]);
+      reference[i] = glm::scale(glm::translate(scene, position) * glm::mat4_cast(rotation), scale);
+    }
+  }
+  double glmSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "glm chain: " << BENCH_TRANSFORMS * BENCH_RUNS / glmSeconds / 1e6 << " M transforms/s" << std::endl;
 
+  for (TransformPath path : {TransformPath::Scalar, TransformPath::Sse, TransformPath::Avx}) {
+    if (!transformPathAvailable(path)) {
+      std::cout << transformPathName(path) << ": not compiled in" << std::endl;
+      continue;
+    }
+    start = std::chrono::steady_clock::now();
+    for (int run = 0; run < BENCH_RUNS; run++) {
+      composeTransforms(scene, transforms, 0, BENCH_TRANSFORMS, models.data(), path);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    float maxError = 0.0f;
+    for (size_t i = 0; i < BENCH_TRANSFORMS; i++) {
+      for (int column = 0; column < 4; column++) {
+        glm::vec4 error = glm::abs(models[i][column] - reference[i][column]);
+        maxError = std::max({maxError, error.x, error.y, error.z, error.w});
+      }
+    }
+    std::cout << transformPathName(path) << " SoA: " << BENCH_TRANSFORMS * BENCH_RUNS / seconds / 1e6
+      << " M transforms/s (" << glmSeconds / seconds << "x), max difference " << maxError << std::endl;
+  }
+}
+
+// Shades BENCH_CUBES cubes, drawn instanced, with 16 to 16k point lights,
+// once at a radius that keeps about 8 lights over any point whatever the
+// count and once at a fixed radius, so the density grows with the count.
+// Reports the light assignment time and the frame time, which waits on
+// glFinish so the shading counts. Expects the FrameData buffer to hold a
+// valid view/projection/time and `instancedShader` to have `scene` as
+// its "model" already.
+void benchLights(GLFWwindow* window, Shader& instancedShader, GLuint VAO, GLsizei indexCount, size_t firstIndex,
+  CubeInstanceBuffer& instanceBuffer, const glm::vec3* fixedPositions, int fixedCount, const glm::mat4& scene) {
+  const int LIGHT_COUNTS[] = {16, 64, 256, 1024, 4096, 16384};
+  const int BENCH_CUBES = 2000;
+  const size_t FIXED_RADIUS_COUNT = 256;  // the fixed radius is the even one of this many lights
+  const double BENCH_SECONDS = 1.0;
+  const int MIN_FRAMES = 3;
+  const int MAX_FRAMES = 300;
+  const char* modes[] = {"even density", "fixed radius"};
+  glfwSwapInterval(0);
+
+  std::vector<CubeInstance> cubes = makeCubeInstances(fixedPositions, fixedCount, BENCH_CUBES);
+  instanceBuffer.upload(cubes);
+  glm::vec3 lightMin, lightMax;
+  cubeFieldBounds(cubes, scene, lightMin, lightMax);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 3.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  int width, height;
+  glfwGetFramebufferSize(window, &width, &height);
+  LightClusters clusters;
+  clusters.setView(width, height, glm::radians(45.0f), aspectRatio(width, height), 0.1f, 100.0f);
+  ClusterLightBuffers lightBuffers;
+  lightBuffers.bind(1);
+  instancedShader.use();
+  setClusterUniforms(instancedShader, clusters);
+  instancedShader.uniform<GL_FLOAT>("ambient").set(0.3f);
+  glState.bindVertexArray(VAO);
+
+  for (int mode = 0; mode < 2; mode++) {
+    float fixedRadius = lightRadiusFor(FIXED_RADIUS_COUNT, lightMin, lightMax);
+    for (int lightCount : LIGHT_COUNTS) {
+      float radius = mode == 0 ? lightRadiusFor(lightCount, lightMin, lightMax) : fixedRadius;
+      PointLights worldLights = scatterLights(lightCount, lightMin, lightMax, radius, 1);
+      PointLights viewLights;
+      for (size_t i = 0; i < worldLights.size(); i++) {
+        glm::vec3 position = glm::vec3(worldLights.x[i], worldLights.y[i], worldLights.z[i]);
+        viewLights.push(glm::vec3(view * glm::vec4(position, 1.0f)), radius, worldLights.color[i]);
+      }
+      glFinish();
+      int frames = 0;
+      double assignMs = 0.0;
+      auto start = std::chrono::steady_clock::now();
+      double seconds = 0.0;
+      while ((seconds < BENCH_SECONDS || frames < MIN_FRAMES) && frames < MAX_FRAMES) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        clusters.assign(viewLights);
+        assignMs += clusters.stats().assignMs;
+        lightBuffers.upload(viewLights, clusters);
+        instanceBuffer.draw(indexCount, firstIndex);
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+        frames++;
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      }
+      glFinish();
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      const LightClusters::Stats& stats = clusters.stats();
+      std::cout << modes[mode] << ", " << lightCount << " lights (radius " << radius << "): "
+        << seconds * 1000.0 / frames << " ms/frame, " << assignMs / frames << " ms/assign, "
+        << (stats.occupiedClusters ? (double)stats.assignments / stats.occupiedClusters : 0.0)
+        << " lights per occupied cluster, up to " << stats.maxPerCluster << std::endl;
+    }
+  }
+  glState.bindVertexArray(0);
+}
+
+// The world space box around every cube, a cube's size larger each way.
+void cubeFieldBounds(const std::vector<CubeInstance>& cubes, const glm::mat4& scene, glm::vec3& min, glm::vec3& max) {
+  min = glm::vec3(FLT_MAX);
+  max = glm::vec3(-FLT_MAX);
+  for (const CubeInstance& cube : cubes) {
+    glm::vec3 position = glm::vec3(scene * glm::vec4(cube.position, 1.0f));
+    min = glm::min(min, position - 1.0f);
+    max = glm::max(max, position + 1.0f);
+  }
+}
 
-GLuint loadTexture(const char* imgPath) {
-  GLuint texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  stbi_set_flip_vertically_on_load(true);
-  int width, height, nrChannels;
-  unsigned char *data = stbi_load(imgPath, &width, &height, &nrChannels, 0);
-  if (!data) {
-    std::cout << "ERROR! couldn't load the texture image: " << imgPath << std::endl;
-    exit(1);
-  }
-  GLenum imgFmt = nrChannels == 4 ? GL_RGBA : GL_RGB;
-  glTexImage2D(GL_TEXTURE_2D, 0, imgFmt, width, height, 0, imgFmt, GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-
-  stbi_image_free(data);
-  return texture;
+// The tile and slice uniforms of `clusters` on `shader`, which must be in use.
+void setClusterUniforms(Shader& shader, const LightClusters& clusters) {
+  glm::vec4 tiles = clusters.tileUniform();
+  glm::vec3 slices = clusters.depthUniform();
+  shader.uniform<GL_FLOAT_VEC4>("clusterTiles").set(tiles.x, tiles.y, tiles.z, tiles.w);
+  shader.uniform<GL_FLOAT_VEC3>("clusterSlices").set(slices.x, slices.y, slices.z);
 }
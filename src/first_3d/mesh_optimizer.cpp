@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include "mesh_optimizer.hpp"
+
+IndexedMesh indexMesh(const float* vertices, size_t vertexCount, int stride) {
+  IndexedMesh mesh;
+  mesh.stride = stride;
+  mesh.indices.reserve(vertexCount);
+  // keyed by the raw bytes, so only exact duplicates merge
+  std::unordered_map<std::string, uint32_t> unique;
+  for (size_t i = 0; i < vertexCount; i++) {
+    const float* vertex = vertices + i * stride;
+    std::string key((const char*)vertex, stride * sizeof(float));
+    auto [found, inserted] = unique.try_emplace(key, (uint32_t)mesh.vertexCount());
+    if (inserted) {
+      mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + stride);
+    }
+    mesh.indices.push_back(found->second);
+  }
+  return mesh;
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation": every vertex scores
+// by its place in a simulated LRU cache and by how many triangles still
+// need it, every triangle by the sum of its vertices, and the best
+// triangle touching the cache is emitted next.
+namespace {
+const int FORSYTH_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+float vertexScore(int cachePosition, int remainingTriangles) {
+  if (remainingTriangles == 0) {
+    return -1.0f;
+  }
+  float score = 0.0f;
+  if (cachePosition >= 0) {
+    if (cachePosition < 3) {
+      // the triangle just emitted, deliberately not the best so the next
+      // one does not always continue the same strip
+      score = LAST_TRIANGLE_SCORE;
+    } else {
+      float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+    }
+  }
+  // vertices with few triangles left get those done first
+  return score + VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+}
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+  size_t triangleCount = indices.size() / 3;
+  // triangles of every vertex, as one flat array with per-vertex offsets
+  std::vector<uint32_t> remaining(vertexCount, 0);
+  for (uint32_t index : indices) {
+    remaining[index]++;
+  }
+  std::vector<uint32_t> firstTriangle(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v++) {
+    firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+  }
+  std::vector<uint32_t> vertexTriangles(indices.size());
+  std::vector<uint32_t> filled(vertexCount, 0);
+  for (size_t t = 0; t < triangleCount; t++) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = indices[t * 3 + k];
+      vertexTriangles[firstTriangle[v] + filled[v]++] = (uint32_t)t;
+    }
+  }
+
+  std::vector<int> cachePosition(vertexCount, -1);
+  std::vector<float> score(vertexCount);
+  for (size_t v = 0; v < vertexCount; v++) {
+    score[v] = vertexScore(-1, remaining[v]);
+  }
+  std::vector<float> triangleScore(triangleCount);
+  std::vector<bool> emitted(triangleCount, false);
+  for (size_t t = 0; t < triangleCount; t++) {
+    triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+  }
+
+  std::vector<uint32_t> ordered;
+  ordered.reserve(indices.size());
+  // cache with room for one triangle's worth of vertices pushed past the end
+  std::vector<uint32_t> cache, nextCache;
+  size_t scanFrom = 0;
+  int64_t best = -1;
+  while (ordered.size() < indices.size()) {
+    if (best < 0) {
+      // nothing in the cache is left to draw, take the best of the rest
+      while (emitted[scanFrom]) {
+        scanFrom++;
+      }
+      float bestScore = -1.0f;
+      for (size_t t = scanFrom; t < triangleCount; t++) {
+        if (!emitted[t] && triangleScore[t] > bestScore) {
+          bestScore = triangleScore[t];
+          best = (int64_t)t;
+        }
+      }
+    }
+    emitted[best] = true;
+    const uint32_t* triangle = &indices[best * 3];
+    nextCache.assign(triangle, triangle + 3);
+    for (int k = 0; k < 3; k++) {
+      uint32_t v = triangle[k];
+      ordered.push_back(v);
+      // take the triangle off the vertex's list of pending ones
+      uint32_t* list = &vertexTriangles[firstTriangle[v]];
+      std::swap(*std::find(list, list + remaining[v], (uint32_t)best), list[remaining[v] - 1]);
+      remaining[v]--;
+    }
+    for (uint32_t v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        nextCache.push_back(v);
+      }
+    }
+    cache.swap(nextCache);
+    // rescore what the cache touched, the evicted vertices included
+    for (size_t i = 0; i < cache.size(); i++) {
+      uint32_t v = cache[i];
+      cachePosition[v] = i < (size_t)FORSYTH_CACHE_SIZE ? (int)i : -1;
+      score[v] = vertexScore(cachePosition[v], remaining[v]);
+    }
+    best = -1;
+    float bestScore = -1.0f;
+    for (uint32_t v : cache) {
+      for (uint32_t i = 0; i < remaining[v]; i++) {
+        uint32_t t = vertexTriangles[firstTriangle[v] + i];
+        triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+        if (triangleScore[t] > bestScore) {
+          bestScore = triangleScore[t];
+          best = t;
+        }
+      }
+    }
+    if (cache.size() > (size_t)FORSYTH_CACHE_SIZE) {
+      cache.resize(FORSYTH_CACHE_SIZE);
+    }
+  }
+  indices.swap(ordered);
+}
+
+void optimizeVertexFetch(IndexedMesh& mesh) {
+  std::vector<uint32_t> remap(mesh.vertexCount(), ~0u);
+  std::vector<float> vertices;
+  vertices.reserve(mesh.vertices.size());
+  uint32_t next = 0;
+  for (uint32_t& index : mesh.indices) {
+    if (remap[index] == ~0u) {
+      remap[index] = next++;
+      const float* vertex = &mesh.vertices[(size_t)index * mesh.stride];
+      vertices.insert(vertices.end(), vertex, vertex + mesh.stride);
+    }
+    index = remap[index];
+  }
+  mesh.vertices.swap(vertices);
+}
+
+namespace {
+// a symmetric 4x4 plane quadric, scaled by the triangle areas it sums
+struct Quadric {
+  float a[10] = {};
+  float weight = 0.0f;
+
+  void addPlane(const glm::vec3& normal, float distance, float area) {
+    float plane[4] = {normal.x, normal.y, normal.z, distance};
+    int k = 0;
+    for (int i = 0; i < 4; i++) {
+      for (int j = i; j < 4; j++) {
+        a[k++] += plane[i] * plane[j] * area;
+      }
+    }
+    weight += area;
+  }
+  void add(const Quadric& other) {
+    for (int k = 0; k < 10; k++) {
+      a[k] += other.a[k];
+    }
+    weight += other.weight;
+  }
+  // area weighted mean squared distance of `p` to the planes
+  float evaluate(const glm::vec3& p) const {
+    float v[4] = {p.x, p.y, p.z, 1.0f};
+    float sum = 0.0f;
+    int k = 0;
+    for (int i = 0; i < 4; i++) {
+      for (int j = i; j < 4; j++) {
+        sum += a[k++] * v[i] * v[j] * (i == j ? 1.0f : 2.0f);
+      }
+    }
+    return weight > 0.0f ? std::max(sum, 0.0f) / weight : 0.0f;
+  }
+};
+
+struct Collapse {
+  uint32_t from;  // position groups
+  uint32_t to;
+  float cost;
+};
+}
+
+// Runs in passes: every pass ranks all edges, then applies the cheapest
+// collapses whose neighbourhoods don't overlap, so each one is checked
+// against positions no other collapse of the pass has moved.
+std::vector<uint32_t> simplifyMesh(const IndexedMesh& mesh, const std::vector<uint32_t>& indices,
+  size_t targetIndexCount, float maxError, float* error) {
+  size_t vertexCount = mesh.vertexCount();
+  auto position = [&](uint32_t v) { return glm::make_vec3(&mesh.vertices[(size_t)v * mesh.stride]); };
+
+  // copies of a position share a group and a quadric
+  std::vector<uint32_t> group(vertexCount);
+  std::vector<std::vector<uint32_t>> members;
+  std::unordered_map<std::string, uint32_t> groupOf;
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    std::string key((const char*)&mesh.vertices[(size_t)v * mesh.stride], 3 * sizeof(float));
+    auto [found, inserted] = groupOf.try_emplace(key, (uint32_t)members.size());
+    if (inserted) {
+      members.emplace_back();
+    }
+    group[v] = found->second;
+    members[found->second].push_back(v);
+  }
+  std::vector<Quadric> quadrics(members.size());
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    glm::vec3 p0 = position(indices[t]), p1 = position(indices[t + 1]), p2 = position(indices[t + 2]);
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float length = glm::length(normal);
+    if (length <= 0.0f) {
+      continue;
+    }
+    normal /= length;
+    for (int corner = 0; corner < 3; corner++) {
+      quadrics[group[indices[t + corner]]].addPlane(normal, -glm::dot(normal, p0), 0.5f * length);
+    }
+  }
+
+  std::vector<uint32_t> result = indices;
+  float largestError = 0.0f;
+  std::vector<std::vector<uint32_t>> neighbours(vertexCount), triangles(vertexCount);
+  std::vector<uint32_t> target(vertexCount);
+  std::vector<bool> locked(members.size());
+  while (result.size() > targetIndexCount) {
+    for (uint32_t v = 0; v < vertexCount; v++) {
+      neighbours[v].clear();
+      triangles[v].clear();
+    }
+    for (uint32_t t = 0; t < result.size(); t += 3) {
+      for (int corner = 0; corner < 3; corner++) {
+        uint32_t v = result[t + corner];
+        triangles[v].push_back(t);
+        neighbours[v].push_back(result[t + (corner + 1) % 3]);
+        neighbours[v].push_back(result[t + (corner + 2) % 3]);
+      }
+    }
+    // each copy of `from` needs a neighbour among the copies of `to` to
+    // move onto, otherwise the collapse would tear a seam open
+    auto findTargets = [&](uint32_t from, uint32_t to) {
+      for (uint32_t u : members[from]) {
+        if (triangles[u].empty()) {
+          continue;
+        }
+        target[u] = ~0u;
+        for (uint32_t n : neighbours[u]) {
+          if (group[n] == to) {
+            target[u] = n;
+            break;
+          }
+        }
+        if (target[u] == ~0u) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    std::vector<Collapse> collapses;
+    for (size_t t = 0; t < result.size(); t += 3) {
+      for (int corner = 0; corner < 3; corner++) {
+        uint32_t from = group[result[t + corner]], to = group[result[t + (corner + 1) % 3]];
+        for (int direction = 0; direction < 2; direction++, std::swap(from, to)) {
+          Quadric sum = quadrics[from];
+          sum.add(quadrics[to]);
+          collapses.push_back({from, to, sum.evaluate(position(members[to][0]))});
+        }
+      }
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+      return a.cost < b.cost || (a.cost == b.cost && (a.from < b.from || (a.from == b.from && a.to < b.to)));
+    });
+
+    std::fill(locked.begin(), locked.end(), false);
+    size_t triangleCount = result.size() / 3;
+    size_t applied = 0;
+    for (const Collapse& collapse : collapses) {
+      if (collapse.cost > maxError * maxError || triangleCount * 3 <= targetIndexCount) {
+        break;
+      }
+      if (locked[collapse.from] || locked[collapse.to] || !findTargets(collapse.from, collapse.to)) {
+        continue;
+      }
+      // no remaining triangle may turn over
+      bool flips = false;
+      size_t removed = 0;
+      for (uint32_t u : members[collapse.from]) {
+        for (uint32_t t : triangles[u]) {
+          uint32_t corners[3] = {result[t], result[t + 1], result[t + 2]};
+          if (corners[0] == target[u] || corners[1] == target[u] || corners[2] == target[u]) {
+            removed++;
+            continue;
+          }
+          glm::vec3 before = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+          for (uint32_t& corner : corners) {
+            corner = corner == u ? target[u] : corner;
+          }
+          glm::vec3 after = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+          flips |= glm::dot(before, after) <= 0.0f;
+        }
+      }
+      if (flips) {
+        continue;
+      }
+      for (uint32_t u : members[collapse.from]) {
+        for (uint32_t n : neighbours[u]) {
+          locked[group[n]] = true;
+        }
+        for (uint32_t t : triangles[u]) {
+          for (int corner = 0; corner < 3; corner++) {
+            result[t + corner] = result[t + corner] == u ? target[u] : result[t + corner];
+          }
+        }
+      }
+      locked[collapse.from] = true;
+      quadrics[collapse.to].add(quadrics[collapse.from]);
+      largestError = std::max(largestError, std::sqrt(collapse.cost));
+      triangleCount -= removed;
+      applied++;
+    }
+    if (applied == 0) {
+      break;
+    }
+    // drop the triangles that lost a corner
+    size_t kept = 0;
+    for (size_t t = 0; t < result.size(); t += 3) {
+      uint32_t a = result[t], b = result[t + 1], c = result[t + 2];
+      if (a != b && b != c && a != c) {
+        result[kept++] = a;
+        result[kept++] = b;
+        result[kept++] = c;
+      }
+    }
+    result.resize(kept);
+  }
+  if (error) {
+    *error = largestError;
+  }
+  return result;
+}
+
+std::vector<MeshLod> buildMeshLods(const IndexedMesh& mesh, int levelCount, float reduction) {
+  std::vector<MeshLod> levels = {{mesh.indices, 0.0f}};
+  // every level starts from the full mesh, so its error is against that
+  float meshSize = 0.0f;
+  for (size_t v = 0; v < mesh.vertexCount(); v++) {
+    meshSize = std::max(meshSize, glm::length(glm::make_vec3(&mesh.vertices[v * mesh.stride])));
+  }
+  for (int level = 1; level < levelCount; level++) {
+    size_t target = (size_t)(levels.back().indices.size() / 3 * reduction) * 3;
+    MeshLod lod;
+    lod.indices = simplifyMesh(mesh, mesh.indices, target, meshSize, &lod.error);
+    // little left to gain
+    if (lod.indices.size() > levels.back().indices.size() * 3 / 4) {
+      break;
+    }
+    optimizeVertexCache(lod.indices, mesh.vertexCount());
+    levels.push_back(std::move(lod));
+  }
+  return levels;
+}
+
+float computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize) {
+  if (indices.empty()) {
+    return 0.0f;
+  }
+  std::deque<uint32_t> cache;
+  std::vector<bool> cached(vertexCount, false);
+  size_t misses = 0;
+  for (uint32_t index : indices) {
+    if (cached[index]) {
+      continue;
+    }
+    misses++;
+    cache.push_back(index);
+    cached[index] = true;
+    if (cache.size() > (size_t)cacheSize) {
+      cached[cache.front()] = false;
+      cache.pop_front();
+    }
+  }
+  return (float)misses / (indices.size() / 3);
+}
+
+QuantizedMesh quantizeMesh(const IndexedMesh& mesh) {
+  if (mesh.stride < 5 || mesh.vertexCount() > 65536) {
+    std::cout << "ERROR! can't quantize a mesh with " << mesh.vertexCount() << " vertices of "
+      << mesh.stride << " floats" << std::endl;
+    exit(1);
+  }
+  QuantizedMesh quantized;
+  for (int axis = 0; axis < 3; axis++) {
+    float extent = 0.0f;
+    for (size_t v = 0; v < mesh.vertexCount(); v++) {
+      extent = std::max(extent, std::abs(mesh.vertices[v * mesh.stride + axis]));
+    }
+    quantized.positionScale[axis] = extent > 0.0f ? extent : 1.0f;
+  }
+  quantized.vertices.resize(mesh.vertexCount());
+  for (size_t v = 0; v < mesh.vertexCount(); v++) {
+    const float* vertex = &mesh.vertices[v * mesh.stride];
+    QuantizedVertex& out = quantized.vertices[v];
+    for (int axis = 0; axis < 3; axis++) {
+      out.position[axis] = (int16_t)std::lround(vertex[axis] / quantized.positionScale[axis] * 32767.0f);
+    }
+    out.position[3] = 0;
+    out.uv[0] = glm::packHalf1x16(vertex[3]);
+    out.uv[1] = glm::packHalf1x16(vertex[4]);
+  }
+  quantized.indices.assign(mesh.indices.begin(), mesh.indices.end());
+  return quantized;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "vertex_layout.hpp"
+
+// Offline-style mesh processing for the vertex data the demo draws, run
+// once at startup. The usual order is indexMesh(), optimizeVertexCache(),
+// optimizeVertexFetch(), then quantizeMesh() for the upload.
+
+// Vertices of `stride` floats each, position (xyz) first, uv right after.
+struct IndexedMesh {
+  std::vector<float> vertices;
+  std::vector<uint32_t> indices;  // triangle list
+  int stride;
+
+  size_t vertexCount() const { return vertices.size() / stride; }
+};
+
+// Merges bitwise identical vertices of an unindexed triangle list.
+IndexedMesh indexMesh(const float* vertices, size_t vertexCount, int stride);
+
+// Reorders triangles so vertices get reused while still in the
+// post-transform cache (Forsyth's linear-speed algorithm).
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// Renumbers vertices in order of first use, so fetches walk the vertex
+// buffer forwards; vertices no triangle uses are dropped.
+void optimizeVertexFetch(IndexedMesh& mesh);
+
+// Quadric error edge collapse (Garland and Heckbert) of the triangle
+// list `indices` of `mesh`, cheapest first, until at most
+// `targetIndexCount` indices are left or the next collapse would move the
+// surface by more than `maxError`. A collapse moves a vertex onto one of
+// its neighbours instead of to a new position, so the result still
+// indexes mesh.vertices. Copies of a vertex that differ only in uv
+// collapse together and only along edges all of them share, which keeps
+// uv seams and corners closed. `error`, if set, gets the largest surface
+// distance of any collapse, in mesh units.
+std::vector<uint32_t> simplifyMesh(const IndexedMesh& mesh, const std::vector<uint32_t>& indices,
+  size_t targetIndexCount, float maxError, float* error = nullptr);
+
+// A detail level of a mesh: its own triangles over the shared vertices,
+// cache ordered, and how far they stray from the full mesh.
+struct MeshLod {
+  std::vector<uint32_t> indices;
+  float error;  // in mesh units, 0 for the full mesh
+};
+
+// mesh.indices, then up to `levelCount` - 1 simplified levels with
+// `reduction` times the triangles of the one before each; stops early
+// once simplifyMesh() can't get much further.
+std::vector<MeshLod> buildMeshLods(const IndexedMesh& mesh, int levelCount, float reduction = 0.25f);
+
+// Average cache miss ratio: transformed vertices per triangle on a FIFO
+// post-transform cache of `cacheSize` entries. 3 is no reuse at all, an
+// ideally ordered regular grid approaches 0.5.
+float computeAcmr(const std::vector<uint32_t>& indices, size_t vertexCount, int cacheSize = 16);
+
+// 12 bytes instead of 20: position as 16-bit signed normalized scaled by
+// QuantizedMesh::positionScale (the largest coordinate on each axis), uv
+// as half floats.
+struct QuantizedVertex {
+  SNorm16<4> position;  // w unused, keeps the uv 4-byte aligned
+  Half<2> uv;
+};
+constexpr auto quantizedVertexLayout = makeVertexLayout<QuantizedVertex>({
+  VERTEX_ATTRIBUTE(QuantizedVertex, position, "aPos"),
+  VERTEX_ATTRIBUTE(QuantizedVertex, uv, "aTexCoord"),
+});
+
+struct QuantizedMesh {
+  std::vector<QuantizedVertex> vertices;
+  std::vector<uint16_t> indices;  // meshes here stay below 65536 vertices
+  float positionScale[3];
+};
+
+// Expects an IndexedMesh with at least 5 floats per vertex and fewer than
+// 65536 vertices.
+QuantizedMesh quantizeMesh(const IndexedMesh& mesh);
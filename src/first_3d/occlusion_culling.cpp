@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "occlusion_culling.hpp"
+#include "gl_state.hpp"
+
+void DepthPyramid::build(const float* depth, int width, int height, const glm::mat4& viewProjection) {
+  this->viewProjection = viewProjection;
+  levels.resize(1);
+  levels[0].width = width;
+  levels[0].height = height;
+  levels[0].depth.assign(depth, depth + (size_t)width * height);
+  while (levels.back().width > 1 || levels.back().height > 1) {
+    const Level& below = levels.back();
+    Level level;
+    level.width = (below.width + 1) / 2;
+    level.height = (below.height + 1) / 2;
+    level.depth.resize((size_t)level.width * level.height);
+    for (int y = 0; y < level.height; y++) {
+      // odd sizes: the last texel covers the one row or column left over
+      const float* row0 = &below.depth[(size_t)(2 * y) * below.width];
+      const float* row1 = &below.depth[(size_t)std::min(2 * y + 1, below.height - 1) * below.width];
+      for (int x = 0; x < level.width; x++) {
+        int x0 = 2 * x, x1 = std::min(2 * x + 1, below.width - 1);
+        level.depth[(size_t)y * level.width + x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+      }
+    }
+    levels.push_back(std::move(level));
+  }
+}
+
+bool DepthPyramid::boxVisible(const glm::vec3& min, const glm::vec3& max) const {
+  if (levels.empty()) {
+    return true;
+  }
+  glm::vec2 lower = glm::vec2(FLT_MAX), upper = glm::vec2(-FLT_MAX);
+  float nearest = 1.0f;
+  for (int corner = 0; corner < 8; corner++) {
+    glm::vec3 point = glm::vec3(corner & 1 ? max.x : min.x, corner & 2 ? max.y : min.y, corner & 4 ? max.z : min.z);
+    glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+    if (clip.w <= 1e-5f) {
+      return true;
+    }
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    lower = glm::min(lower, glm::vec2(ndc));
+    upper = glm::max(upper, glm::vec2(ndc));
+    nearest = std::min(nearest, ndc.z * 0.5f + 0.5f);
+  }
+  if (nearest <= 0.0f || upper.x < -1.0f || upper.y < -1.0f || lower.x > 1.0f || lower.y > 1.0f) {
+    return true;
+  }
+
+  const Level& base = levels[0];
+  auto texel = [](float ndc, int size) {
+    return std::clamp((int)std::floor((ndc * 0.5f + 0.5f) * size), 0, size - 1);
+  };
+  int x0 = texel(lower.x, base.width), x1 = texel(upper.x, base.width);
+  int y0 = texel(lower.y, base.height), y1 = texel(upper.y, base.height);
+  // the level where the rectangle spans 2 or 3 texels a side
+  int span = std::max(x1 - x0, y1 - y0);
+  int level = 0;
+  while ((span >> level) > 1 && level + 1 < (int)levels.size()) {
+    level++;
+  }
+  const Level& chosen = levels[level];
+  float farthest = 0.0f;
+  for (int y = y0 >> level; y <= y1 >> level; y++) {
+    for (int x = x0 >> level; x <= x1 >> level; x++) {
+      farthest = std::max(farthest, chosen.depth[(size_t)y * chosen.width + x]);
+    }
+  }
+  return nearest <= farthest;
+}
+
+DepthReadback::DepthReadback() {
+  for (Buffer& buffer : buffers) {
+    glGenBuffers(1, &buffer.id);
+  }
+}
+
+DepthReadback::~DepthReadback() {
+  for (Buffer& buffer : buffers) {
+    if (buffer.fence) {
+      glDeleteSync(buffer.fence);
+    }
+    glState.deleteBuffers(1, &buffer.id);
+  }
+}
+
+void DepthReadback::capture(int width, int height, const glm::mat4& viewProjection) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  Buffer& buffer = buffers[next];
+  if (buffer.fence) {
+    // never got read, a newer frame replaces it
+    glDeleteSync(buffer.fence);
+  }
+  next = (next + 1) % BUFFER_COUNT;
+  glState.bindBuffer(GL_PIXEL_PACK_BUFFER, buffer.id);
+  if (buffer.width != width || buffer.height != height) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * sizeof(float), nullptr, GL_STREAM_READ);
+    buffer.width = width;
+    buffer.height = height;
+  }
+  buffer.viewProjection = viewProjection;
+  glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, (void*)0);
+  glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+// Walks the ring oldest first and uses the newest finished copy.
+bool DepthReadback::collect(DepthPyramid& pyramid) {
+  Buffer* newest = nullptr;
+  for (int i = 0; i < BUFFER_COUNT; i++) {
+    Buffer& buffer = buffers[(next + i) % BUFFER_COUNT];
+    if (!buffer.fence) {
+      continue;
+    }
+    if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      break;
+    }
+    glDeleteSync(buffer.fence);
+    buffer.fence = nullptr;
+    newest = &buffer;
+  }
+  if (!newest) {
+    return false;
+  }
+  GLsizeiptr bytes = (GLsizeiptr)newest->width * newest->height * sizeof(float);
+  glState.bindBuffer(GL_PIXEL_PACK_BUFFER, newest->id);
+  const float* depth = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+  if (depth) {
+    pyramid.build(depth, newest->width, newest->height, newest->viewProjection);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  return depth != nullptr;
+}
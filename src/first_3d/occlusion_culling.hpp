@@ -0,0 +1,67 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// A hierarchical depth buffer on the CPU: level 0 is a frame's window
+// depth, every level above halves it and keeps the farthest depth of the
+// texels it covers. A box is hidden if its nearest point is still behind
+// the farthest depth over the 2x2 texels of the level where its screen
+// rectangle is about one texel wide.
+//
+// The depth comes from an earlier frame, so the test uses that frame's
+// view-projection: it answers "was this box hidden last time", which
+// lets something that just came out from behind an occluder pop in a
+// frame or two late, but never hides anything the depth says is in front.
+class DepthPyramid {
+  public:
+    // `depth` is width x height window depths, bottom row first, as
+    // glReadPixels gives them
+    void build(const float* depth, int width, int height, const glm::mat4& viewProjection);
+    bool empty() const { return levels.empty(); }
+    int levelCount() const { return (int)levels.size(); }
+    // false only if the box lies entirely behind what the depth saw;
+    // boxes reaching behind the camera or off the screen count as visible
+    bool boxVisible(const glm::vec3& min, const glm::vec3& max) const;
+
+  private:
+    struct Level {
+      int width;
+      int height;
+      std::vector<float> depth;
+    };
+    std::vector<Level> levels;
+    glm::mat4 viewProjection;
+};
+
+// Copies the window's depth into pixel buffers after the frame's draws
+// and hands the newest one the GPU has finished to a DepthPyramid a frame
+// or two later, so reading it back never waits on the GPU. Owns the
+// buffers and their fences, so it has to be destroyed before
+// glfwTerminate().
+class DepthReadback {
+  public:
+    static const int BUFFER_COUNT = 3;
+
+    DepthReadback();
+    ~DepthReadback();
+    DepthReadback(const DepthReadback&) = delete;
+    DepthReadback& operator=(const DepthReadback&) = delete;
+
+    // after the draws, before the swap; `viewProjection` is what they used
+    void capture(int width, int height, const glm::mat4& viewProjection);
+    // rebuilds `pyramid` if a newer copy finished, returns whether it did
+    bool collect(DepthPyramid& pyramid);
+
+  private:
+    struct Buffer {
+      GLuint id;
+      GLsync fence = nullptr;
+      int width = 0;
+      int height = 0;
+      glm::mat4 viewProjection;
+    };
+    Buffer buffers[BUFFER_COUNT];
+    int next = 0;
+};
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstring>
+#include "render_queue.hpp"
+
+namespace {
+const int PASS_SHIFT = 60;
+const int STATE_BITS = DRAW_KEY_PROGRAM_BITS + DRAW_KEY_MATERIAL_BITS + DRAW_KEY_VERTEX_ARRAY_BITS;
+const uint64_t STATE_MASK = (1ull << STATE_BITS) - 1;
+
+uint32_t depthBits(float depth) {
+  // negative distances (behind the near plane) clamp to 0
+  depth = std::max(depth, 0.0f);
+  uint32_t bits;
+  memcpy(&bits, &depth, sizeof(bits));
+  return bits;
+}
+
+float depthFromBits(uint32_t bits) {
+  float depth;
+  memcpy(&depth, &bits, sizeof(depth));
+  return depth;
+}
+
+uint64_t packState(const DrawKeyFields& fields) {
+  uint64_t program = fields.program & ((1u << DRAW_KEY_PROGRAM_BITS) - 1);
+  uint64_t material = fields.material & ((1u << DRAW_KEY_MATERIAL_BITS) - 1);
+  uint64_t vertexArray = fields.vertexArray & ((1u << DRAW_KEY_VERTEX_ARRAY_BITS) - 1);
+  return program << (DRAW_KEY_MATERIAL_BITS + DRAW_KEY_VERTEX_ARRAY_BITS) | material << DRAW_KEY_VERTEX_ARRAY_BITS
+    | vertexArray;
+}
+}
+
+uint64_t makeDrawKey(const DrawKeyFields& fields) {
+  uint64_t key = (uint64_t)fields.pass << PASS_SHIFT;
+  uint64_t depth = depthBits(fields.depth);
+  if (fields.pass == RENDER_PASS_BLENDED) {
+    return key | (~depth & 0xffffffffull) << STATE_BITS | packState(fields);
+  }
+  return key | packState(fields) << 32 | depth;
+}
+
+DrawKeyFields decodeDrawKey(uint64_t key) {
+  DrawKeyFields fields;
+  fields.pass = (RenderPass)(key >> PASS_SHIFT);
+  uint64_t state;
+  if (fields.pass == RENDER_PASS_BLENDED) {
+    state = key & STATE_MASK;
+    fields.depth = depthFromBits(~(uint32_t)(key >> STATE_BITS));
+  } else {
+    state = key >> 32 & STATE_MASK;
+    fields.depth = depthFromBits((uint32_t)key);
+  }
+  fields.vertexArray = state & ((1u << DRAW_KEY_VERTEX_ARRAY_BITS) - 1);
+  fields.material = state >> DRAW_KEY_VERTEX_ARRAY_BITS & ((1u << DRAW_KEY_MATERIAL_BITS) - 1);
+  fields.program = (uint32_t)(state >> (DRAW_KEY_MATERIAL_BITS + DRAW_KEY_VERTEX_ARRAY_BITS));
+  return fields;
+}
+
+int radixSortItems(std::vector<RenderQueue::Item>& items, std::vector<RenderQueue::Item>& scratch) {
+  size_t count = items.size();
+  scratch.resize(count);
+  // every digit's histogram in one read of the keys
+  uint32_t histograms[8][256] = {};
+  for (const RenderQueue::Item& item : items) {
+    for (int digit = 0; digit < 8; digit++) {
+      histograms[digit][item.key >> (digit * 8) & 0xff]++;
+    }
+  }
+  int passes = 0;
+  for (int digit = 0; digit < 8; digit++) {
+    uint32_t* histogram = histograms[digit];
+    // a digit every key shares would copy everything to where it already is
+    if (count == 0 || histogram[items[0].key >> (digit * 8) & 0xff] == count) {
+      continue;
+    }
+    uint32_t offset = 0;
+    for (int bucket = 0; bucket < 256; bucket++) {
+      uint32_t bucketCount = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += bucketCount;
+    }
+    for (const RenderQueue::Item& item : items) {
+      scratch[histogram[item.key >> (digit * 8) & 0xff]++] = item;
+    }
+    items.swap(scratch);
+    passes++;
+  }
+  return passes;
+}
+
+void RenderQueue::sort() {
+  sortedItems.assign(pushed.begin(), pushed.end());
+  frameStats.draws = (uint32_t)pushed.size();
+  frameStats.radixPasses = radixSortItems(sortedItems, scratch);
+  frameStats.unsorted = countStateChanges(pushed);
+  frameStats.sorted = countStateChanges(sortedItems);
+}
+
+RenderQueue::StateChanges RenderQueue::countStateChanges(std::span<const Item> items) {
+  StateChanges changes;
+  for (size_t i = 0; i < items.size(); i++) {
+    DrawKeyFields fields = decodeDrawKey(items[i].key);
+    // the first draw sets everything
+    if (i == 0) {
+      changes = {1, 1, 1, 1};
+      continue;
+    }
+    DrawKeyFields previous = decodeDrawKey(items[i - 1].key);
+    changes.pass += fields.pass != previous.pass;
+    changes.program += fields.program != previous.program;
+    changes.material += fields.material != previous.material || fields.program != previous.program;
+    changes.vertexArray += fields.vertexArray != previous.vertexArray;
+  }
+  return changes;
+}
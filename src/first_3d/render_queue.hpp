@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Every draw of a frame as a 64-bit key plus the caller's index of the
+// draw, sorted by key before submission so draws sharing state end up
+// next to each other. From the top bit down:
+//
+//   opaque:   pass:4 | program:8 | material:12 | vertex array:8 | depth:32
+//   blended:  pass:4 | ~depth:32 | program:8 | material:12 | vertex array:8
+//
+// Opaque draws group by state and run front to back inside a group;
+// blended ones have to run back to front whatever their state, so depth
+// comes first and inverted. Depth is a non-negative float distance
+// from the camera, whose bits already sort like the value. Program,
+// material and vertex array are small ids the caller hands out, not GL
+// names.
+enum RenderPass : uint8_t {
+  RENDER_PASS_OPAQUE = 0,
+  RENDER_PASS_BLENDED = 1,
+};
+
+const int DRAW_KEY_PROGRAM_BITS = 8;
+const int DRAW_KEY_MATERIAL_BITS = 12;
+const int DRAW_KEY_VERTEX_ARRAY_BITS = 8;
+
+struct DrawKeyFields {
+  RenderPass pass;
+  uint32_t program;
+  uint32_t material;
+  uint32_t vertexArray;
+  float depth;
+};
+
+uint64_t makeDrawKey(const DrawKeyFields& fields);
+DrawKeyFields decodeDrawKey(uint64_t key);
+
+class RenderQueue {
+  public:
+    struct Item {
+      uint64_t key;
+      uint32_t draw;  // the caller's index
+    };
+    // consecutive draws that differ in each part of the state; material
+    // uniforms belong to the program, so a program change counts as a
+    // material change too
+    struct StateChanges {
+      uint32_t pass = 0;
+      uint32_t program = 0;
+      uint32_t material = 0;
+      uint32_t vertexArray = 0;
+      uint32_t total() const { return pass + program + material + vertexArray; }
+    };
+    struct Stats {
+      uint32_t draws = 0;
+      StateChanges unsorted;  // in push order
+      StateChanges sorted;
+      int radixPasses = 0;    // of 8, digits every key shares are skipped
+    };
+
+    void clear() { pushed.clear(); sortedItems.clear(); }
+    void push(uint64_t key, uint32_t draw) { pushed.push_back({key, draw}); }
+    void push(const DrawKeyFields& fields, uint32_t draw) { push(makeDrawKey(fields), draw); }
+    // radix sorts what was pushed into sorted()
+    void sort();
+
+    std::span<const Item> items() const { return pushed; }
+    std::span<const Item> sorted() const { return sortedItems; }
+    const Stats& stats() const { return frameStats; }
+
+    static StateChanges countStateChanges(std::span<const Item> items);
+
+  private:
+    std::vector<Item> pushed;
+    std::vector<Item> sortedItems;
+    std::vector<Item> scratch;
+    Stats frameStats;
+};
+
+// LSD radix sort by key, 8 bits a pass, stable. `scratch` is resized to
+// match. Returns how many passes actually moved items.
+int radixSortItems(std::vector<RenderQueue::Item>& items, std::vector<RenderQueue::Item>& scratch);
@@ -1,33 +1,127 @@
-const char* vertexShaderSource = R"(
+#include <string>
+#include "mesh_optimizer.hpp"
+#include "cube_instances.hpp"
+
+// The `in` declarations of both vertex shaders come from the layouts of
+// QuantizedVertex and CubeInstance.
+constexpr GlslSource vertexShaderSource = withVertexInputs(R"(
 #version 330 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoord;
 out vec4 vCol;
 out vec2 vTexCoord;
+out vec3 vViewPos;  // for the light clusters
 
+layout (std140) uniform FrameData {
+  mat4 view;
+  mat4 projection;
+  vec3 camPos;
+  float time;
+  mat3 camRot;
+};
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform vec3 positionScale;  // undoes the 16-bit normalized quantization
 
 void main() {
-  gl_Position = projection * view * model * vec4(aPos, 1.0);
+  vec4 viewPos = view * model * vec4(aPos.xyz * positionScale, 1.0);
+  gl_Position = projection * viewPos;
+  vViewPos = viewPos.xyz;
   vTexCoord = aTexCoord;  
 }
-)";
+)", quantizedVertexLayout);
 
 
-const char* fragmentShaderSource = R"(
+// Same cube, but every cube of the scene in one draw: the per-cube part
+// of the model transform comes from the instance attribute, `model` only
+// holds what all cubes share.
+constexpr GlslSource instancedVertexShaderSource = withVertexInputs(R"(
 #version 330 core
 
+out vec4 vCol;
+out vec2 vTexCoord;
+out vec3 vViewPos;  // for the light clusters
+
+layout (std140) uniform FrameData {
+  mat4 view;
+  mat4 projection;
+  vec3 camPos;
+  float time;
+  mat3 camRot;
+};
+uniform mat4 model;
+uniform vec3 spinAxis;  // normalized
+uniform vec3 positionScale;  // undoes the 16-bit normalized quantization
+
+vec3 rotateAroundAxis(vec3 v, vec3 axis, float angle) {
+  float c = cos(angle);
+  float s = sin(angle);
+  return v * c + cross(axis, v) * s + axis * dot(axis, v) * (1.0 - c);
+}
+
+void main() {
+  // aInstanceSpin is in degrees per second
+  vec3 local = rotateAroundAxis(aPos.xyz * positionScale, spinAxis, radians(aInstanceSpin * time));
+  vec4 viewPos = view * model * vec4(aInstancePos + local, 1.0);
+  gl_Position = projection * viewPos;
+  vViewPos = viewPos.xyz;
+  vTexCoord = aTexCoord;
+}
+)", quantizedVertexLayout, cubeInstanceLayout);
+
+
+// STRIPES makes the second cube program, the queue sorts draws by program
+// and material.
+const char* fragmentShaderCommon = R"(
 in vec4 vCol;
 in vec2 vTexCoord;
+in vec3 vViewPos;
 out vec4 FragColor;
 
-uniform sampler2D texture1Data;
-uniform sampler2D texture2Data;
+// every material image is a layer of one array, so switching materials
+// between draws is a uniform change instead of a texture bind
+uniform sampler2DArray materials;
+uniform ivec2 materialLayers;  // base, overlay
+uniform vec4 materialUvScale;  // base in xy, overlay in zw
+uniform float opacity;  // below 1 only in the blended pass
+
+// clustered point lights, see LightClusters: per cluster the first entry
+// in lightIndices and the count, per light 2 texels in lightData, view
+// space position and radius, then color
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer lightIndices;
+uniform vec4 clusterTiles;  // pixels per tile, tiles across and down
+uniform vec3 clusterSlices;  // scale and bias of log(depth), slice count
+uniform float ambient;
+
+vec3 clusterLighting(vec3 position, vec3 normal) {
+  ivec2 tile = min(ivec2(gl_FragCoord.xy / clusterTiles.xy), ivec2(clusterTiles.zw) - 1);
+  int slice = clamp(int(log(-position.z) * clusterSlices.x + clusterSlices.y), 0, int(clusterSlices.z) - 1);
+  int cluster = (slice * int(clusterTiles.w) + tile.y) * int(clusterTiles.z) + tile.x;
+  uvec2 range = texelFetch(clusterRanges, cluster).xy;
+  vec3 light = vec3(ambient);
+  for (uint i = range.x; i < range.x + range.y; i++) {
+    int index = int(texelFetch(lightIndices, int(i)).x);
+    vec4 positionRadius = texelFetch(lightData, 2 * index);
+    vec3 toLight = positionRadius.xyz - position;
+    float distance = length(toLight);
+    float falloff = clamp(1.0 - distance / positionRadius.w, 0.0, 1.0);
+    light += texelFetch(lightData, 2 * index + 1).rgb * falloff * falloff * max(dot(normal, toLight / distance), 0.0);
+  }
+  return light;
+}
 
 void main() {
-  FragColor = mix(texture(texture1Data, vTexCoord), texture(texture2Data, vTexCoord), 0.3f);
+  vec4 base = texture(materials, vec3(vTexCoord * materialUvScale.xy, materialLayers.x));
+  vec4 overlay = texture(materials, vec3(vTexCoord * materialUvScale.zw, materialLayers.y));
+  vec4 color = mix(base, overlay, 0.3f);
+#ifdef STRIPES
+  color.rgb *= 0.6 + 0.4 * step(0.5, fract(vTexCoord.x * 4.0));
+#endif
+  // the vertices carry no normals, light faceted from screen space derivatives
+  vec3 normal = normalize(cross(dFdx(vViewPos), dFdy(vViewPos)));
+  FragColor = vec4(color.rgb * clusterLighting(vViewPos, normal), opacity);
 }
 )";
+
+const std::string fragmentShaderSource = std::string("#version 330 core\n") + fragmentShaderCommon;
+const std::string stripedFragmentShaderSource = std::string("#version 330 core\n#define STRIPES\n") + fragmentShaderCommon;
@@ -0,0 +1,102 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include "stream_buffer.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+
+StreamBuffer::StreamBuffer(size_t frameBytes)
+  // whole 256 bytes, so every region starts on any uniform buffer alignment
+  : frameBytes((frameBytes + 255) / 256 * 256) {
+  glGenBuffers(1, &bufferId);
+  // the copy target, so the binding no draw state depends on is the only one touched
+  glState.bindBuffer(GL_COPY_WRITE_BUFFER, bufferId);
+  GLsizeiptr totalBytes = this->frameBytes * FRAME_COUNT;
+  if (glExt.bufferStorage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_COPY_WRITE_BUFFER, totalBytes, nullptr, flags);
+    persistentData = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, totalBytes, flags);
+    if (!persistentData) {
+      std::cout << "ERROR! couldn't map the stream buffer persistently" << std::endl;
+      exit(1);
+    }
+  } else {
+    glBufferData(GL_COPY_WRITE_BUFFER, totalBytes, nullptr, GL_STREAM_DRAW);
+  }
+  glState.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+  for (GLsync fence : fences) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+  // the persistent mapping, or a region still mapped mid-frame
+  if (persistentData || frameData) {
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, bufferId);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+  glState.deleteBuffers(1, &bufferId);
+}
+
+void StreamBuffer::beginFrame() {
+  region = (region + 1) % FRAME_COUNT;
+  if (GLsync fence = fences[region]) {
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      counters.fenceWaits++;
+      auto start = std::chrono::steady_clock::now();
+      // flushed so the fence is sure to get signaled at all
+      do {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      } while (status == GL_TIMEOUT_EXPIRED);
+      counters.fenceWaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    glDeleteSync(fence);
+    fences[region] = nullptr;
+  }
+  used = 0;
+  if (persistentData) {
+    frameData = persistentData + region * frameBytes;
+  } else {
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, bufferId);
+    // the fence above already guarantees the GPU is done with the region
+    frameData = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, region * frameBytes, frameBytes,
+      GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (!frameData) {
+      std::cout << "ERROR! couldn't map the stream buffer" << std::endl;
+      exit(1);
+    }
+  }
+}
+
+StreamBuffer::Allocation StreamBuffer::allocate(size_t bytes, size_t alignment) {
+  size_t offset = (used + alignment - 1) / alignment * alignment;
+  if (!frameData || offset + bytes > frameBytes) {
+    std::cout << "ERROR! stream buffer frame region of " << frameBytes << " bytes can't fit " << bytes
+      << " more bytes" << std::endl;
+    exit(1);
+  }
+  used = offset + bytes;
+  return {frameData + offset, (GLintptr)(region * frameBytes + offset)};
+}
+
+void StreamBuffer::commit() {
+  if (!persistentData && frameData) {
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, bufferId);
+    glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glState.bindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  }
+  frameData = nullptr;
+}
+
+void StreamBuffer::endFrame() {
+  commit();
+  fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  counters.frames++;
+  counters.peakFrameBytes = std::max(counters.peakFrameBytes, used);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// One buffer for everything the CPU writes anew each frame (instance
+// lists, uniform blocks, dynamic vertices), split into FRAME_COUNT
+// regions used round-robin. A frame writes only its own region, straight
+// into memory the GPU reads, and fences it once its draws are submitted;
+// beginFrame() only waits if the GPU is still FRAME_COUNT - 1 frames
+// behind on the region it is about to reuse.
+//
+// With GL_ARB_buffer_storage the buffer is mapped persistent and coherent
+// once for its whole life. Without it each region is mapped unsynchronized
+// in beginFrame() and unmapped in commit(), the fences still guard reuse,
+// so neither path ever reallocates the store or lets the driver sync.
+//
+// Per frame: beginFrame(), allocate() and write, commit(), draw, endFrame().
+// Owns GL objects, so it must be destroyed before glfwTerminate().
+class StreamBuffer {
+  public:
+    static const int FRAME_COUNT = 3;
+
+    struct Allocation {
+      void* data;       // valid until commit()
+      GLintptr offset;  // into id(), for glBindBufferRange / attribute pointers
+    };
+    struct Stats {
+      uint64_t frames = 0;
+      uint64_t fenceWaits = 0;  // frames that found their region still in use
+      double fenceWaitMs = 0.0;
+      size_t peakFrameBytes = 0;
+    };
+
+    explicit StreamBuffer(size_t frameBytes);
+    ~StreamBuffer();
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    void beginFrame();
+    Allocation allocate(size_t bytes, size_t alignment = 16);
+    template <typename T>
+    Allocation push(const T& value, size_t alignment = 16) {
+      Allocation allocation = allocate(sizeof(T), alignment);
+      memcpy(allocation.data, &value, sizeof(T));
+      return allocation;
+    }
+    void commit();
+    void endFrame();
+
+    GLuint id() const { return bufferId; }
+    bool persistent() const { return persistentData != nullptr; }
+    const Stats& stats() const { return counters; }
+
+  private:
+    GLuint bufferId;
+    size_t frameBytes;
+    unsigned char* persistentData = nullptr;
+    unsigned char* frameData = nullptr;
+    int region = FRAME_COUNT - 1;
+    size_t used = 0;
+    GLsync fences[FRAME_COUNT] = {};
+    Stats counters;
+};
@@ -0,0 +1,169 @@
+#include "transforms.hpp"
+#include "avx_kernels.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void TransformArrays::push(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+  positionX.push_back(position.x);
+  positionY.push_back(position.y);
+  positionZ.push_back(position.z);
+  rotationX.push_back(rotation.x);
+  rotationY.push_back(rotation.y);
+  rotationZ.push_back(rotation.z);
+  rotationW.push_back(rotation.w);
+  scaleX.push_back(scale.x);
+  scaleY.push_back(scale.y);
+  scaleZ.push_back(scale.z);
+}
+
+void TransformArrays::setRotation(size_t i, const glm::quat& rotation) {
+  rotationX[i] = rotation.x;
+  rotationY[i] = rotation.y;
+  rotationZ[i] = rotation.z;
+  rotationW[i] = rotation.w;
+}
+
+void TransformArrays::clear() {
+  for (std::vector<float>* component : {&positionX, &positionY, &positionZ, &rotationX, &rotationY, &rotationZ,
+    &rotationW, &scaleX, &scaleY, &scaleZ}) {
+    component->clear();
+  }
+}
+
+const char* transformPathName(TransformPath path) {
+  switch (path) {
+    case TransformPath::Sse: return "SSE";
+    case TransformPath::Avx: return "AVX";
+    default: return "scalar";
+  }
+}
+
+bool transformPathAvailable(TransformPath path) {
+  switch (path) {
+#ifdef __SSE2__
+    case TransformPath::Sse: return true;
+#endif
+    case TransformPath::Avx: return cpuHasAvx();
+    case TransformPath::Scalar: return true;
+    default: return false;
+  }
+}
+
+TransformPath bestTransformPath() {
+  if (cpuHasAvx()) {
+    return TransformPath::Avx;
+  }
+#if defined(__SSE2__)
+  return TransformPath::Sse;
+#else
+  return TransformPath::Scalar;
+#endif
+}
+
+// Every path works out the upper 3x3 of translate * rotate * scale from
+// the quaternion directly, then multiplies only the columns of `parent`
+// that can contribute: the local matrix's bottom row is always 0 0 0 1.
+// Item i is transform indices[i], or first + i without `indices`.
+
+// items [begin, end) one at a time, also the tail of the SIMD paths
+static void composeScalar(const glm::mat4& parent, const TransformArrays& t, const uint32_t* indices, size_t first,
+  size_t begin, size_t end, glm::mat4* out) {
+  for (size_t i = begin; i < end; i++) {
+    size_t k = indices ? indices[i] : first + i;
+    float x = t.rotationX[k], y = t.rotationY[k], z = t.rotationZ[k], w = t.rotationW[k];
+    float xx = x * x, yy = y * y, zz = z * z;
+    float xy = x * y, xz = x * z, yz = y * z, wx = w * x, wy = w * y, wz = w * z;
+    glm::vec3 column0 = glm::vec3(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy)) * t.scaleX[k];
+    glm::vec3 column1 = glm::vec3(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx)) * t.scaleY[k];
+    glm::vec3 column2 = glm::vec3(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy)) * t.scaleZ[k];
+    glm::vec3 position = glm::vec3(t.positionX[k], t.positionY[k], t.positionZ[k]);
+    out[i][0] = parent[0] * column0.x + parent[1] * column0.y + parent[2] * column0.z;
+    out[i][1] = parent[0] * column1.x + parent[1] * column1.y + parent[2] * column1.z;
+    out[i][2] = parent[0] * column2.x + parent[1] * column2.y + parent[2] * column2.z;
+    out[i][3] = parent[0] * position.x + parent[1] * position.y + parent[2] * position.z + parent[3];
+  }
+}
+
+#ifdef __SSE2__
+static size_t composeSse(const glm::mat4& parent, const TransformArrays& t, const uint32_t* indices, size_t first,
+  size_t begin, size_t end, glm::mat4* out) {
+  size_t n = begin + ((end - begin) & ~(size_t)3);
+  for (size_t i = begin; i < n; i += 4) {
+    auto load = [&](const std::vector<float>& component) {
+      if (!indices) {
+        return _mm_loadu_ps(&component[first + i]);
+      }
+      return _mm_setr_ps(component[indices[i]], component[indices[i + 1]], component[indices[i + 2]],
+        component[indices[i + 3]]);
+    };
+    __m128 x = load(t.rotationX), y = load(t.rotationY), z = load(t.rotationZ), w = load(t.rotationW);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+    __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+    __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+    __m128 scaleX = load(t.scaleX), scaleY = load(t.scaleY), scaleZ = load(t.scaleZ);
+    // local[column][row], rows 0-2
+    __m128 local[4][3] = {
+      {_mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleX),
+        _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleX),
+        _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleX)},
+      {_mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleY),
+        _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleY),
+        _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleY)},
+      {_mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZ),
+        _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZ),
+        _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZ)},
+      {load(t.positionX), load(t.positionY), load(t.positionZ)},
+    };
+    for (int column = 0; column < 4; column++) {
+      // one row of this column across the 4 items, then transposed into
+      // the 4 items' columns
+      __m128 rows[4];
+      for (int row = 0; row < 4; row++) {
+        __m128 value = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(parent[0][row]), local[column][0]),
+            _mm_mul_ps(_mm_set1_ps(parent[1][row]), local[column][1])),
+          _mm_mul_ps(_mm_set1_ps(parent[2][row]), local[column][2]));
+        rows[row] = column == 3 ? _mm_add_ps(value, _mm_set1_ps(parent[3][row])) : value;
+      }
+      _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+      for (int lane = 0; lane < 4; lane++) {
+        _mm_storeu_ps(&out[i + lane][column][0], rows[lane]);
+      }
+    }
+  }
+  return n;
+}
+#endif
+
+static void compose(const glm::mat4& parent, const TransformArrays& transforms, const uint32_t* indices, size_t first,
+  size_t count, glm::mat4* out, TransformPath path) {
+  size_t done = 0;
+#ifdef HAVE_AVX_KERNELS
+  if (path == TransformPath::Avx && cpuHasAvx()) {
+    const float* components[10] = {transforms.positionX.data(), transforms.positionY.data(), transforms.positionZ.data(),
+      transforms.rotationX.data(), transforms.rotationY.data(), transforms.rotationZ.data(), transforms.rotationW.data(),
+      transforms.scaleX.data(), transforms.scaleY.data(), transforms.scaleZ.data()};
+    done = composeTransformsAvx(&parent[0][0], components, indices, first, 0, count, &out[0][0][0]);
+  }
+#endif
+#ifdef __SSE2__
+  if (path == TransformPath::Sse) {
+    done = composeSse(parent, transforms, indices, first, 0, count, out);
+  }
+#endif
+  composeScalar(parent, transforms, indices, first, done, count, out);
+}
+
+void composeTransforms(const glm::mat4& parent, const TransformArrays& transforms, size_t first, size_t end,
+  glm::mat4* out, TransformPath path) {
+  compose(parent, transforms, nullptr, first, end - first, out, path);
+}
+
+void composeTransforms(const glm::mat4& parent, const TransformArrays& transforms, std::span<const uint32_t> indices,
+  glm::mat4* out, TransformPath path) {
+  compose(parent, transforms, indices.data(), 0, indices.size(), out, path);
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Position, rotation and scale of many objects as structure-of-arrays, so
+// the SIMD paths load 4 or 8 objects' worth of one component at a time
+// and build that many model matrices side by side.
+struct TransformArrays {
+  std::vector<float> positionX, positionY, positionZ;
+  std::vector<float> rotationX, rotationY, rotationZ, rotationW;  // unit quaternions
+  std::vector<float> scaleX, scaleY, scaleZ;
+
+  void push(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale);
+  void setRotation(size_t i, const glm::quat& rotation);
+  void clear();
+  size_t size() const { return positionX.size(); }
+};
+
+enum class TransformPath { Scalar, Sse, Avx };
+const char* transformPathName(TransformPath path);
+// whether this build compiled the path in and this CPU runs it
+bool transformPathAvailable(TransformPath path);
+// the widest available path
+TransformPath bestTransformPath();
+
+// Writes parent * translate(position) * mat4(rotation) * scale(scale) of
+// transforms [first, end) to out[0 .. end - first). `out` is plain
+// column-major mat4s, so it may just as well be a mapped buffer.
+void composeTransforms(const glm::mat4& parent, const TransformArrays& transforms, size_t first, size_t end,
+  glm::mat4* out, TransformPath path = bestTransformPath());
+// The same for the transforms listed in `indices`, in that order.
+void composeTransforms(const glm::mat4& parent, const TransformArrays& transforms, std::span<const uint32_t> indices,
+  glm::mat4* out, TransformPath path = bestTransformPath());
@@ -0,0 +1,79 @@
+#include "avx_kernels.hpp"
+
+#ifdef __AVX__
+#include <immintrin.h>
+
+// rows[k] lane l <-> rows[l] lane k
+static void transpose8(__m256 rows[8]) {
+  __m256 t[8], s[8];
+  for (int k = 0; k < 8; k += 2) {
+    t[k] = _mm256_unpacklo_ps(rows[k], rows[k + 1]);
+    t[k + 1] = _mm256_unpackhi_ps(rows[k], rows[k + 1]);
+  }
+  for (int k = 0; k < 8; k += 4) {
+    s[k] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(1, 0, 1, 0));
+    s[k + 1] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(3, 2, 3, 2));
+    s[k + 2] = _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(1, 0, 1, 0));
+    s[k + 3] = _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(3, 2, 3, 2));
+  }
+  for (int k = 0; k < 4; k++) {
+    rows[k] = _mm256_permute2f128_ps(s[k], s[k + 4], 0x20);
+    rows[k + 4] = _mm256_permute2f128_ps(s[k], s[k + 4], 0x31);
+  }
+}
+
+size_t composeTransformsAvx(const float* parent, const float* const* components, const uint32_t* indices, size_t first,
+  size_t begin, size_t end, float* out) {
+  size_t n = begin + ((end - begin) & ~(size_t)7);
+  for (size_t i = begin; i < n; i += 8) {
+    auto load = [&](int component) {
+      const float* values = components[component];
+      if (!indices) {
+        return _mm256_loadu_ps(values + first + i);
+      }
+      const uint32_t* k = &indices[i];
+      return _mm256_setr_ps(values[k[0]], values[k[1]], values[k[2]], values[k[3]], values[k[4]], values[k[5]],
+        values[k[6]], values[k[7]]);
+    };
+    __m256 x = load(3), y = load(4), z = load(5), w = load(6);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+    __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+    __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+    __m256 scaleX = load(7), scaleY = load(8), scaleZ = load(9);
+    __m256 local[4][3] = {
+      {_mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), scaleX),
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), scaleX),
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), scaleX)},
+      {_mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), scaleY),
+        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), scaleY),
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), scaleY)},
+      {_mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), scaleZ),
+        _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), scaleZ),
+        _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), scaleZ)},
+      {load(0), load(1), load(2)},
+    };
+    // two columns at a time: 8 rows across the 8 items transpose into the
+    // 8 items' first or last two columns, 8 contiguous floats each
+    for (int column = 0; column < 4; column += 2) {
+      __m256 rows[8];
+      for (int half = 0; half < 2; half++) {
+        for (int row = 0; row < 4; row++) {
+          const __m256* source = local[column + half];
+          __m256 value = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(parent[0 * 4 + row]), source[0]),
+              _mm256_mul_ps(_mm256_set1_ps(parent[1 * 4 + row]), source[1])),
+            _mm256_mul_ps(_mm256_set1_ps(parent[2 * 4 + row]), source[2]));
+          rows[half * 4 + row] = column + half == 3 ? _mm256_add_ps(value, _mm256_set1_ps(parent[3 * 4 + row])) : value;
+        }
+      }
+      transpose8(rows);
+      for (int lane = 0; lane < 8; lane++) {
+        _mm256_storeu_ps(out + (i + lane) * 16 + column * 4, rows[lane]);
+      }
+    }
+  }
+  return n;
+}
+#endif
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include "asset_pack.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Assets& assets() {
+  static Assets instance;
+  return instance;
+}
+
+Assets::~Assets() {
+#ifdef __linux__
+  if (data) {
+    munmap((void*)data, size);
+  }
+#endif
+}
+
+bool validateAssetPack(const unsigned char* data, size_t size) {
+  if (size < sizeof(AssetPackHeader)) {
+    return false;
+  }
+  const AssetPackHeader* header = (const AssetPackHeader*)data;
+  if (memcmp(header->magic, "GPAK", 4) != 0 || header->version != ASSET_PACK_VERSION
+      || header->indexOffset % alignof(AssetPackEntry) != 0
+      || header->indexOffset + (uint64_t)header->entryCount * sizeof(AssetPackEntry) > size || header->namesOffset > size) {
+    return false;
+  }
+  const AssetPackEntry* entries = (const AssetPackEntry*)(data + header->indexOffset);
+  for (uint32_t i = 0; i < header->entryCount; i++) {
+    // the +1 covers the null byte after every blob
+    if (header->namesOffset + entries[i].nameOffset + entries[i].nameLength > size
+        || entries[i].dataOffset + entries[i].dataSize + 1 > size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Assets::open(const std::string& packPath) {
+#ifdef __linux__
+  int fd = ::open(packPath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  if (!validateAssetPack((const unsigned char*)mapped, st.st_size)) {
+    std::cout << "ERROR! malformed asset pack: " << packPath << std::endl;
+    munmap(mapped, st.st_size);
+    return false;
+  }
+  data = (const unsigned char*)mapped;
+  size = st.st_size;
+  header = (const AssetPackHeader*)data;
+  entries = (const AssetPackEntry*)(data + header->indexOffset);
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::span<const unsigned char> Assets::blob(std::string_view path) const {
+  if (!data) {
+    return {};
+  }
+  const char* names = (const char*)data + header->namesOffset;
+  auto nameOf = [names](const AssetPackEntry& entry) {
+    return std::string_view(names + entry.nameOffset, entry.nameLength);
+  };
+  const AssetPackEntry* end = entries + header->entryCount;
+  const AssetPackEntry* found = std::lower_bound(entries, end, path,
+    [&](const AssetPackEntry& entry, std::string_view name) { return nameOf(entry) < name; });
+  if (found == end || nameOf(*found) != path) {
+    return {};
+  }
+  return std::span<const unsigned char>(data + found->dataOffset, found->dataSize);
+}
+
+std::string_view Assets::text(const std::string& path) {
+  std::span<const unsigned char> packed = blob(path);
+  if (!packed.empty()) {
+    return std::string_view((const char*)packed.data(), packed.size());
+  }
+  // one read straight into the string, no stream buffer in between
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in.is_open()) {
+    throw std::runtime_error("Failed to open file: " + path);
+  }
+  std::string& text = looseFiles[path];
+  text.resize(in.tellg());
+  in.seekg(0);
+  in.read(text.data(), text.size());
+  return text;
+}
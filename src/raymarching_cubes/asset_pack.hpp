@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "asset_pack_format.hpp"
+
+// Where the program's files come from. open() maps a pack once at launch;
+// without one (the usual case while developing, so shader hot reload sees
+// the edited files) every lookup goes to the loose file instead.
+class Assets {
+  public:
+    Assets() = default;
+    ~Assets();
+    Assets(const Assets&) = delete;
+    Assets& operator=(const Assets&) = delete;
+
+    // Returns false, and keeps serving loose files, when `packPath` is
+    // missing or malformed.
+    bool open(const std::string& packPath);
+    bool packed() const { return data != nullptr; }
+
+    // A view into the pack, or into a copy of the loose file that stays
+    // valid until the same path is read again. Throws std::runtime_error
+    // when neither has it. GL thread only.
+    std::string_view text(const std::string& path);
+    // Packed bytes, empty when the pack does not hold `path` (callers fall
+    // back to the loose file themselves). Safe from any thread.
+    std::span<const unsigned char> blob(std::string_view path) const;
+
+  private:
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    const AssetPackHeader* header = nullptr;
+    const AssetPackEntry* entries = nullptr;
+    std::unordered_map<std::string, std::string> looseFiles;
+};
+
+Assets& assets();
@@ -1,42 +1,212 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <stdexcept>
 #include <string>
 #include "shader.hpp"
+#include "gl_extensions.hpp"
+#include "program_cache.hpp"
+#include "frame_uniforms.hpp"
+#include "gl_state.hpp"
 
 
 GLuint submitShaderProgram(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource);
-GLuint getUniformLocation(GLuint shaderProgramId, const std::string& uniformName);
-std::string readFileAsText(const std::string& filePath);
+GLint getUniformLocation(GLuint shaderProgramId, const std::string& uniformName);
+bool checkShaderCompiled(GLuint shaderId, GLenum shaderType);
+bool checkProgramLinked(GLuint shaderProgramId);
 
+uint32_t hashUniformName(const char* name);
 
-Shader::Shader(const std::string& vertShaderPath, const std::string& fragShaderPath) {
-  std::string vertShader = readFileAsText(vertShaderPath);
-  std::string fragShader = readFileAsText(fragShaderPath);
+Shader::Shader(const std::string& vertShaderPath, const std::string& fragShaderPath, const ShaderDefines& defines)
+  : vertShaderPath(vertShaderPath), fragShaderPath(fragShaderPath), defines(defines) {
+  std::string vertShader = preprocessShaderFile(vertShaderPath, defines);
+  std::string fragShader = preprocessShaderFile(fragShaderPath, defines);
   shaderProgramId = submitShaderProgram(vertShader.c_str(), fragShader.c_str());
+  reflectUniforms();
+  bindUniformBlocks();
 }
 void Shader::use() {
-  glUseProgram(shaderProgramId);
+  glState.useProgram(shaderProgramId);
+}
+void Shader::reload() {
+  discardPendingProgram();
+  std::string vertShader, fragShader;
+  try {
+    vertShader = preprocessShaderFile(vertShaderPath, defines);
+    fragShader = preprocessShaderFile(fragShaderPath, defines);
+  } catch (const std::runtime_error& e) {
+    // editors may briefly remove the file while saving, the next event retries
+    std::cout << "ERROR! shader reload failed: " << e.what() << std::endl;
+    return;
+  }
+  pending.cacheKey = programCacheKey(vertShader.c_str(), fragShader.c_str());
+  pending.programId = loadCachedProgram(pending.cacheKey);
+  if (pending.programId != 0) {
+    return;
+  }
+  // only issue the work here, status is queried in update() so that with
+  // parallel shader compile the driver finishes it off the render thread
+  const GLchar* vertSource = vertShader.c_str();
+  const GLchar* fragSource = fragShader.c_str();
+  pending.vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(pending.vertexShaderId, 1, &vertSource, nullptr);
+  glCompileShader(pending.vertexShaderId);
+  pending.fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(pending.fragmentShaderId, 1, &fragSource, nullptr);
+  glCompileShader(pending.fragmentShaderId);
+  pending.programId = glCreateProgram();
+  if (glExt.programBinary) {
+    glProgramParameteri(pending.programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+  glAttachShader(pending.programId, pending.vertexShaderId);
+  glAttachShader(pending.programId, pending.fragmentShaderId);
+  glLinkProgram(pending.programId);
+}
+bool Shader::update() {
+  if (pending.programId == 0) {
+    return false;
+  }
+  if (glExt.parallelShaderCompile) {
+    GLint done = GL_FALSE;
+    glGetProgramiv(pending.programId, GL_COMPLETION_STATUS_KHR, &done);
+    if (!done) {
+      return false;
+    }
+  }
+  bool compiledFromSource = pending.vertexShaderId != 0;
+  bool success = !compiledFromSource || (checkShaderCompiled(pending.vertexShaderId, GL_VERTEX_SHADER)
+    && checkShaderCompiled(pending.fragmentShaderId, GL_FRAGMENT_SHADER));
+  success = success && checkProgramLinked(pending.programId);
+  if (!success) {
+    std::cout << "ERROR! shader reload failed, keeping the previous program" << std::endl;
+    discardPendingProgram();
+    return false;
+  }
+  if (compiledFromSource) {
+    storeCachedProgram(pending.programId, pending.cacheKey);
+  }
+  glState.deleteProgram(shaderProgramId);
+  shaderProgramId = pending.programId;
+  pending.programId = 0;
+  discardPendingProgram();
+  reflectUniforms();
+  bindUniformBlocks();
+  return true;
+}
+void Shader::discardPendingProgram() {
+  if (pending.vertexShaderId != 0) {
+    glDeleteShader(pending.vertexShaderId);
+    glDeleteShader(pending.fragmentShaderId);
+  }
+  if (pending.programId != 0) {
+    glState.deleteProgram(pending.programId);
+  }
+  pending = PendingProgram();
 }
 void Shader::setUniform1f(const std::string& name, float val) {
-  int uniformLoc = getUniformLocation(shaderProgramId, name);
+  int uniformLoc = uniforms[findUniform(name, GL_FLOAT)].location;
   glUniform1f(uniformLoc, val);
 }
 void Shader::setUniform1i(const std::string& name, int val) {
-  int uniformLoc = getUniformLocation(shaderProgramId, name);
+  int uniformLoc = uniforms[findUniform(name, GL_INT)].location;
   glUniform1i(uniformLoc, val);
 }
-void Shader::setUnifromMatrix4fv(const std::string& name, const GLfloat* value){
-  int uniformLoc = getUniformLocation(shaderProgramId, name);
+void Shader::setUnifromMatrix4fv(const std::string& name, const GLfloat* value) {
+  int uniformLoc = uniforms[findUniform(name, GL_FLOAT_MAT4)].location;
   glUniformMatrix4fv(uniformLoc, 1, GL_FALSE, value);
 }
 
-GLuint submitShader(const GLchar* source, GLenum shaderType) {
-  GLuint shaderId = glCreateShader(shaderType);
-  glShaderSource(shaderId, 1, &source, nullptr);
-  glCompileShader(shaderId);
+void Shader::reflectUniforms() {
+  // handles keep indices into `uniforms`, so after a reload existing entries
+  // are re-resolved in place; names the new program dropped get location -1,
+  // which glUniform* silently ignores
+  for (UniformInfo& info : uniforms) {
+    info.location = glGetUniformLocation(shaderProgramId, info.name.c_str());
+  }
+  GLint count = 0, maxNameLen = 0;
+  glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLen);
+  std::vector<char> nameBuf(maxNameLen + 1);
+  for (GLint i = 0; i < count; i++) {
+    GLsizei nameLen;
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(shaderProgramId, i, nameBuf.size(), &nameLen, &size, &type, nameBuf.data());
+    std::string name(nameBuf.data(), nameLen);
+    // arrays are reported as "name[0]", register them under the bare name
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+      name.resize(name.size() - 3);
+    }
+    GLint location = glGetUniformLocation(shaderProgramId, name.c_str());
+    if (location == -1) {
+      continue; // members of uniform blocks have no location
+    }
+    bool known = false;
+    for (UniformInfo& info : uniforms) {
+      if (info.name == name) {
+        info.type = type;
+        known = true;
+        break;
+      }
+    }
+    if (!known) {
+      uniforms.push_back({name, hashUniformName(name.c_str()), location, type});
+    }
+  }
+  uint32_t slotCount = 8;
+  while (slotCount < uniforms.size() * 2) {
+    slotCount *= 2;
+  }
+  uniformSlots.assign(slotCount, -1);
+  for (uint32_t i = 0; i < uniforms.size(); i++) {
+    insertUniformSlot(i);
+  }
+}
+
+void Shader::bindUniformBlocks() {
+  GLuint blockIndex = glGetUniformBlockIndex(shaderProgramId, "FrameData");
+  if (blockIndex != GL_INVALID_INDEX) {
+    glUniformBlockBinding(shaderProgramId, blockIndex, FRAME_UNIFORMS_BINDING);
+  }
+}
+
+void Shader::insertUniformSlot(uint32_t index) {
+  uint32_t mask = uniformSlots.size() - 1;
+  uint32_t slot = uniforms[index].hash & mask;
+  while (uniformSlots[slot] != -1) {
+    slot = (slot + 1) & mask;
+  }
+  uniformSlots[slot] = index;
+}
+
+uint32_t Shader::findUniform(const std::string& name, GLenum type) {
+  uint32_t hash = hashUniformName(name.c_str());
+  uint32_t mask = uniformSlots.size() - 1;
+  for (uint32_t slot = hash & mask; uniformSlots[slot] != -1; slot = (slot + 1) & mask) {
+    const UniformInfo& info = uniforms[uniformSlots[slot]];
+    if (info.hash != hash || info.name != name) {
+      continue;
+    }
+    if (info.type != type && !(type == GL_INT && isSamplerType(info.type))) {
+      std::cout << "ERROR! uniform type mismatch: " << name << std::endl;
+      exit(1);
+    }
+    return uniformSlots[slot];
+  }
+  // individual array elements and struct members are not enumerated, so ask the driver once
+  uniforms.push_back({name, hash, getUniformLocation(shaderProgramId, name), type});
+  if (uniforms.size() * 2 > uniformSlots.size()) {
+    uniformSlots.assign(uniformSlots.size() * 2, -1);
+    for (uint32_t i = 0; i < uniforms.size(); i++) {
+      insertUniformSlot(i);
+    }
+  } else {
+    insertUniformSlot(uniforms.size() - 1);
+  }
+  return uniforms.size() - 1;
+}
+
+bool checkShaderCompiled(GLuint shaderId, GLenum shaderType) {
   int success;
   glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
   if (!success) {
@@ -45,32 +215,57 @@ GLuint submitShader(const GLchar* source, GLenum shaderType) {
     std::cout << "ERROR! shader compilation failed (" 
       << (shaderType == GL_VERTEX_SHADER ? "VERTEX_SHADER" : "FRAGMENT_SHADER")
       << "): " << log << std::endl;
+  }
+  return success;
+}
+
+bool checkProgramLinked(GLuint shaderProgramId) {
+  int success;
+  glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
+  if (!success) {
+    char log[512];
+    glGetProgramInfoLog(shaderProgramId, 512, nullptr, log);
+    std::cout << "ERROR! shader link failed: " << log << std::endl;
+  }
+  return success;
+}
+
+GLuint submitShader(const GLchar* source, GLenum shaderType) {
+  GLuint shaderId = glCreateShader(shaderType);
+  glShaderSource(shaderId, 1, &source, nullptr);
+  glCompileShader(shaderId);
+  if (!checkShaderCompiled(shaderId, shaderType)) {
     exit(1);
   }
   return shaderId;
 }
 
 GLuint submitShaderProgram(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource) {
+  std::string cacheKey = programCacheKey(vertexShaderSource, fragmentShaderSource);
+  GLuint cachedProgramId = loadCachedProgram(cacheKey);
+  if (cachedProgramId != 0) {
+    return cachedProgramId;
+  }
+
   GLuint vertexShaderId = submitShader(vertexShaderSource, GL_VERTEX_SHADER);
   GLuint fragmentShaderId = submitShader(fragmentShaderSource, GL_FRAGMENT_SHADER);
   GLuint shaderProgramId = glCreateProgram();
+  if (glExt.programBinary) {
+    glProgramParameteri(shaderProgramId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
   glAttachShader(shaderProgramId, vertexShaderId);
   glAttachShader(shaderProgramId, fragmentShaderId);
   glLinkProgram(shaderProgramId);
-  int success;
-  glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
-  if (!success) {
-    char log[512];
-    glGetProgramInfoLog(shaderProgramId, 512, nullptr, log);
-    std::cout << "ERROR! shader link failed: " << log << std::endl;
+  if (!checkProgramLinked(shaderProgramId)) {
     exit(1);
   }
   glDeleteShader(vertexShaderId);
   glDeleteShader(fragmentShaderId);
+  storeCachedProgram(shaderProgramId, cacheKey);
   return shaderProgramId;
 }
 
-GLuint getUniformLocation(GLuint shaderProgramId, const std::string& uniformName) {
+GLint getUniformLocation(GLuint shaderProgramId, const std::string& uniformName) {
   int uniformLoc = glGetUniformLocation(shaderProgramId, uniformName.c_str());
   if (uniformLoc == -1) {
     std::cout << "ERROR! couldn't locate the uniform: " << uniformName << std::endl;
@@ -79,12 +274,11 @@ GLuint getUniformLocation(GLuint shaderProgramId, const std::string& uniformName
   return uniformLoc;
 }
 
-std::string readFileAsText(const std::string& filePath) {
-  std::ifstream in(filePath);
-  if (!in.is_open()) {
-      throw std::runtime_error("Failed to open file: " + filePath);
-  }
-  std::stringstream buffer;
-  buffer << in.rdbuf();
-  return buffer.str();
+// FNV-1a
+uint32_t hashUniformName(const char* name) {
+  uint32_t hash = 2166136261u;
+  for (; *name; name++) {
+    hash = (hash ^ (uint8_t)*name) * 16777619u;
+  }
+  return hash;
 }
@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "shader_preprocessor.hpp"
+#include "asset_pack.hpp"
+
+struct IncludeState {
+  std::set<std::string> included;
+  int nextFileId = 1;
+};
+
+std::string directoryOf(const std::string& filePath) {
+  size_t slash = filePath.find_last_of('/');
+  return slash == std::string::npos ? "" : filePath.substr(0, slash + 1);
+}
+
+// whether `directive` is the first token of `line`, so a mention in a
+// comment or after other code doesn't count
+bool startsWithDirective(std::string_view line, std::string_view directive) {
+  size_t start = line.find_first_not_of(" \t");
+  if (start == std::string_view::npos || line.compare(start, directive.size(), directive) != 0) {
+    return false;
+  }
+  size_t end = start + directive.size();
+  return end == line.size() || line[end] == ' ' || line[end] == '\t';
+}
+
+// returns the quoted path of an `#include "..."` line, or an empty string
+std::string_view includePath(std::string_view line) {
+  if (!startsWithDirective(line, "#include")) {
+    return "";
+  }
+  size_t open = line.find('"', line.find_first_not_of(" \t") + 8);
+  size_t close = open == std::string_view::npos ? open : line.find('"', open + 1);
+  if (close == std::string_view::npos) {
+    throw std::runtime_error("Malformed shader include: " + std::string(line));
+  }
+  return line.substr(open + 1, close - open - 1);
+}
+
+// `source` is walked line by line in place, only the output is copied
+void expandIncludes(std::string_view source, const std::string& sourceDir, int fileId,
+                    const ShaderDefines* defines, IncludeState& state, std::string& out) {
+  int lineNumber = 0;
+  while (!source.empty()) {
+    size_t newline = source.find('\n');
+    std::string_view line = source.substr(0, newline);
+    source.remove_prefix(newline == std::string_view::npos ? source.size() : newline + 1);
+    lineNumber++;
+    if (defines && startsWithDirective(line, "#version")) {
+      out += line;
+      out += "\n";
+      for (const ShaderDefine& define : *defines) {
+        out += "#define " + define.name + " " + define.value + "\n";
+      }
+      out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileId) + "\n";
+      defines = nullptr;
+      continue;
+    }
+    std::string_view path = includePath(line);
+    if (path.empty()) {
+      out += line;
+      out += "\n";
+      continue;
+    }
+    std::string fullPath = sourceDir + std::string(path);
+    if (state.included.insert(fullPath).second) {
+      int includeId = state.nextFileId++;
+      out += "#line 1 " + std::to_string(includeId) + "\n";
+      expandIncludes(assets().text(fullPath), directoryOf(fullPath), includeId, nullptr, state, out);
+    }
+    out += "#line " + std::to_string(lineNumber + 1) + " " + std::to_string(fileId) + "\n";
+  }
+}
+
+// `state` already lists the top level file when there is one, so a file
+// including it back doesn't paste it a second time
+std::string preprocess(std::string_view source, const std::string& sourceDir, const ShaderDefines& defines,
+                       IncludeState& state) {
+  std::string out;
+  out.reserve(source.size());
+  expandIncludes(source, sourceDir, 0, &defines, state, out);
+  return out;
+}
+
+std::string preprocessShaderSource(std::string_view source, const std::string& sourceDir, const ShaderDefines& defines) {
+  IncludeState state;
+  return preprocess(source, sourceDir, defines, state);
+}
+
+std::string preprocessShaderFile(const std::string& filePath, const ShaderDefines& defines) {
+  IncludeState state;
+  state.included.insert(filePath);
+  return preprocess(assets().text(filePath), directoryOf(filePath), defines, state);
+}
+
+std::string shaderVariantKey(const ShaderDefines& defines) {
+  std::vector<std::string> entries;
+  for (const ShaderDefine& define : defines) {
+    entries.push_back(define.name + "=" + define.value + ";");
+  }
+  std::sort(entries.begin(), entries.end());
+  std::string key;
+  for (const std::string& entry : entries) {
+    key += entry;
+  }
+  return key;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct ShaderDefine {
+  std::string name;
+  std::string value;
+};
+using ShaderDefines = std::vector<ShaderDefine>;
+
+// Expands `#include "file"` (paths relative to the including file, each
+// file pasted at most once) and injects one #define per entry right after
+// the #version line. #line directives keep driver error messages pointing
+// at the original file and line; file numbers count up in include order
+// starting with 0 for the top level source. Files come from assets(), so
+// from the pack when one is open. Throws std::runtime_error on a missing
+// include.
+std::string preprocessShaderSource(std::string_view source, const std::string& sourceDir, const ShaderDefines& defines);
+std::string preprocessShaderFile(const std::string& filePath, const ShaderDefines& defines);
+
+// Order independent key of a define set, e.g. "MAX_DIST=50.0;MAX_STEPS=64;"
+std::string shaderVariantKey(const ShaderDefines& defines);
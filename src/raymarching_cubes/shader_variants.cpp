@@ -0,0 +1,29 @@
+#include <memory>
+#include <string>
+#include "shader_variants.hpp"
+
+ShaderVariants::ShaderVariants(const std::string& vertShaderPath, const std::string& fragShaderPath)
+  : vertShaderPath(vertShaderPath), fragShaderPath(fragShaderPath) {
+}
+
+Shader& ShaderVariants::get(const ShaderDefines& defines) {
+  std::unique_ptr<Shader>& shader = variants[shaderVariantKey(defines)];
+  if (!shader) {
+    shader = std::make_unique<Shader>(vertShaderPath, fragShaderPath, defines);
+  }
+  return *shader;
+}
+
+void ShaderVariants::reload() {
+  for (auto& [key, shader] : variants) {
+    shader->reload();
+  }
+}
+
+bool ShaderVariants::update() {
+  bool swapped = false;
+  for (auto& [key, shader] : variants) {
+    swapped |= shader->update();
+  }
+  return swapped;
+}
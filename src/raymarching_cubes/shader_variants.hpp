@@ -0,0 +1,30 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "shader.hpp"
+#include "shader_preprocessor.hpp"
+
+// One program per define set of the same pair of shader files. Hot
+// constants go in as #defines so the driver can unroll and fold them;
+// get() compiles a variant the first time its key is seen and returns the
+// cached Shader afterwards, so switching between prebuilt variants at
+// runtime is free.
+class ShaderVariants {
+  public:
+    ShaderVariants(const std::string& vertShaderPath, const std::string& fragShaderPath);
+    Shader& get(const ShaderDefines& defines);
+    // forwards Shader::reload/update to every built variant
+    void reload();
+    bool update();
+    template <typename Fn>
+    void forEach(Fn fn) {
+      for (auto& [key, shader] : variants) {
+        fn(*shader);
+      }
+    }
+  private:
+    std::string vertShaderPath;
+    std::string fragShaderPath;
+    std::unordered_map<std::string, std::unique_ptr<Shader>> variants;
+};
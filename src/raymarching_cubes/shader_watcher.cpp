@@ -0,0 +1,48 @@
+#include <iostream>
+#include <string>
+#include "shader_watcher.hpp"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher::ShaderWatcher(const std::string& dirPath) {
+#ifdef __linux__
+  inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  // editors either rewrite the file in place or rename a temp file over it
+  if (inotifyFd == -1 || inotify_add_watch(inotifyFd, dirPath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+    std::cout << "WARNING! couldn't watch shader directory: " << dirPath << std::endl;
+  }
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher() {
+#ifdef __linux__
+  if (inotifyFd != -1) {
+    close(inotifyFd);
+  }
+#endif
+}
+
+bool ShaderWatcher::poll() {
+  bool changed = false;
+#ifdef __linux__
+  if (inotifyFd == -1) {
+    return false;
+  }
+  alignas(inotify_event) char buffer[4096];
+  ssize_t len;
+  while ((len = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+    for (char* ptr = buffer; ptr < buffer + len; ) {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(ptr);
+      std::string name = event->len > 0 ? event->name : "";
+      if (name.size() > 5 && name.compare(name.size() - 5, 5, ".glsl") == 0) {
+        changed = true;
+      }
+      ptr += sizeof(inotify_event) + event->len;
+    }
+  }
+#endif
+  return changed;
+}
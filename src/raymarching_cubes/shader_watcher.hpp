@@ -0,0 +1,17 @@
+#pragma once
+#include <string>
+
+// Watches a directory of shader files with inotify. poll() never blocks,
+// so it can be called every frame; a burst of events from one save is
+// reported as a single change. Does nothing on platforms without inotify.
+class ShaderWatcher {
+  public:
+    ShaderWatcher(const std::string& dirPath);
+    ~ShaderWatcher();
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+    // true when a .glsl file in the directory was written since the last poll
+    bool poll();
+  private:
+    int inotifyFd = -1;
+};
@@ -0,0 +1,8 @@
+// Mirrors FrameUniforms in frame_uniforms.hpp, keep the two in sync.
+layout (std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    vec3 camPos;
+    float time;
+    mat3 camRot;
+};
@@ -0,0 +1,86 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoords;
+uniform sampler2D tex;
+#include "frame_data.glsl"
+
+#include "sdf.glsl"
+
+// ---------- Variant constants (injected by ShaderVariants) ----------
+#ifndef MAX_STEPS
+#define MAX_STEPS 100
+#endif
+#ifndef MAX_DIST
+#define MAX_DIST 50.0
+#endif
+#ifndef ASPECT
+#define ASPECT (800.0/600.0)
+#endif
+
+// ---------- Scene ----------
+vec3 pos1, pos2;
+vec3 cubeHalf = vec3(0.5);
+
+float sceneSDF(vec3 p) {
+    float earlyMerge = 0.8; // distance at which merging starts
+    float c1 = sdBox(p - pos1, cubeHalf) - earlyMerge;
+    float c2 = sdBox(p - pos2, cubeHalf) - earlyMerge;
+    return opSmoothUnion(c1, c2, 0.2);
+}
+
+// ---------- Normals ----------
+vec3 getNormal(vec3 p) {
+    float eps = 0.0005;
+    return normalize(vec3(
+        sceneSDF(p + vec3(eps,0,0)) - sceneSDF(p - vec3(eps,0,0)),
+        sceneSDF(p + vec3(0,eps,0)) - sceneSDF(p - vec3(0,eps,0)),
+        sceneSDF(p + vec3(0,0,eps)) - sceneSDF(p - vec3(0,0,eps))
+    ));
+}
+
+// ---------- Triplanar Texture ----------
+vec3 triplanar(sampler2D tex, vec3 p, vec3 n) {
+    vec3 an = abs(n);
+    vec3 xproj = texture(tex, p.yz).rgb;
+    vec3 yproj = texture(tex, p.zx).rgb;
+    vec3 zproj = texture(tex, p.xy).rgb;
+    return (xproj*an.x + yproj*an.y + zproj*an.z) / (an.x + an.y + an.z);
+}
+
+// ---------- Raymarch ----------
+float raymarch(vec3 ro, vec3 rd, out vec3 pos) {
+    float t = 0.0;
+    for(int i=0;i<MAX_STEPS;i++) {
+        pos = ro + t*rd;
+        float d = sceneSDF(pos);
+        if(d < 0.001) break;
+        t += d;
+        if(t>MAX_DIST) break;
+    }
+    return t;
+}
+
+// ---------- Main ----------
+void main() {
+    vec2 uv = TexCoords*2.0 - 1.0;
+    uv.x *= ASPECT;
+
+    vec3 ro = camPos;
+    vec3 rd = normalize(camRot * vec3(uv.xy, -1.0));
+
+    float mergeDist = 1.5;
+    float t = sin(time)*0.5 + 0.5;
+    pos1 = vec3(-mergeDist*(1.0-t),0,0);
+    pos2 = vec3( mergeDist*(1.0-t),0,0);
+
+    vec3 p;
+    float dist = raymarch(ro, rd, p);
+    if(dist>MAX_DIST) { FragColor = vec4(0.2,0.3,0.3,1.0); return; }
+
+    vec3 n = getNormal(p);
+    vec3 lightDir = normalize(vec3(0.5,1.0,0.7));
+    float diff = max(dot(n, lightDir),0.0);
+    vec3 col = triplanar(tex, p, n);
+
+    FragColor = vec4(col*diff,1.0);
+}
@@ -0,0 +1,9 @@
+// ---------- SDF Functions ----------
+float sdBox(vec3 p, vec3 b) {
+    vec3 q = abs(p) - b;
+    return length(max(q,0.0)) + min(max(q.x,max(q.y,q.z)), 0.0);
+}
+float opSmoothUnion(float d1, float d2, float k) {
+    float h = clamp(0.5 + 0.5*(d2 - d1)/k, 0.0, 1.0);
+    return mix(d2,d1,h) - k*h*(1.0 - h);
+}
@@ -1,22 +1,31 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <stb_image.h>
 #include "shader.hpp"
+#include "texture_streamer.hpp"
+#include "texture_container.hpp"
+#include "texture_cache.hpp"
+#include "gl_extensions.hpp"
+#include "program_cache.hpp"
 #include "shader_sources.hpp"
+#include "gl_state.hpp"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
+void benchTextureContainer(const char* imgPath);
+void benchTextureResidency(GLFWwindow* window, size_t budgetBytes, const std::vector<std::string>& imgPaths);
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
 
-GLuint loadTexture(const char* imgPath);
-
-
-
-int main() {
+int main(int argc, char** argv) {
+  auto startTime = std::chrono::steady_clock::now();
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -39,22 +48,37 @@ int main() {
       std::cout << "Failed to initialize GLAD" << std::endl;
       return -1;
   }
+  loadGLExtensions();
+
+  if (argc > 2 && strcmp(argv[1], "--bench-container") == 0) {
+    benchTextureContainer(argv[2]);
+    glfwTerminate();
+    return 0;
+  }
+  if (argc > 3 && strcmp(argv[1], "--bench-residency") == 0) {
+    benchTextureResidency(window, (size_t)atol(argv[2]) * 1024, std::vector<std::string>(argv + 3, argv + argc));
+    glfwTerminate();
+    return 0;
+  }
 
-  Shader shader(vertexShaderSource, fragmentShaderSource);
-  GLuint texture1Id = loadTexture("assets/container.jpg");
-  GLuint texture2Id = loadTexture("assets/awesomeface.png");
+  Shader shader(vertexShaderSource.c_str(), fragmentShaderSource);
+  // textures show a placeholder until their worker decode and upload finish
+  TextureStreamer textureStreamer;
+  std::vector<TextureStreamer::ArrayLayer> materialLayers;
+  GLuint materialsId = textureStreamer.requestArray({"assets/container.jpg", "assets/awesomeface.png"}, materialLayers);
+  const TextureStreamer::ArrayLayer& baseMaterial = materialLayers[0];
+  const TextureStreamer::ArrayLayer& overlayMaterial = materialLayers[1];
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture1Id);
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, texture2Id);
+  // bound once, draws only pick layers
+  glState.activeTexture(GL_TEXTURE0);
+  glState.bindTexture(GL_TEXTURE_2D_ARRAY, materialsId);
 
-  float vertices[] = {
+  Vertex vertices[] = {
     // positions         // colors           // texture coords
-    0.5f,  0.5f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 1.0f,   // top right
-    0.5f, -0.5f, 0.0f,   0.0f, 1.0f, 0.0f,   1.0f, 0.0f,   // bottom right
-    -0.5f, -0.5f, 0.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f,   // bottom left
-    -0.5f,  0.5f, 0.0f,   1.0f, 1.0f, 0.0f,   0.0f, 1.0f    // top left   
+    0.5f,  0.5f, 0.0f,   255, 0, 0, 255,     1.0f, 1.0f,   // top right
+    0.5f, -0.5f, 0.0f,   0, 255, 0, 255,     1.0f, 0.0f,   // bottom right
+    -0.5f, -0.5f, 0.0f,  0, 0, 255, 255,     0.0f, 0.0f,   // bottom left
+    -0.5f,  0.5f, 0.0f,  255, 255, 0, 255,   0.0f, 1.0f    // top left   
   };
   unsigned int indices[] = {
     0, 1, 2,
@@ -66,46 +90,53 @@ int main() {
   glGenBuffers(1, &VBO);
   glGenBuffers(1, &EBO);
 
-  glBindVertexArray(VAO);
+  glState.bindVertexArray(VAO);
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-  glEnableVertexAttribArray(2);
+  setupVertexAttributes(vertexLayout);
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+  glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+  glState.bindVertexArray(0);
 
   shader.use();
-  // mapping uniform to the GL_TEXTUREX
-  shader.setUniform1i("texture1Data", 0);
-  shader.setUniform1i("texture2Data", 1);
+  // the material array sits on GL_TEXTURE0
+  shader.uniform<GL_SAMPLER_2D_ARRAY>("materials").set(0);
+  shader.uniform<GL_INT_VEC2>("materialLayers").set(baseMaterial.layer, overlayMaterial.layer);
+  shader.uniform<GL_FLOAT_VEC4>("materialUvScale").set(baseMaterial.uvScale[0], baseMaterial.uvScale[1],
+    overlayMaterial.uvScale[0], overlayMaterial.uvScale[1]);
 
+  bool firstFrame = true;
   while (!glfwWindowShouldClose(window)) {
     processInput(window);
+    textureStreamer.update();
 
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT);
 
     shader.use();
-    glBindVertexArray(VAO);
+    glState.bindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
-    glBindVertexArray(0);
+    glState.bindVertexArray(0);
 
     glfwSwapBuffers(window);
+    glState.endFrame();
+    if (firstFrame) {
+      firstFrame = false;
+      glFinish();
+      reportTimeToFirstFrame("texture",
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+    }
     glfwPollEvents();
   }
+  std::cout << "state calls: " << GLStateCache::summary(glState.total(), glState.frames()) << std::endl;
 
-  glDeleteBuffers(1, &VBO);
-  glDeleteVertexArrays(1, &VAO);
+  glState.deleteBuffers(1, &VBO);
+  glState.deleteVertexArrays(1, &VAO);
 
   glfwTerminate();
   return 0;
@@ -121,15 +152,11 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 }
 
 
-
-GLuint loadTexture(const char* imgPath) {
-  GLuint texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+// Loads `imgPath` through stb_image (decode, glTexImage2D, glGenerateMipmap)
+// and through a .gtex container baked next to it, finishing the GPU work
+// each run so both numbers include the upload.
+void benchTextureContainer(const char* imgPath) {
+  const int BENCH_RUNS = 10;
   stbi_set_flip_vertically_on_load(true);
   int width, height, nrChannels;
   unsigned char *data = stbi_load(imgPath, &width, &height, &nrChannels, 0);
@@ -137,10 +164,75 @@ GLuint loadTexture(const char* imgPath) {
     std::cout << "ERROR! couldn't load the texture image: " << imgPath << std::endl;
     exit(1);
   }
-  GLenum imgFmt = nrChannels == 4 ? GL_RGBA : GL_RGB;
-  glTexImage2D(GL_TEXTURE_2D, 0, imgFmt, width, height, 0, imgFmt, GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-
+  std::string containerPath = textureContainerPath(imgPath);
+  if (!writeTextureContainer(containerPath, data, width, height, nrChannels)) {
+    std::cout << "ERROR! couldn't write the texture container: " << containerPath << std::endl;
+    exit(1);
+  }
   stbi_image_free(data);
-  return texture;
+
+  double stbMs = 0.0, containerMs = 0.0;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    auto start = std::chrono::steady_clock::now();
+    data = stbi_load(imgPath, &width, &height, &nrChannels, 0);
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glState.bindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    GLenum imgFmt = nrChannels == 4 ? GL_RGBA : GL_RGB;
+    glTexImage2D(GL_TEXTURE_2D, 0, imgFmt, width, height, 0, imgFmt, GL_UNSIGNED_BYTE, data);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glFinish();
+    stbi_image_free(data);
+    stbMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    glState.deleteTextures(1, &texture);
+
+    start = std::chrono::steady_clock::now();
+    TextureContainer container;
+    if (!openTextureContainer(containerPath, container)) {
+      std::cout << "ERROR! couldn't open the texture container: " << containerPath << std::endl;
+      exit(1);
+    }
+    glGenTextures(1, &texture);
+    uploadTextureContainer(texture, container);
+    glFinish();
+    closeTextureContainer(container);
+    containerMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    glState.deleteTextures(1, &texture);
+  }
+  std::cout << imgPath << " (" << width << "x" << height << "x" << nrChannels << ")" << std::endl
+    << "  stb_image + glGenerateMipmap: " << stbMs / BENCH_RUNS << " ms" << std::endl
+    << "  mmapped .gtex container:      " << containerMs / BENCH_RUNS << " ms" << std::endl;
+}
+
+
+// Slides a window of BENCH_WORKING_SET images across `imgPaths`, one
+// step per frame, binding each through a TextureCache limited to
+// `budgetBytes`, then prints the cache counters and the peak residency.
+void benchTextureResidency(GLFWwindow* window, size_t budgetBytes, const std::vector<std::string>& imgPaths) {
+  const int BENCH_FRAMES = 600;
+  const size_t BENCH_WORKING_SET = 4;
+  TextureStreamer textureStreamer;
+  TextureCache textureCache(textureStreamer, budgetBytes);
+  size_t peakBytes = 0;
+  glState.activeTexture(GL_TEXTURE0);
+  for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+    textureStreamer.update();
+    textureCache.update();
+    peakBytes = std::max(peakBytes, textureCache.residentBytes());
+    for (size_t i = 0; i < std::min(BENCH_WORKING_SET, imgPaths.size()); i++) {
+      glState.bindTexture(GL_TEXTURE_2D, textureCache.acquire(imgPaths[(frame + i) % imgPaths.size()]));
+    }
+    glClear(GL_COLOR_BUFFER_BIT);
+    glfwSwapBuffers(window);
+    glfwPollEvents();
+  }
+  const TextureCache::Counters& counters = textureCache.counters();
+  std::cout << imgPaths.size() << " images, budget " << budgetBytes / 1024 << " KiB over " << BENCH_FRAMES << " frames" << std::endl
+    << "  hits " << counters.hits << ", misses " << counters.misses << ", full-res reloads " << counters.reloads << std::endl
+    << "  mip drops " << counters.mipDrops << ", evictions " << counters.evictions
+    << ", failed loads " << counters.failures << std::endl
+    << "  resident " << textureCache.residentBytes() / 1024 << " KiB, peak " << peakBytes / 1024 << " KiB" << std::endl;
+  textureCache.clear();
 }
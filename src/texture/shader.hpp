@@ -2,14 +2,93 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Sampler uniforms are set like GL_INT ones, with the texture unit.
+constexpr bool isSamplerType(GLenum type) {
+  switch (type) {
+    case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+    case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_BUFFER:
+    case GL_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+      return true;
+    default:
+      return false;
+  }
+}
+
+class Shader;
+
+// Pre-resolved handle to an active uniform of GLSL type `Type`.
+// Setting it is one indexed load plus the glUniform call: no string
+// hashing and no driver query. Applies to the currently used program,
+// and must not outlive the Shader it came from.
+template <GLenum Type>
+class Uniform {
+  public:
+    Uniform() = default;
+    Uniform(const Shader* shader, uint32_t index) : shader(shader), index(index) {}
+    void set(int val) const requires (isSamplerType(Type) || Type == GL_INT) {
+      glUniform1i(location(), val);
+    }
+    void set(int v1, int v2) const requires (Type == GL_INT_VEC2) {
+      glUniform2i(location(), v1, v2);
+    }
+    void set(float val) const requires (Type == GL_FLOAT) {
+      glUniform1f(location(), val);
+    }
+    void set(float v1, float v2) const requires (Type == GL_FLOAT_VEC2) {
+      glUniform2f(location(), v1, v2);
+    }
+    void set(float v1, float v2, float v3) const requires (Type == GL_FLOAT_VEC3) {
+      glUniform3f(location(), v1, v2, v3);
+    }
+    void set(float v1, float v2, float v3, float v4) const requires (Type == GL_FLOAT_VEC4) {
+      glUniform4f(location(), v1, v2, v3, v4);
+    }
+    void set(const GLfloat* value) const requires (Type == GL_FLOAT_MAT3) {
+      glUniformMatrix3fv(location(), 1, GL_FALSE, value);
+    }
+    void set(const GLfloat* value) const requires (Type == GL_FLOAT_MAT4) {
+      glUniformMatrix4fv(location(), 1, GL_FALSE, value);
+    }
+  private:
+    GLint location() const;
+    const Shader* shader = nullptr;
+    uint32_t index = 0;
+};
 
 class Shader {
   public:
     Shader(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource);
+    // Uniform handles point back at the shader, a copy would leave them behind
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
     void use();
+    GLuint id() const { return shaderProgramId; }
+    template <GLenum Type>
+    Uniform<Type> uniform(const char* name) { return Uniform<Type>(this, findUniform(name, Type)); }
+    GLint uniformLocation(uint32_t index) const { return uniforms[index].location; }
     void setUniform1f(const char* name, float val);
     void setUniform1i(const char* name, int val);
   private:
+    struct UniformInfo {
+      std::string name;
+      uint32_t hash;
+      GLint location;
+      GLenum type;
+    };
+    void reflectUniforms();
+    void insertUniformSlot(uint32_t index);
+    uint32_t findUniform(const char* name, GLenum type);
     GLuint shaderProgramId;
+    std::vector<UniformInfo> uniforms;
+    // open addressing table of indices into `uniforms`, -1 marks an empty slot
+    std::vector<int32_t> uniformSlots;
 };
 
+template <GLenum Type>
+GLint Uniform<Type>::location() const {
+  return shader->uniformLocation(index);
+}
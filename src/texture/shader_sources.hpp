@@ -1,9 +1,21 @@
-const char* vertexShaderSource = R"(
+#include "vertex_layout.hpp"
+
+// 24 bytes, the colour as normalized bytes
+struct Vertex {
+  Float<3> aPos;
+  UNorm8<4> aCol;
+  Float<2> aTexCoord;
+};
+constexpr auto vertexLayout = makeVertexLayout<Vertex>({
+  VERTEX_ATTRIBUTE(Vertex, aPos, "aPos"),
+  VERTEX_ATTRIBUTE(Vertex, aCol, "aCol"),
+  VERTEX_ATTRIBUTE(Vertex, aTexCoord, "aTexCoord"),
+});
+
+// the `in` declarations come from vertexLayout
+constexpr GlslSource vertexShaderSource = withVertexInputs(R"(
 #version 330 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aCol;
-layout (location = 2) in vec2 aTexCoord;
 out vec4 vCol;
 out vec2 vTexCoord;
 
@@ -13,10 +25,10 @@ void main() {
   float x = sin(aPos.x + time);
   float y = sin(aPos.y + time);
   gl_Position = vec4(x, y, aPos.z, 1.0f);
-  vCol = vec4(aCol, 1.0f);
+  vCol = aCol;
   vTexCoord = aTexCoord;  
 }
-)";
+)", vertexLayout);
 
 
 const char* fragmentShaderSource = R"(
@@ -26,10 +38,15 @@ in vec4 vCol;
 in vec2 vTexCoord;
 out vec4 FragColor;
 
-uniform sampler2D texture1Data;
-uniform sampler2D texture2Data;
+// every material image is a layer of one array, so switching materials
+// between draws is a uniform change instead of a texture bind
+uniform sampler2DArray materials;
+uniform ivec2 materialLayers;  // base, overlay
+uniform vec4 materialUvScale;  // base in xy, overlay in zw
 
 void main() {
-  FragColor = mix(texture(texture1Data, vTexCoord), texture(texture2Data, vTexCoord), 0.3f);
+  vec4 base = texture(materials, vec3(vTexCoord * materialUvScale.xy, materialLayers.x));
+  vec4 overlay = texture(materials, vec3(vTexCoord * materialUvScale.zw, materialLayers.y));
+  FragColor = mix(base, overlay, 0.3f);
 }
 )";
@@ -0,0 +1,122 @@
+#include <glad/glad.h>
+#include <iterator>
+#include "texture_cache.hpp"
+#include "gl_state.hpp"
+
+TextureCache::TextureCache(TextureStreamer& streamer, size_t budgetBytes)
+  : streamer(streamer), budgetBytes(budgetBytes) {}
+
+GLuint TextureCache::acquire(const std::string& imgPath) {
+  auto found = entryByPath.find(imgPath);
+  if (found == entryByPath.end()) {
+    entries.push_front(Entry());
+    entries.front().path = imgPath;
+    entries.front().lastUsedFrame = frame;
+    entryByPath[imgPath] = entries.begin();
+    stats.misses++;
+    return load(entries.begin(), 0);
+  }
+
+  EntryList::iterator entry = found->second;
+  entries.splice(entries.begin(), entries, entry);
+  entry->lastUsedFrame = frame;
+  if (entry->texture == 0) {
+    stats.misses++;
+    return load(entry, 0);
+  }
+  if (!entry->loading) {
+    stats.hits++;
+    if (entry->droppedLevels > 0 && entry->upgrade == 0) {
+      stats.reloads++;
+      entry->upgrade = streamer.request(entry->path);
+      entryByTexture[entry->upgrade] = entry;
+    }
+  }
+  return entry->texture;
+}
+
+GLuint TextureCache::load(EntryList::iterator entry, int droppedLevels) {
+  entry->texture = streamer.request(entry->path, droppedLevels);
+  entry->loading = true;
+  entry->bytes = 0;
+  entry->droppedLevels = droppedLevels;
+  entryByTexture[entry->texture] = entry;
+  return entry->texture;
+}
+
+// Call once per frame, after TextureStreamer::update() and before the
+// frame's acquire() calls: whatever was acquired last frame is kept.
+void TextureCache::update() {
+  landUploads();
+  trim();
+  frame++;
+}
+
+// The streamer reports every finished upload with its size; pick up the
+// ones that belong to this cache.
+void TextureCache::landUploads() {
+  for (const TextureStreamer::Completion& upload : streamer.takeCompletions()) {
+    auto found = entryByTexture.find(upload.texture);
+    if (found == entryByTexture.end()) {
+      continue;
+    }
+    Entry& entry = *found->second;
+    entryByTexture.erase(found);
+    if (upload.failed) {
+      // the name only holds the placeholder, drop it so acquire() retries
+      stats.failures++;
+      GLuint texture = upload.texture;
+      glState.deleteTextures(1, &texture);
+      if (texture == entry.upgrade) {
+        entry.upgrade = 0;
+      } else {
+        entry.texture = 0;
+        entry.loading = false;
+      }
+      continue;
+    }
+    if (upload.texture == entry.upgrade) {
+      glState.deleteTextures(1, &entry.texture);
+      totalBytes -= entry.bytes;
+      entry.texture = entry.upgrade;
+      entry.upgrade = 0;
+      entry.droppedLevels = 0;
+    }
+    entry.loading = false;
+    entry.bytes = upload.bytes;
+    totalBytes += upload.bytes;
+  }
+}
+
+// Walks from the least recently used end. Textures with an upload in
+// flight are skipped: their names must stay valid until the streamer is
+// done with them.
+void TextureCache::trim() {
+  for (auto it = entries.rbegin(); totalBytes > budgetBytes && it != entries.rend(); ++it) {
+    Entry& entry = *it;
+    if (entry.lastUsedFrame == frame || entry.texture == 0 || entry.loading || entry.upgrade != 0) {
+      continue;
+    }
+    glState.deleteTextures(1, &entry.texture);
+    totalBytes -= entry.bytes;
+    if (entry.droppedLevels < MAX_DROPPED_LEVELS) {
+      stats.mipDrops++;
+      load(std::prev(it.base()), entry.droppedLevels + 1);
+    } else {
+      stats.evictions++;
+      entry.texture = 0;
+      entry.bytes = 0;
+    }
+  }
+}
+
+void TextureCache::clear() {
+  for (Entry& entry : entries) {
+    glState.deleteTextures(1, &entry.texture);
+    glState.deleteTextures(1, &entry.upgrade);
+  }
+  entries.clear();
+  entryByPath.clear();
+  entryByTexture.clear();
+  totalBytes = 0;
+}
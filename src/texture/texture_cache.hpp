@@ -0,0 +1,72 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "texture_streamer.hpp"
+
+// Keeps the textures loaded through a TextureStreamer under a memory
+// budget. acquire() is called every frame for every texture a draw needs
+// and returns the name to bind; the name can change between frames, so it
+// must not be cached by the caller. update() runs after the streamer's and
+// trims the least recently used textures until the budget holds: first by
+// reloading them MAX_DROPPED_LEVELS mips down, then by deleting them.
+// Acquiring a reduced or evicted texture reloads it at full resolution,
+// the reduced copy keeps being returned until the reload lands. A load
+// that fails is evicted (a failed reload just dropped), so the next
+// acquire() tries again.
+class TextureCache {
+  public:
+    struct Counters {
+      uint64_t hits = 0;       // resident at full resolution
+      uint64_t misses = 0;     // never loaded or evicted, a placeholder is returned
+      uint64_t reloads = 0;    // resident with dropped mips, full resolution requested
+      uint64_t mipDrops = 0;
+      uint64_t evictions = 0;
+      uint64_t failures = 0;   // loads the streamer couldn't complete
+    };
+    static const int MAX_DROPPED_LEVELS = 2;
+
+    TextureCache(TextureStreamer& streamer, size_t budgetBytes);
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    GLuint acquire(const std::string& imgPath);
+    void update();
+    // Deletes every texture. Only call it once the streamer is idle (or
+    // it is never updated again) and while the context is still alive.
+    void clear();
+
+    size_t residentBytes() const { return totalBytes; }
+    size_t budget() const { return budgetBytes; }
+    const Counters& counters() const { return stats; }
+
+  private:
+    struct Entry {
+      std::string path;
+      GLuint texture = 0;     // 0 once evicted
+      bool loading = true;    // `texture` still shows the streamer placeholder
+      GLuint upgrade = 0;     // full resolution reload in flight
+      size_t bytes = 0;
+      int droppedLevels = 0;
+      uint64_t lastUsedFrame = 0;
+    };
+    using EntryList = std::list<Entry>;
+
+    void landUploads();
+    void trim();
+    GLuint load(EntryList::iterator entry, int droppedLevels);
+
+    TextureStreamer& streamer;
+    size_t budgetBytes;
+    size_t totalBytes = 0;
+    uint64_t frame = 0;
+    Counters stats;
+    // most recently used first
+    EntryList entries;
+    std::unordered_map<std::string, EntryList::iterator> entryByPath;
+    // texture names with an upload in flight -> their entry
+    std::unordered_map<GLuint, EntryList::iterator> entryByTexture;
+};
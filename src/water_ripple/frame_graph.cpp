@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "frame_graph.hpp"
+#include "gl_extensions.hpp"
+#include "gl_state.hpp"
+
+namespace {
+struct RenderTargetFormat {
+  GLenum internalFormat;
+  size_t bytesPerPixel;
+  // for glTexImage2D without GL_ARB_texture_storage
+  GLenum format;
+  GLenum type;
+};
+
+const RenderTargetFormat RENDER_TARGET_FORMATS[] = {
+  {GL_RGBA8, 4, GL_RGBA, GL_UNSIGNED_BYTE},
+  {GL_RGBA16F, 8, GL_RGBA, GL_HALF_FLOAT},
+  {GL_RGBA32F, 16, GL_RGBA, GL_FLOAT},
+  {GL_R11F_G11F_B10F, 4, GL_RGB, GL_FLOAT},
+  {GL_RG16F, 4, GL_RG, GL_HALF_FLOAT},
+  {GL_R8, 1, GL_RED, GL_UNSIGNED_BYTE},
+  {GL_DEPTH_COMPONENT24, 4, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT},
+  {GL_DEPTH24_STENCIL8, 4, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8},
+};
+
+const RenderTargetFormat& renderTargetFormat(GLenum internalFormat) {
+  for (const RenderTargetFormat& format : RENDER_TARGET_FORMATS) {
+    if (format.internalFormat == internalFormat) {
+      return format;
+    }
+  }
+  std::cout << "ERROR! unsupported render target format: 0x" << std::hex << internalFormat << std::dec << std::endl;
+  exit(1);
+}
+
+GLenum attachmentPoint(GLenum internalFormat, int colorIndex) {
+  switch (internalFormat) {
+    case GL_DEPTH_COMPONENT24: return GL_DEPTH_ATTACHMENT;
+    case GL_DEPTH24_STENCIL8: return GL_DEPTH_STENCIL_ATTACHMENT;
+    default: return GL_COLOR_ATTACHMENT0 + colorIndex;
+  }
+}
+
+size_t targetBytes(const RenderTargetDesc& desc) {
+  return (size_t)desc.width * desc.height * renderTargetBytesPerPixel(desc.internalFormat);
+}
+}
+
+size_t renderTargetBytesPerPixel(GLenum internalFormat) {
+  return renderTargetFormat(internalFormat).bytesPerPixel;
+}
+
+FrameGraph::Target FrameGraph::PassBuilder::create(const std::string& name, const RenderTargetDesc& desc) {
+  renderTargetFormat(desc.internalFormat);
+  graph.resources.push_back({name, desc, pass});
+  Target target = {(int)graph.resources.size() - 1};
+  write(target);
+  return target;
+}
+
+void FrameGraph::PassBuilder::read(Target target) {
+  graph.passes[pass].reads.push_back(target.index);
+}
+
+void FrameGraph::PassBuilder::write(Target target) {
+  graph.passes[pass].writes.push_back(target.index);
+}
+
+void FrameGraph::PassBuilder::writeBackbuffer() {
+  graph.passes[pass].backbuffer = true;
+}
+
+void FrameGraph::PassBuilder::sideEffect() {
+  graph.passes[pass].sideEffect = true;
+}
+
+FrameGraph::~FrameGraph() {
+  for (auto& [attachments, framebuffer] : framebuffers) {
+    glState.deleteFramebuffers(1, &framebuffer);
+  }
+  for (PooledTexture& texture : textures) {
+    glState.deleteTextures(1, &texture.id);
+  }
+}
+
+void FrameGraph::addPass(const std::string& name, const Setup& setup, const Execute& execute) {
+  Pass newPass;
+  newPass.name = name;
+  newPass.execute = execute;
+  passes.push_back(newPass);
+  PassBuilder builder(*this, (int)passes.size() - 1);
+  setup(builder);
+  Pass& pass = passes.back();
+  if (pass.backbuffer && !pass.writes.empty()) {
+    std::cout << "ERROR! frame graph pass " << name << " writes both the backbuffer and render targets" << std::endl;
+    exit(1);
+  }
+}
+
+void FrameGraph::compile() {
+  // back to front: a pass runs if it has effects of its own or writes a
+  // target some later running pass reads, and then what it reads is
+  // needed from the passes before it
+  std::vector<bool> needed(resources.size(), false);
+  for (int p = (int)passes.size() - 1; p >= 0; p--) {
+    Pass& pass = passes[p];
+    bool writesNeeded = std::any_of(pass.writes.begin(), pass.writes.end(), [&](int r) { return needed[r]; });
+    pass.culled = !pass.backbuffer && !pass.sideEffect && !writesNeeded;
+    if (pass.culled) {
+      continue;
+    }
+    // a target this pass overwrites without reading needs nothing older
+    for (int r : pass.writes) {
+      needed[r] = false;
+    }
+    for (int r : pass.reads) {
+      needed[r] = true;
+    }
+  }
+
+  order.clear();
+  for (int p = 0; p < (int)passes.size(); p++) {
+    if (passes[p].culled) {
+      continue;
+    }
+    int position = (int)order.size();
+    order.push_back(p);
+    for (const std::vector<int>* list : {&passes[p].reads, &passes[p].writes}) {
+      for (int r : *list) {
+        Resource& resource = resources[r];
+        if (resource.firstPass < 0) {
+          resource.firstPass = position;
+        }
+        resource.lastPass = position;
+      }
+    }
+  }
+
+  // walk the passes in order, taking a texture at a target's first use and
+  // giving it back after its last, so the next target of the same shape
+  // reuses it
+  for (PooledTexture& texture : textures) {
+    texture.inUse = false;
+  }
+  frameStats = {};
+  frameStats.passes = (int)order.size();
+  frameStats.culledPasses = (int)(passes.size() - order.size());
+  for (int position = 0; position < (int)order.size(); position++) {
+    for (Resource& resource : resources) {
+      if (resource.firstPass == position) {
+        resource.texture = acquireTexture(resource.desc);
+        frameStats.targets++;
+        frameStats.targetBytes += targetBytes(resource.desc);
+      }
+    }
+    for (Resource& resource : resources) {
+      if (resource.lastPass == position) {
+        textures[resource.texture].inUse = false;
+      }
+    }
+  }
+  for (PooledTexture& texture : textures) {
+    if (texture.usedThisFrame) {
+      frameStats.textures++;
+      frameStats.textureBytes += targetBytes(texture.desc);
+    }
+  }
+  compiled = true;
+}
+
+int FrameGraph::acquireTexture(const RenderTargetDesc& desc) {
+  for (int i = 0; i < (int)textures.size(); i++) {
+    if (!textures[i].inUse && textures[i].desc == desc) {
+      textures[i].inUse = true;
+      textures[i].usedThisFrame = true;
+      return i;
+    }
+  }
+  const RenderTargetFormat& format = renderTargetFormat(desc.internalFormat);
+  GLuint id;
+  glGenTextures(1, &id);
+  GLint boundTexture;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+  glState.bindTexture(GL_TEXTURE_2D, id);
+  if (glExt.textureStorage) {
+    glTexStorage2D(GL_TEXTURE_2D, 1, desc.internalFormat, desc.width, desc.height);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format.format, format.type, nullptr);
+  }
+  // sampled by later passes, usually at another resolution
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glState.bindTexture(GL_TEXTURE_2D, boundTexture);
+  textures.push_back({id, desc, true, true});
+  return (int)textures.size() - 1;
+}
+
+GLuint FrameGraph::framebufferFor(const Pass& pass) {
+  std::vector<GLuint> attachments;
+  for (int r : pass.writes) {
+    attachments.push_back(textures[resources[r].texture].id);
+  }
+  auto found = framebuffers.find(attachments);
+  if (found != framebuffers.end()) {
+    return found->second;
+  }
+  GLuint framebuffer;
+  glGenFramebuffers(1, &framebuffer);
+  glState.bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  std::vector<GLenum> drawBuffers;
+  for (int r : pass.writes) {
+    const Resource& resource = resources[r];
+    GLenum attachment = attachmentPoint(resource.desc.internalFormat, (int)drawBuffers.size());
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, textures[resource.texture].id, 0);
+    if (attachment >= GL_COLOR_ATTACHMENT0 && attachment <= GL_COLOR_ATTACHMENT15) {
+      drawBuffers.push_back(attachment);
+    }
+  }
+  if (drawBuffers.empty()) {
+    glDrawBuffer(GL_NONE);
+  } else {
+    glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+  }
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "ERROR! incomplete framebuffer for frame graph pass " << pass.name << std::endl;
+    exit(1);
+  }
+  framebuffers[attachments] = framebuffer;
+  return framebuffer;
+}
+
+void FrameGraph::execute(int width, int height) {
+  if (!compiled) {
+    compile();
+  }
+  for (int p : order) {
+    const Pass& pass = passes[p];
+    if (!pass.writes.empty()) {
+      glState.bindFramebuffer(GL_FRAMEBUFFER, framebufferFor(pass));
+      const RenderTargetDesc& target = resources[pass.writes[0]].desc;
+      glViewport(0, 0, target.width, target.height);
+    } else if (pass.backbuffer) {
+      glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+      glViewport(0, 0, width, height);
+    }
+    pass.execute(*this);
+  }
+  glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(0, 0, width, height);
+}
+
+void FrameGraph::reset() {
+  releaseUnusedTextures();
+  for (PooledTexture& texture : textures) {
+    texture.inUse = false;
+    texture.usedThisFrame = false;
+  }
+  passes.clear();
+  resources.clear();
+  order.clear();
+  compiled = false;
+}
+
+// Textures a whole frame went without, e.g. after a resize or once a
+// pass got culled, and the framebuffers they are attached to.
+void FrameGraph::releaseUnusedTextures() {
+  std::vector<GLuint> released;
+  std::vector<PooledTexture> kept;
+  for (PooledTexture& texture : textures) {
+    if (texture.usedThisFrame) {
+      kept.push_back(texture);
+    } else {
+      released.push_back(texture.id);
+    }
+  }
+  if (released.empty()) {
+    return;
+  }
+  for (auto it = framebuffers.begin(); it != framebuffers.end();) {
+    bool stale = std::any_of(it->first.begin(), it->first.end(), [&](GLuint id) {
+      return std::find(released.begin(), released.end(), id) != released.end();
+    });
+    if (stale) {
+      glState.deleteFramebuffers(1, &it->second);
+      it = framebuffers.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  glState.deleteTextures((GLsizei)released.size(), released.data());
+  textures.swap(kept);
+}
+
+GLuint FrameGraph::texture(Target target) const {
+  return textures[resources[target.index].texture].id;
+}
+
+const RenderTargetDesc& FrameGraph::desc(Target target) const {
+  return resources[target.index].desc;
+}
+
+std::string FrameGraph::describe() const {
+  std::ostringstream out;
+  auto list = [&](const std::vector<int>& targets) {
+    for (size_t i = 0; i < targets.size(); i++) {
+      const Resource& resource = resources[targets[i]];
+      out << (i ? ", " : " ") << resource.name << " (texture " << resource.texture << ")";
+    }
+  };
+  for (const Pass& pass : passes) {
+    out << "  " << pass.name;
+    if (pass.culled) {
+      out << ": culled\n";
+      continue;
+    }
+    if (!pass.reads.empty()) {
+      out << ", reads";
+      list(pass.reads);
+    }
+    if (!pass.writes.empty()) {
+      out << ", writes";
+      list(pass.writes);
+    }
+    if (pass.backbuffer) {
+      out << ", writes the backbuffer";
+    }
+    out << "\n";
+  }
+  return out.str();
+}
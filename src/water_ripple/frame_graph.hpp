@@ -0,0 +1,143 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Transient render targets and the passes that use them, rebuilt every
+// frame. Passes are added in the order they should run and say in their
+// setup callback which targets they create, read and write; compile()
+// then drops every pass whose output nothing needs and hands out the
+// GL textures: a target only holds one from the pass that first uses it
+// to the pass that last does, and targets whose lifetimes don't overlap
+// share one texture when their descriptions match. The textures stay
+// pooled across frames, so a steady graph allocates nothing after the
+// first frame, and a resize replaces what no longer fits.
+//
+//   FrameGraph::Target scene;
+//   graph.addPass("scene", [&](FrameGraph::PassBuilder& pass) {
+//     scene = pass.create("scene", {width, height, GL_RGBA16F});
+//   }, [&](const FrameGraph& graph) { ... draw ... });
+//   graph.addPass("present", [&](FrameGraph::PassBuilder& pass) {
+//     pass.read(scene);
+//     pass.writeBackbuffer();
+//   }, [&](const FrameGraph& graph) { ... sample graph.texture(scene) ... });
+//   graph.compile();
+//   graph.execute(width, height);
+//   graph.reset();
+//
+// A target's contents are undefined when its first pass starts, since the
+// texture may just have held another target: that pass clears or covers
+// every pixel itself.
+struct RenderTargetDesc {
+  int width;
+  int height;
+  GLenum internalFormat;  // one of those renderTargetBytesPerPixel() knows
+
+  bool operator==(const RenderTargetDesc& other) const {
+    return width == other.width && height == other.height && internalFormat == other.internalFormat;
+  }
+};
+
+size_t renderTargetBytesPerPixel(GLenum internalFormat);
+
+class FrameGraph {
+  public:
+    struct Target {
+      int index = -1;
+      bool valid() const { return index >= 0; }
+    };
+
+    class PassBuilder {
+      public:
+        // a new transient target, which this pass writes
+        Target create(const std::string& name, const RenderTargetDesc& desc);
+        void read(Target target);
+        // keeps drawing into a target an earlier pass created, e.g. after
+        // reading it for blending
+        void write(Target target);
+        // the window; a pass writing it is never culled
+        void writeBackbuffer();
+        // never culled either, for passes with effects outside the graph
+        // such as readbacks
+        void sideEffect();
+      private:
+        friend class FrameGraph;
+        PassBuilder(FrameGraph& graph, int pass) : graph(graph), pass(pass) {}
+        FrameGraph& graph;
+        int pass;
+    };
+
+    using Setup = std::function<void(PassBuilder&)>;
+    // runs with the pass's targets bound as the framebuffer and the
+    // viewport covering them; passes that write nothing get neither
+    using Execute = std::function<void(const FrameGraph&)>;
+
+    struct Stats {
+      int passes = 0;
+      int culledPasses = 0;
+      int targets = 0;         // transients of the passes that run
+      int textures = 0;        // GL textures holding them
+      size_t targetBytes = 0;  // what one texture per target would take
+      size_t textureBytes = 0;
+    };
+
+    FrameGraph() = default;
+    ~FrameGraph();
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    void addPass(const std::string& name, const Setup& setup, const Execute& execute);
+    void compile();
+    // `width` x `height` is the backbuffer's viewport
+    void execute(int width, int height);
+    // forgets the passes and targets, keeps the textures for the next frame
+    void reset();
+
+    // inside Execute: the texture currently holding `target`
+    GLuint texture(Target target) const;
+    const RenderTargetDesc& desc(Target target) const;
+    const Stats& stats() const { return frameStats; }
+    // one line per pass that runs, with the textures it uses, for debugging
+    std::string describe() const;
+
+  private:
+    struct Resource {
+      std::string name;
+      RenderTargetDesc desc;
+      int creator;
+      int firstPass = -1;  // in `order`, -1 while no running pass uses it
+      int lastPass = -1;
+      int texture = -1;    // into `textures`
+    };
+    struct Pass {
+      std::string name;
+      Execute execute;
+      std::vector<int> reads;
+      std::vector<int> writes;
+      bool backbuffer = false;
+      bool sideEffect = false;
+      bool culled = false;
+    };
+    struct PooledTexture {
+      GLuint id;
+      RenderTargetDesc desc;
+      bool inUse = false;
+      bool usedThisFrame = false;
+    };
+
+    int acquireTexture(const RenderTargetDesc& desc);
+    GLuint framebufferFor(const Pass& pass);
+    void releaseUnusedTextures();
+
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    std::vector<int> order;  // passes that survived culling
+    std::vector<PooledTexture> textures;
+    // by attached textures; a texture's framebuffers go with it
+    std::map<std::vector<GLuint>, GLuint> framebuffers;
+    bool compiled = false;
+    Stats frameStats;
+};
@@ -1,23 +1,41 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
-#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <random>
+#include <vector>
+#include <stb_image.h>
 #include "shader.hpp"
+#include "texture_streamer.hpp"
+#include "virtual_texture.hpp"
+#include "gl_extensions.hpp"
+#include "program_cache.hpp"
 #include "shader_sources.hpp"
+#include "frame_graph.hpp"
+#include "gl_state.hpp"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
 float randomFloat();
+void bakeVirtualTexture(const char* imgPath, const char* outPath);
+void setVirtualTextureUniforms(Shader& shader, const VirtualTexture& virtualTexture, bool feedback);
+void bindTarget(GLenum unit, GLuint texture);
+void runDemo(GLFWwindow* window, const char* virtualTexturePath, bool bloom,
+  std::chrono::steady_clock::time_point startTime);
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
 
-GLuint loadTexture(const char* imgPath);
-
-
-int main() {
+// water_ripple                          ripple over assets/swimming_pool.jpg
+// water_ripple --bake-virtual <image> <out.gvt>
+// water_ripple --virtual <file.gvt>     ripple over a virtual texture
+//   --no-bloom                          composite the ripple without the glow
+int main(int argc, char** argv) {
+  auto startTime = std::chrono::steady_clock::now();
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -40,15 +58,52 @@ int main() {
       std::cout << "Failed to initialize GLAD" << std::endl;
       return -1;
   }
+  loadGLExtensions();
+
+  if (argc > 3 && strcmp(argv[1], "--bake-virtual") == 0) {
+    bakeVirtualTexture(argv[2], argv[3]);
+    glfwTerminate();
+    return 0;
+  }
+  const char* virtualTexturePath = argc > 2 && strcmp(argv[1], "--virtual") == 0 ? argv[2] : nullptr;
+  bool bloom = true;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--no-bloom") == 0) {
+      bloom = false;
+    }
+  }
 
-  Shader shader(vertexShaderSource, fragmentShaderSource);
-  glfwSetWindowUserPointer(window, &shader);
-  GLuint textureId = loadTexture("assets/swimming_pool.jpg");
+  runDemo(window, virtualTexturePath, bloom, startTime);
+  glfwTerminate();
+  return 0;
+}
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, textureId);
+// Everything owning GL objects, the frame graph's pooled targets
+// included, is a local in here or deleted before it returns, so it is all
+// freed while the context is still alive.
+void runDemo(GLFWwindow* window, const char* virtualTexturePath, bool bloom,
+  std::chrono::steady_clock::time_point startTime) {
+  Shader shader(vertexShaderSource.c_str(), (virtualTexturePath ? virtualFragmentShaderSource : fragmentShaderSource).c_str());
+  // every ripple program needs the aspect on resize
+  std::vector<Shader*> rippleShaders = {&shader};
+  glfwSetWindowUserPointer(window, &rippleShaders);
+  // textures show a placeholder until their worker decode and upload finish
+  TextureStreamer textureStreamer;
+  VirtualTexture* virtualTexture = nullptr;
+  Shader* feedbackShader = nullptr;
+  if (virtualTexturePath) {
+    // only the visible tiles of the image are ever resident
+    virtualTexture = new VirtualTexture(virtualTexturePath);
+    virtualTexture->bind(GL_TEXTURE0, GL_TEXTURE1);
+    feedbackShader = new Shader(vertexShaderSource.c_str(), feedbackFragmentShaderSource.c_str());
+    rippleShaders.push_back(feedbackShader);
+  } else {
+    GLuint textureId = textureStreamer.request("assets/swimming_pool.jpg");
+    glState.activeTexture(GL_TEXTURE0);
+    glState.bindTexture(GL_TEXTURE_2D, textureId);
+  }
 
-  float vertices[] = {
+  Vertex vertices[] = {
     // positions            // texture coords
     1.0f,  1.0f, 0.0f,      1.0f, 1.0f,   // top right
     1.0f, -1.0f, 0.0f,      1.0f, 0.0f,   // bottom right
@@ -65,58 +120,183 @@ int main() {
   glGenBuffers(1, &VBO);
   glGenBuffers(1, &EBO);
 
-  glBindVertexArray(VAO);
+  glState.bindVertexArray(VAO);
 
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
+  setupVertexAttributes(vertexLayout);
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+  glState.bindBuffer(GL_ARRAY_BUFFER, 0);
+  glState.bindVertexArray(0);
 
+  std::vector<Uniform<GL_FLOAT>> tUniforms;
+  std::vector<Uniform<GL_FLOAT_VEC2>> centreUniforms;
+  for (Shader* rippleShader : rippleShaders) {
+    rippleShader->use();
+    rippleShader->setUniform1f("t", 1.0f);
+    rippleShader->setUniform2f("aspect", 1.0f, (float)SCR_WIDTH / SCR_HEIGHT);
+    tUniforms.push_back(rippleShader->uniform<GL_FLOAT>("t"));
+    centreUniforms.push_back(rippleShader->uniform<GL_FLOAT_VEC2>("centre"));
+  }
   shader.use();
-  shader.setUniform1i("bgImage", 0); // GL_TEXTURE0
-  shader.setUniform1f("t", 1.0f);
-  shader.setUniform2f("aspect", 1.0f, (float)SCR_WIDTH / SCR_HEIGHT);
-  shader.setUniform2f("centre", randomFloat(), randomFloat());
+  if (virtualTexture) {
+    setVirtualTextureUniforms(shader, *virtualTexture, false);
+    feedbackShader->use();
+    setVirtualTextureUniforms(*feedbackShader, *virtualTexture, true);
+  } else {
+    shader.setUniform1i("bgImage", 0); // GL_TEXTURE0
+  }
+  float centreX = randomFloat(), centreY = randomFloat();
+
+  // post-processing samples the graph's targets on units 2 and 3, clear of
+  // the ripple's own textures on 0 and 1
+  Shader brightShader(vertexShaderSource.c_str(), brightFragmentShaderSource);
+  brightShader.use();
+  brightShader.setUniform1i("scene", 2);
+  brightShader.setUniform1f("threshold", 0.9f);
+  Shader blurShader(vertexShaderSource.c_str(), blurFragmentShaderSource);
+  blurShader.use();
+  blurShader.setUniform1i("source", 2);
+  Uniform<GL_FLOAT_VEC2> texelStepUniform = blurShader.uniform<GL_FLOAT_VEC2>("texelStep");
+  Shader compositeShader(vertexShaderSource.c_str(),
+    (bloom ? bloomCompositeFragmentShaderSource : compositeFragmentShaderSource).c_str());
+  compositeShader.use();
+  compositeShader.setUniform1i("scene", 2);
+  compositeShader.setUniform1f("vignette", 0.6f);
+  if (bloom) {
+    compositeShader.setUniform1i("bloom", 3);
+    compositeShader.setUniform1f("bloomStrength", 0.8f);
+  }
+  // the whole frame as passes over transient targets, rebuilt every frame;
+  // without bloom the composite reads no glow and the passes making it
+  // get culled
+  FrameGraph frameGraph;
 
   const int FRAMES_TO_COUNT = 60;
   int counter = 60;
 
+  bool firstFrame = true;
   while (!glfwWindowShouldClose(window)) {
     processInput(window);
+    textureStreamer.update();
+    if (virtualTexture) {
+      virtualTexture->update();
+    }
 
     counter--;
     if (counter == 0) {
       counter = FRAMES_TO_COUNT;
-      shader.use();
-      shader.setUniform2f("centre", randomFloat(), randomFloat());
+      centreX = randomFloat();
+      centreY = randomFloat();
     }
-
-    shader.use();
     float t = (float)(FRAMES_TO_COUNT - counter) / FRAMES_TO_COUNT;
-    shader.setUniform1f("t", t);
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+    for (size_t i = 0; i < rippleShaders.size(); i++) {
+      rippleShaders[i]->use();
+      tUniforms[i].set(t);
+      centreUniforms[i].set(centreX, centreY);
+    }
 
-    glBindVertexArray(0);
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    auto drawQuad = [] { glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0); };
+    if (virtualTexture) {
+      // renders into the virtual texture's own target and reads it back
+      frameGraph.addPass("feedback", [](FrameGraph::PassBuilder& pass) {
+        pass.sideEffect();
+      }, [&](const FrameGraph&) {
+        feedbackShader->use();
+        virtualTexture->beginFeedback(width, height);
+        drawQuad();
+        virtualTexture->endFeedback();
+      });
+    }
+    FrameGraph::Target scene, bright, blurred, glow;
+    frameGraph.addPass("ripple", [&](FrameGraph::PassBuilder& pass) {
+      // half floats keep the ripple highlights above 1 for the bright pass
+      scene = pass.create("scene", {width, height, GL_RGBA16F});
+    }, [&](const FrameGraph&) {
+      shader.use();
+      drawQuad();
+    });
+    RenderTargetDesc halfSize = {std::max(1, width / 2), std::max(1, height / 2), GL_RGBA16F};
+    frameGraph.addPass("bright", [&](FrameGraph::PassBuilder& pass) {
+      pass.read(scene);
+      bright = pass.create("bright", halfSize);
+    }, [&](const FrameGraph& graph) {
+      brightShader.use();
+      bindTarget(GL_TEXTURE2, graph.texture(scene));
+      drawQuad();
+    });
+    frameGraph.addPass("blur horizontal", [&](FrameGraph::PassBuilder& pass) {
+      pass.read(bright);
+      blurred = pass.create("blurred", halfSize);
+    }, [&](const FrameGraph& graph) {
+      blurShader.use();
+      texelStepUniform.set(1.0f / halfSize.width, 0.0f);
+      bindTarget(GL_TEXTURE2, graph.texture(bright));
+      drawQuad();
+    });
+    frameGraph.addPass("blur vertical", [&](FrameGraph::PassBuilder& pass) {
+      pass.read(blurred);
+      glow = pass.create("glow", halfSize);
+    }, [&](const FrameGraph& graph) {
+      blurShader.use();
+      texelStepUniform.set(0.0f, 1.0f / halfSize.height);
+      bindTarget(GL_TEXTURE2, graph.texture(blurred));
+      drawQuad();
+    });
+    frameGraph.addPass("composite", [&](FrameGraph::PassBuilder& pass) {
+      pass.read(scene);
+      if (bloom) {
+        pass.read(glow);
+      }
+      pass.writeBackbuffer();
+    }, [&](const FrameGraph& graph) {
+      compositeShader.use();
+      bindTarget(GL_TEXTURE2, graph.texture(scene));
+      if (bloom) {
+        bindTarget(GL_TEXTURE3, graph.texture(glow));
+      }
+      drawQuad();
+    });
+
+    glState.bindVertexArray(VAO);
+    frameGraph.compile();
+    frameGraph.execute(width, height);
+    glState.bindVertexArray(0);
 
     glfwSwapBuffers(window);
+    glState.endFrame();
+    if (firstFrame) {
+      firstFrame = false;
+      glFinish();
+      reportTimeToFirstFrame("water_ripple",
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+      const FrameGraph::Stats& stats = frameGraph.stats();
+      std::cout << "frame graph: " << stats.passes << " passes (" << stats.culledPasses << " culled), "
+        << stats.targets << " targets in " << stats.textures << " textures, "
+        << stats.textureBytes / 1024 << " KiB instead of " << stats.targetBytes / 1024 << " KiB\n"
+        << frameGraph.describe() << std::flush;
+    }
+    frameGraph.reset();
     glfwPollEvents();
   }
-
-  glDeleteBuffers(1, &VBO);
-  glDeleteVertexArrays(1, &VAO);
-
-  glfwTerminate();
-  return 0;
+  std::cout << "state calls: " << GLStateCache::summary(glState.total(), glState.frames()) << std::endl;
+
+  glState.deleteBuffers(1, &VBO);
+  glState.deleteVertexArrays(1, &VAO);
+
+  if (virtualTexture) {
+    const VirtualTexture::Stats& stats = virtualTexture->stats();
+    std::cout << "virtual texture: " << stats.residentTiles << " tiles resident, " << stats.visibleTiles << " visible, "
+      << stats.tilesUploaded << " uploaded (" << stats.bytesUploaded / (1024 * 1024) << " MiB), "
+      << stats.tilesEvicted << " evicted" << std::endl;
+    delete virtualTexture;
+    delete feedbackShader;
+  }
 }
 
 void processInput(GLFWwindow *window) {
@@ -126,39 +306,57 @@ void processInput(GLFWwindow *window) {
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
   glViewport(0, 0, width, height);
-  Shader* shader = static_cast<Shader*>(glfwGetWindowUserPointer(window));
-  shader->use();
-  shader->setUniform2f("aspect", 1.0f, (float)width / height);
+  std::vector<Shader*>* shaders = static_cast<std::vector<Shader*>*>(glfwGetWindowUserPointer(window));
+  for (Shader* shader : *shaders) {
+    shader->use();
+    shader->setUniform2f("aspect", 1.0f, (float)width / height);
+  }
 }
 
 
+float randomFloat() {
+    static std::random_device rd;
+    static std::mt19937 gen(rd());
+    static std::uniform_real_distribution<float> dist(0.2f, 0.7f);
+    return dist(gen);
+}
 
-GLuint loadTexture(const char* imgPath) {
-  GLuint texture;
-  glGenTextures(1, &texture);
-  glBindTexture(GL_TEXTURE_2D, texture);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+void setVirtualTextureUniforms(Shader& shader, const VirtualTexture& virtualTexture, bool feedback) {
+  shader.setUniform2f("vtImageScale", virtualTexture.imageScaleX(), virtualTexture.imageScaleY());
+  shader.setUniform1f("vtVirtualSize", virtualTexture.virtualSize());
+  shader.setUniform1f("vtMaxLevel", virtualTexture.maxLevel());
+  shader.setUniform1f("vtTileSize", virtualTexture.tileSize());
+  if (feedback) {
+    // derivatives in the small target are FEEDBACK_DOWNSCALE times too big
+    shader.setUniform1f("vtLodBias", -std::log2((float)VirtualTexture::FEEDBACK_DOWNSCALE));
+  } else {
+    shader.setUniform1f("vtLodBias", 0.0f);
+    shader.setUniform1i("pageTable", 0); // GL_TEXTURE0
+    shader.setUniform1i("physicalTiles", 1); // GL_TEXTURE1
+    shader.setUniform2f("vtPhysicalTiles", VirtualTexture::PHYSICAL_TILES, VirtualTexture::PHYSICAL_TILES);
+    shader.setUniform1f("vtBorder", virtualTexture.border());
+  }
+}
+
+void bakeVirtualTexture(const char* imgPath, const char* outPath) {
   stbi_set_flip_vertically_on_load(true);
   int width, height, nrChannels;
-  unsigned char *data = stbi_load(imgPath, &width, &height, &nrChannels, 0);
+  unsigned char* data = stbi_load(imgPath, &width, &height, &nrChannels, 4);
   if (!data) {
     std::cout << "ERROR! couldn't load the texture image: " << imgPath << std::endl;
     exit(1);
   }
-  GLenum imgFmt = nrChannels == 4 ? GL_RGBA : GL_RGB;
-  glTexImage2D(GL_TEXTURE_2D, 0, imgFmt, width, height, 0, imgFmt, GL_UNSIGNED_BYTE, data);
-  glGenerateMipmap(GL_TEXTURE_2D);
-
+  if (!writeVirtualTexture(outPath, data, width, height)) {
+    std::cout << "ERROR! couldn't write the virtual texture: " << outPath << std::endl;
+    exit(1);
+  }
   stbi_image_free(data);
-  return texture;
+  std::cout << "baked " << imgPath << " (" << width << "x" << height << ") into " << outPath << std::endl;
 }
 
-float randomFloat() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_real_distribution<float> dist(0.2f, 0.7f);
-    return dist(gen);
+void bindTarget(GLenum unit, GLuint texture) {
+  glState.activeTexture(unit);
+  glState.bindTexture(GL_TEXTURE_2D, texture);
+  // the rest of the demo binds and uploads on unit 0
+  glState.activeTexture(GL_TEXTURE0);
 }
@@ -1,43 +1,107 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <string>
 #include "shader.hpp"
+#include "gl_extensions.hpp"
+#include "program_cache.hpp"
+#include "gl_state.hpp"
 
 
 GLuint submitShaderProgram(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource);
-GLuint getUniformLocation(GLuint shaderProgramId, const char* uniformName);
+GLint getUniformLocation(GLuint shaderProgramId, const char* uniformName);
+
+uint32_t hashUniformName(const char* name);
 
 Shader::Shader(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource) {
   shaderProgramId = submitShaderProgram(vertexShaderSource, fragmentShaderSource);
+  reflectUniforms();
 }
 void Shader::use() {
-  glUseProgram(shaderProgramId);
+  glState.useProgram(shaderProgramId);
 }
 void Shader::setUniform1f(const char* name, float val) {
-  int uniformLoc = getUniformLocation(shaderProgramId, name);
-  if (uniformLoc == -1) {
-    std::cout << "ERROR! couldn't locate the uniform: " << name << std::endl;
-    exit(1);
-  }
+  int uniformLoc = uniforms[findUniform(name, GL_FLOAT)].location;
   glUniform1f(uniformLoc, val);
 }
 void Shader::setUniform2f(const char* name, float v1, float v2) {
-  int uniformLoc = getUniformLocation(shaderProgramId, name);
-  if (uniformLoc == -1) {
-    std::cout << "ERROR! couldn't locate the uniform: " << name << std::endl;
-    exit(1);
-  }
+  int uniformLoc = uniforms[findUniform(name, GL_FLOAT_VEC2)].location;
   glUniform2f(uniformLoc, v1, v2);
 }
 void Shader::setUniform1i(const char* name, int val) {
-  int uniformLoc = getUniformLocation(shaderProgramId, name);
-  if (uniformLoc == -1) {
-    std::cout << "ERROR! couldn't locate the uniform: " << name << std::endl;
-    exit(1);
-  }
+  int uniformLoc = uniforms[findUniform(name, GL_INT)].location;
   glUniform1i(uniformLoc, val);
 }
 
+void Shader::reflectUniforms() {
+  GLint count = 0, maxNameLen = 0;
+  glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLen);
+  std::vector<char> nameBuf(maxNameLen + 1);
+  uniforms.clear();
+  uniforms.reserve(count);
+  for (GLint i = 0; i < count; i++) {
+    GLsizei nameLen;
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(shaderProgramId, i, nameBuf.size(), &nameLen, &size, &type, nameBuf.data());
+    std::string name(nameBuf.data(), nameLen);
+    // arrays are reported as "name[0]", register them under the bare name
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+      name.resize(name.size() - 3);
+    }
+    GLint location = glGetUniformLocation(shaderProgramId, name.c_str());
+    if (location == -1) {
+      continue; // members of uniform blocks have no location
+    }
+    uniforms.push_back({name, hashUniformName(name.c_str()), location, type});
+  }
+  uint32_t slotCount = 8;
+  while (slotCount < uniforms.size() * 2) {
+    slotCount *= 2;
+  }
+  uniformSlots.assign(slotCount, -1);
+  for (uint32_t i = 0; i < uniforms.size(); i++) {
+    insertUniformSlot(i);
+  }
+}
+
+void Shader::insertUniformSlot(uint32_t index) {
+  uint32_t mask = uniformSlots.size() - 1;
+  uint32_t slot = uniforms[index].hash & mask;
+  while (uniformSlots[slot] != -1) {
+    slot = (slot + 1) & mask;
+  }
+  uniformSlots[slot] = index;
+}
+
+uint32_t Shader::findUniform(const char* name, GLenum type) {
+  uint32_t hash = hashUniformName(name);
+  uint32_t mask = uniformSlots.size() - 1;
+  for (uint32_t slot = hash & mask; uniformSlots[slot] != -1; slot = (slot + 1) & mask) {
+    const UniformInfo& info = uniforms[uniformSlots[slot]];
+    if (info.hash != hash || info.name != name) {
+      continue;
+    }
+    if (info.type != type && !(type == GL_INT && isSamplerType(info.type))) {
+      std::cout << "ERROR! uniform type mismatch: " << name << std::endl;
+      exit(1);
+    }
+    return uniformSlots[slot];
+  }
+  // individual array elements and struct members are not enumerated, so ask the driver once
+  uniforms.push_back({name, hash, getUniformLocation(shaderProgramId, name), type});
+  if (uniforms.size() * 2 > uniformSlots.size()) {
+    uniformSlots.assign(uniformSlots.size() * 2, -1);
+    for (uint32_t i = 0; i < uniforms.size(); i++) {
+      insertUniformSlot(i);
+    }
+  } else {
+    insertUniformSlot(uniforms.size() - 1);
+  }
+  return uniforms.size() - 1;
+}
+
 GLuint submitShader(const GLchar* source, GLenum shaderType) {
   GLuint shaderId = glCreateShader(shaderType);
   glShaderSource(shaderId, 1, &source, nullptr);
@@ -56,9 +120,18 @@ GLuint submitShader(const GLchar* source, GLenum shaderType) {
 }
 
 GLuint submitShaderProgram(const GLchar* vertexShaderSource, const GLchar* fragmentShaderSource) {
+  std::string cacheKey = programCacheKey(vertexShaderSource, fragmentShaderSource);
+  GLuint cachedProgramId = loadCachedProgram(cacheKey);
+  if (cachedProgramId != 0) {
+    return cachedProgramId;
+  }
+
   GLuint vertexShaderId = submitShader(vertexShaderSource, GL_VERTEX_SHADER);
   GLuint fragmentShaderId = submitShader(fragmentShaderSource, GL_FRAGMENT_SHADER);
   GLuint shaderProgramId = glCreateProgram();
+  if (glExt.programBinary) {
+    glProgramParameteri(shaderProgramId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
   glAttachShader(shaderProgramId, vertexShaderId);
   glAttachShader(shaderProgramId, fragmentShaderId);
   glLinkProgram(shaderProgramId);
@@ -72,10 +145,11 @@ GLuint submitShaderProgram(const GLchar* vertexShaderSource, const GLchar* fragm
   }
   glDeleteShader(vertexShaderId);
   glDeleteShader(fragmentShaderId);
+  storeCachedProgram(shaderProgramId, cacheKey);
   return shaderProgramId;
 }
 
-GLuint getUniformLocation(GLuint shaderProgramId, const char* uniformName) {
+GLint getUniformLocation(GLuint shaderProgramId, const char* uniformName) {
   int uniformLoc = glGetUniformLocation(shaderProgramId, uniformName);
   if (uniformLoc == -1) {
     std::cout << "ERROR! couldn't locate the uniform: " << uniformName << std::endl;
@@ -84,4 +158,13 @@ GLuint getUniformLocation(GLuint shaderProgramId, const char* uniformName) {
   return uniformLoc;
 }
 
+// FNV-1a
+uint32_t hashUniformName(const char* name) {
+  uint32_t hash = 2166136261u;
+  for (; *name; name++) {
+    hash = (hash ^ (uint8_t)*name) * 16777619u;
+  }
+  return hash;
+}
+
 
@@ -1,31 +1,41 @@
+#include <string>
+#include "vertex_layout.hpp"
+
 // Based on: https://www.youtube.com/watch?v=ZcRptHYY3zM
 
 
 
-const char* vertexShaderSource = R"(
+struct Vertex {
+  Float<3> aPos;
+  Float<2> aTexCoord;
+};
+constexpr auto vertexLayout = makeVertexLayout<Vertex>({
+  VERTEX_ATTRIBUTE(Vertex, aPos, "aPos"),
+  VERTEX_ATTRIBUTE(Vertex, aTexCoord, "aTexCoord"),
+});
+
+// the `in` declarations come from vertexLayout
+constexpr GlslSource vertexShaderSource = withVertexInputs(R"(
 #version 330 core
 
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoord;
 out vec2 pos;
 
 void main() {
   gl_Position = vec4(aPos, 1.0f);
   pos = aTexCoord;  
 }
-)";
+)", vertexLayout);
 
 
 
 // ---------------------------------------------------------
 
-const char* fragmentShaderSource = R"(
-#version 330 core
-
+// The ripple distortion, shared by the plain and the virtual texture
+// fragment shaders below: rippleUv() bends `pos` and returns the shadow
+// term to add to the sampled colour.
+const char* rippleFragmentCommon = R"(
 in vec2 pos;
-out vec4 color;
 
-uniform sampler2D bgImage;
 uniform vec2 aspect;
 uniform vec2 centre;
 uniform float t; // position in the timescale of animation
@@ -40,14 +50,159 @@ float getOffsetStrength(float t, vec2 dir) {
   return d;
 }
 
-void main() {
-  vec2 dir = pos - centre;
+vec2 rippleUv(vec2 fragPos, out float shadow) {
+  vec2 dir = fragPos - centre;
   float d = getOffsetStrength(t, dir);
   dir = normalize(dir);
   // SDF on inner ring is -ve so subtracts the brigthness
   // SDF on outside ring is +ve so adds the brightness
-  float shadow = d * 6.; 
-  vec4 tex = texture(bgImage, pos + dir * d);
+  shadow = d * 6.;
+  return fragPos + dir * d;
+}
+)";
+
+const std::string fragmentShaderSource = std::string("#version 330 core\n") + rippleFragmentCommon + R"(
+out vec4 color;
+
+uniform sampler2D bgImage;
+
+void main() {
+  float shadow;
+  vec2 uv = rippleUv(pos, shadow);
+  vec4 tex = texture(bgImage, uv);
   color = tex + shadow;
 }
 )";
+
+// ---------------------------------------------------------
+// Virtual texturing: the image lives in tiles of a physical tile cache and
+// a page table (one mip per virtual mip level) says, per page, which
+// cache slot holds it or the closest coarser tile that is resident.
+// Texel (slot x, slot y, resident level, 255) per page table entry.
+
+const char* virtualTextureCommon = R"(
+uniform sampler2D pageTable;
+uniform sampler2D physicalTiles;
+uniform vec2 vtImageScale;     // image size / virtual size
+uniform float vtVirtualSize;   // virtual size in texels, pages * tile size
+uniform float vtMaxLevel;
+uniform float vtLodBias;       // log2 of the render target downscale, negated
+uniform vec2 vtPhysicalTiles;  // slots per row/column of physicalTiles
+uniform float vtTileSize;
+uniform float vtBorder;
+
+vec2 vtVirtualUv(vec2 uv) {
+  return clamp(uv, 0.0, 1.0) * vtImageScale;
+}
+
+int vtLevel(vec2 vuv) {
+  vec2 texel = vuv * vtVirtualSize;
+  float lod = log2(max(length(dFdx(texel)), length(dFdy(texel)))) + vtLodBias;
+  return int(clamp(floor(lod), 0.0, vtMaxLevel));
+}
+
+ivec2 vtPage(vec2 vuv, int level) {
+  int pages = int(vtVirtualSize / vtTileSize) >> level;
+  return clamp(ivec2(vuv * float(pages)), ivec2(0), ivec2(pages - 1));
+}
+)";
+
+const std::string virtualFragmentShaderSource = std::string("#version 330 core\n") + rippleFragmentCommon + virtualTextureCommon + R"(
+out vec4 color;
+
+vec4 vtSample(vec2 uv) {
+  vec2 vuv = vtVirtualUv(uv);
+  int level = vtLevel(vuv);
+  vec4 entry = texelFetch(pageTable, vtPage(vuv, level), level) * 255.0;
+  // position inside the tile that is actually resident, which may be coarser
+  vec2 inTile = fract(vuv * vtVirtualSize / (vtTileSize * exp2(entry.b)));
+  float paddedTile = vtTileSize + 2.0 * vtBorder;
+  vec2 texel = entry.rg * paddedTile + vtBorder + inTile * vtTileSize;
+  return textureLod(physicalTiles, texel / (vtPhysicalTiles * paddedTile), 0.0);
+}
+
+void main() {
+  float shadow;
+  vec2 uv = rippleUv(pos, shadow);
+  color = vtSample(uv) + shadow;
+}
+)";
+
+// Rendered into a small offscreen target: every pixel reports the page
+// and level the full resolution pass needs, alpha 0 marks a cleared pixel.
+const std::string feedbackFragmentShaderSource = std::string("#version 330 core\n") + rippleFragmentCommon + virtualTextureCommon + R"(
+out vec4 feedback;
+
+void main() {
+  float shadow;
+  vec2 vuv = vtVirtualUv(rippleUv(pos, shadow));
+  int level = vtLevel(vuv);
+  ivec2 page = vtPage(vuv, level);
+  feedback = vec4(page.x, page.y, level, 255.0) / 255.0;
+}
+)";
+
+// ---------------------------------------------------------
+// Post-processing, run by the frame graph after the ripple pass renders
+// into an offscreen target: the parts of the scene brighter than
+// `threshold` are blurred at half resolution and added back as a glow.
+
+const char* brightFragmentShaderSource = R"(
+#version 330 core
+in vec2 pos;
+out vec4 color;
+
+uniform sampler2D scene;
+uniform float threshold;
+
+void main() {
+  vec3 c = texture(scene, pos).rgb;
+  float brightness = max(c.r, max(c.g, c.b));
+  color = vec4(c * max(brightness - threshold, 0.0) / max(brightness, 1e-4), 1.0);
+}
+)";
+
+// One direction of a 9-tap gaussian, folded into 5 bilinear fetches.
+const char* blurFragmentShaderSource = R"(
+#version 330 core
+in vec2 pos;
+out vec4 color;
+
+uniform sampler2D source;
+uniform vec2 texelStep;  // one texel along the blur direction
+
+const float offsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float weights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main() {
+  vec3 sum = texture(source, pos).rgb * weights[0];
+  for (int i = 1; i < 3; i++) {
+    sum += texture(source, pos + texelStep * offsets[i]).rgb * weights[i];
+    sum += texture(source, pos - texelStep * offsets[i]).rgb * weights[i];
+  }
+  color = vec4(sum, 1.0);
+}
+)";
+
+const char* compositeFragmentCommon = R"(
+in vec2 pos;
+out vec4 color;
+
+uniform sampler2D scene;
+uniform sampler2D bloom;
+uniform float bloomStrength;
+uniform float vignette;
+
+void main() {
+  vec3 c = texture(scene, pos).rgb;
+#ifdef BLOOM
+  c += texture(bloom, pos).rgb * bloomStrength;
+#endif
+  vec2 d = pos - 0.5;
+  c *= 1.0 - vignette * dot(d, d);
+  color = vec4(c, 1.0);
+}
+)";
+
+const std::string compositeFragmentShaderSource = std::string("#version 330 core\n") + compositeFragmentCommon;
+const std::string bloomCompositeFragmentShaderSource = std::string("#version 330 core\n#define BLOOM\n") + compositeFragmentCommon;
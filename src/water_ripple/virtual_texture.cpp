@@ -0,0 +1,434 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "gl_extensions.hpp"
+#include "texture_container.hpp"
+#include "virtual_texture.hpp"
+#include "gl_state.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const uint32_t NO_TILE = ~0u;
+
+uint32_t tileKeyLevel(uint32_t key) { return key >> 16; }
+uint32_t tileKeyY(uint32_t key) { return (key >> 8) & 0xFF; }
+uint32_t tileKeyX(uint32_t key) { return key & 0xFF; }
+uint32_t makeTileKey(uint32_t level, uint32_t x, uint32_t y) { return level << 16 | y << 8 | x; }
+
+bool writeVirtualTexture(const std::string& path, const unsigned char* pixels, uint32_t width, uint32_t height) {
+  const uint32_t tile = VIRTUAL_TEXTURE_TILE_SIZE, border = VIRTUAL_TEXTURE_BORDER, padded = tile + 2 * border;
+  uint32_t pages = 1, levelCount = 1;
+  while (pages * tile < std::max(width, height)) {
+    pages *= 2;
+    levelCount++;
+  }
+  if (pages > VIRTUAL_TEXTURE_MAX_PAGES) {
+    return false;
+  }
+  VirtualTextureHeader header = {{'G', 'V', 'T', '1'}, VIRTUAL_TEXTURE_VERSION, width, height, tile, border, levelCount, pages};
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    return false;
+  }
+  out.write((const char*)&header, sizeof(header));
+  std::vector<char> padding(VIRTUAL_TEXTURE_DATA_OFFSET - sizeof(header), 0);
+  out.write(padding.data(), padding.size());
+
+  std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+  uint32_t levelWidth = width, levelHeight = height;
+  std::vector<unsigned char> tileTexels((size_t)padded * padded * 4);
+  for (uint32_t l = 0; l < levelCount; l++) {
+    uint32_t columns = (levelWidth + tile - 1) / tile, rows = (levelHeight + tile - 1) / tile;
+    for (uint32_t ty = 0; ty < rows; ty++) {
+      for (uint32_t tx = 0; tx < columns; tx++) {
+        for (uint32_t py = 0; py < padded; py++) {
+          // clamp at the image edge, the border repeats the last texel there
+          int64_t sy = std::clamp<int64_t>((int64_t)ty * tile + py - border, 0, levelHeight - 1);
+          for (uint32_t px = 0; px < padded; px++) {
+            int64_t sx = std::clamp<int64_t>((int64_t)tx * tile + px - border, 0, levelWidth - 1);
+            memcpy(&tileTexels[((size_t)py * padded + px) * 4], &level[((size_t)sy * levelWidth + sx) * 4], 4);
+          }
+        }
+        out.write((const char*)tileTexels.data(), tileTexels.size());
+      }
+    }
+    uint32_t nextWidth, nextHeight;
+    level = downsampleTextureLevel(level.data(), levelWidth, levelHeight, 4, nextWidth, nextHeight);
+    levelWidth = nextWidth;
+    levelHeight = nextHeight;
+  }
+  return out.good();
+}
+
+VirtualTexture::VirtualTexture(const std::string& path, unsigned int workerCount) {
+#ifdef __linux__
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1 || (size_t)st.st_size < VIRTUAL_TEXTURE_DATA_OFFSET) {
+    std::cout << "ERROR! couldn't open the virtual texture: " << path << std::endl;
+    exit(1);
+  }
+  void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    std::cout << "ERROR! couldn't map the virtual texture: " << path << std::endl;
+    exit(1);
+  }
+  // tiles are read in whatever order the camera wants them
+  madvise(mapped, st.st_size, MADV_RANDOM);
+  data = (const unsigned char*)mapped;
+  size = st.st_size;
+#else
+  std::cout << "ERROR! virtual textures need mmap: " << path << std::endl;
+  exit(1);
+#endif
+
+  memcpy(&header, data, sizeof(header));
+  bool valid = memcmp(header.magic, "GVT1", 4) == 0 && header.version == VIRTUAL_TEXTURE_VERSION
+    && header.tileSize > 0 && header.pages > 0 && header.pages <= VIRTUAL_TEXTURE_MAX_PAGES
+    && (header.pages & (header.pages - 1)) == 0 && (1u << (header.levelCount - 1)) == header.pages
+    && header.width <= header.pages * header.tileSize && header.height <= header.pages * header.tileSize;
+  if (valid) {
+    uint64_t tileCount = 0;
+    for (uint32_t level = 0; level < header.levelCount; level++) {
+      levelFirstTile.push_back(tileCount);
+      tileCount += (uint64_t)levelColumns(level) * levelRows(level);
+    }
+    valid = VIRTUAL_TEXTURE_DATA_OFFSET + tileCount * paddedTileBytes() <= size;
+  }
+  if (!valid) {
+    std::cout << "ERROR! malformed virtual texture: " << path << std::endl;
+    exit(1);
+  }
+
+  glGenTextures(1, &pageTable);
+  glState.bindTexture(GL_TEXTURE_2D, pageTable);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levelCount - 1);
+  if (glExt.textureStorage) {
+    glTexStorage2D(GL_TEXTURE_2D, header.levelCount, GL_RGBA8, header.pages, header.pages);
+  } else {
+    for (uint32_t level = 0; level < header.levelCount; level++) {
+      glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, header.pages >> level, header.pages >> level, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+  }
+  for (uint32_t level = 0; level < header.levelCount; level++) {
+    pageTableLevels.emplace_back((size_t)(header.pages >> level) * (header.pages >> level));
+  }
+
+  int physicalSize = PHYSICAL_TILES * (header.tileSize + 2 * header.border);
+  glGenTextures(1, &physicalTiles);
+  glState.bindTexture(GL_TEXTURE_2D, physicalTiles);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  if (glExt.textureStorage) {
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, physicalSize, physicalSize);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, physicalSize, physicalSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+  slotOwners.assign(PHYSICAL_TILES * PHYSICAL_TILES, NO_TILE);
+
+  glGenFramebuffers(1, &feedbackFramebuffer);
+  glGenTextures(1, &feedbackTexture);
+  for (ReadbackBuffer& readbackBuffer : readbackBuffers) {
+    glGenBuffers(1, &readbackBuffer.bufferId);
+  }
+
+  // the root tile backs every page that has nothing finer resident
+  TileKey root = makeTileKey(header.levelCount - 1, 0, 0);
+  const unsigned char* rootData = tileData(root);
+  uploadTile({root, std::vector<unsigned char>(rootData, rootData + paddedTileBytes())});
+  refreshPageTable();
+
+  for (unsigned int i = 0; i < workerCount; i++) {
+    workers.emplace_back(&VirtualTexture::workerLoop, this);
+  }
+}
+
+VirtualTexture::~VirtualTexture() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeWorkers.notify_all();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+#ifdef __linux__
+  munmap((void*)data, size);
+#endif
+}
+
+uint32_t VirtualTexture::levelColumns(uint32_t level) const {
+  return (std::max(1u, header.width >> level) + header.tileSize - 1) / header.tileSize;
+}
+
+uint32_t VirtualTexture::levelRows(uint32_t level) const {
+  return (std::max(1u, header.height >> level) + header.tileSize - 1) / header.tileSize;
+}
+
+bool VirtualTexture::tileExists(TileKey key) const {
+  return tileKeyLevel(key) < header.levelCount && tileKeyX(key) < levelColumns(tileKeyLevel(key))
+    && tileKeyY(key) < levelRows(tileKeyLevel(key));
+}
+
+size_t VirtualTexture::paddedTileBytes() const {
+  size_t padded = header.tileSize + 2 * header.border;
+  return padded * padded * 4;
+}
+
+const unsigned char* VirtualTexture::tileData(TileKey key) const {
+  uint32_t level = tileKeyLevel(key);
+  uint64_t index = levelFirstTile[level] + (uint64_t)tileKeyY(key) * levelColumns(level) + tileKeyX(key);
+  return data + VIRTUAL_TEXTURE_DATA_OFFSET + index * paddedTileBytes();
+}
+
+void VirtualTexture::bind(GLenum pageTableUnit, GLenum physicalUnit) const {
+  glState.activeTexture(pageTableUnit);
+  glState.bindTexture(GL_TEXTURE_2D, pageTable);
+  glState.activeTexture(physicalUnit);
+  glState.bindTexture(GL_TEXTURE_2D, physicalTiles);
+}
+
+void VirtualTexture::beginFeedback(int windowWidth, int windowHeight) {
+  int width = std::max(1, windowWidth / FEEDBACK_DOWNSCALE), height = std::max(1, windowHeight / FEEDBACK_DOWNSCALE);
+  glState.bindFramebuffer(GL_FRAMEBUFFER, feedbackFramebuffer);
+  if (width != feedbackWidth || height != feedbackHeight) {
+    feedbackWidth = width;
+    feedbackHeight = height;
+    GLint activeUnit, boundTexture;
+    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+    glState.activeTexture(GL_TEXTURE0);
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+    glState.bindTexture(GL_TEXTURE_2D, feedbackTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackTexture, 0);
+    glState.bindTexture(GL_TEXTURE_2D, boundTexture);
+    glState.activeTexture(activeUnit);
+  }
+  glGetIntegerv(GL_VIEWPORT, savedViewport);
+  glViewport(0, 0, feedbackWidth, feedbackHeight);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+// Queues the readback; the pixels are only looked at once the fence says
+// the copy is done, a couple of frames later.
+void VirtualTexture::endFeedback() {
+  ReadbackBuffer& readbackBuffer = readbackBuffers[nextReadback];
+  if (readbackBuffer.fence) {
+    // never got read, a newer frame replaces it
+    glDeleteSync(readbackBuffer.fence);
+  }
+  nextReadback = (nextReadback + 1) % READBACK_BUFFER_COUNT;
+  readbackBuffer.width = feedbackWidth;
+  readbackBuffer.height = feedbackHeight;
+  glState.bindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer.bufferId);
+  glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)feedbackWidth * feedbackHeight * 4, nullptr, GL_STREAM_READ);
+  glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+  glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readbackBuffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glState.bindFramebuffer(GL_FRAMEBUFFER, 0);
+  glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+// Walks the ring oldest first and uses the newest finished readback.
+void VirtualTexture::readFeedback() {
+  ReadbackBuffer* newest = nullptr;
+  for (int i = 0; i < READBACK_BUFFER_COUNT; i++) {
+    ReadbackBuffer& readbackBuffer = readbackBuffers[(nextReadback + i) % READBACK_BUFFER_COUNT];
+    if (!readbackBuffer.fence) {
+      continue;
+    }
+    if (glClientWaitSync(readbackBuffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      break;
+    }
+    glDeleteSync(readbackBuffer.fence);
+    readbackBuffer.fence = nullptr;
+    newest = &readbackBuffer;
+  }
+  if (!newest) {
+    return;
+  }
+  GLsizeiptr bytes = (GLsizeiptr)newest->width * newest->height * 4;
+  glState.bindBuffer(GL_PIXEL_PACK_BUFFER, newest->bufferId);
+  const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+  if (pixels) {
+    processFeedback(pixels, newest->width * newest->height);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glState.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void VirtualTexture::processFeedback(const unsigned char* pixels, int pixelCount) {
+  std::unordered_set<TileKey> visible;
+  for (int i = 0; i < pixelCount; i++) {
+    const unsigned char* pixel = pixels + i * 4;
+    if (pixel[3] == 0) {
+      continue;
+    }
+    // the parents come along so zooming out never falls back to the root
+    for (uint32_t level = pixel[2], x = pixel[0], y = pixel[1]; level < header.levelCount; level++, x /= 2, y /= 2) {
+      if (!visible.insert(makeTileKey(level, x, y)).second) {
+        break;
+      }
+    }
+  }
+  lastFeedbackFrame = frame;
+  counters.visibleTiles = visible.size();
+
+  std::vector<TileKey> missing;
+  for (TileKey key : visible) {
+    auto resident = residentTiles.find(key);
+    if (resident != residentTiles.end()) {
+      resident->second.lastSeenFrame = frame;
+    } else if (tileExists(key) && tilesInFlight.count(key) == 0) {
+      missing.push_back(key);
+    }
+  }
+  // coarse tiles first, they cover the most screen
+  std::sort(missing.begin(), missing.end(), [](TileKey a, TileKey b) { return a > b; });
+  for (TileKey key : missing) {
+    requestTile(key);
+  }
+}
+
+void VirtualTexture::requestTile(TileKey key) {
+  tilesInFlight.insert(key);
+  counters.tilesRequested++;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pendingTiles.push_back(key);
+  }
+  wakeWorkers.notify_one();
+}
+
+void VirtualTexture::workerLoop() {
+  while (true) {
+    TileKey key;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeWorkers.wait(lock, [this] { return stopping || !pendingTiles.empty(); });
+      if (stopping) {
+        return;
+      }
+      key = pendingTiles.front();
+      pendingTiles.pop_front();
+    }
+    // the copy is where the mapped pages fault in, off the GL thread
+    const unsigned char* texels = tileData(key);
+    LoadedTile tile = {key, std::vector<unsigned char>(texels, texels + paddedTileBytes())};
+    std::lock_guard<std::mutex> lock(mutex);
+    loadedTiles.push_back(std::move(tile));
+  }
+}
+
+// Returns false when every slot holds a tile the last feedback still saw.
+bool VirtualTexture::uploadTile(const LoadedTile& tile) {
+  int slot = -1;
+  uint64_t oldestFrame = UINT64_MAX;
+  for (int i = 0; i < (int)slotOwners.size(); i++) {
+    if (slotOwners[i] == NO_TILE) {
+      slot = i;
+      break;
+    }
+    const Tile& owner = residentTiles[slotOwners[i]];
+    bool pinned = tileKeyLevel(slotOwners[i]) == header.levelCount - 1;
+    if (!pinned && owner.lastSeenFrame != lastFeedbackFrame && owner.lastSeenFrame < oldestFrame) {
+      slot = i;
+      oldestFrame = owner.lastSeenFrame;
+    }
+  }
+  if (slot == -1) {
+    return false;
+  }
+  if (slotOwners[slot] != NO_TILE) {
+    residentTiles.erase(slotOwners[slot]);
+    counters.tilesEvicted++;
+  }
+
+  int padded = header.tileSize + 2 * header.border;
+  glState.bindTexture(GL_TEXTURE_2D, physicalTiles);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % PHYSICAL_TILES) * padded, (slot / PHYSICAL_TILES) * padded,
+    padded, padded, GL_RGBA, GL_UNSIGNED_BYTE, tile.texels.data());
+  slotOwners[slot] = tile.key;
+  residentTiles[tile.key] = {slot, frame};
+  pageTableDirty = true;
+  counters.tilesUploaded++;
+  counters.bytesUploaded += tile.texels.size();
+  return true;
+}
+
+// Every entry points at its own tile when resident, else at whatever its
+// parent entry points at. Rebuilt coarse to fine whenever the cache
+// changed; even 256x256 pages are under 90k entries.
+void VirtualTexture::refreshPageTable() {
+  for (int level = header.levelCount - 1; level >= 0; level--) {
+    uint32_t pages = header.pages >> level;
+    std::vector<uint32_t>& entries = pageTableLevels[level];
+    for (uint32_t y = 0; y < pages; y++) {
+      for (uint32_t x = 0; x < pages; x++) {
+        auto resident = residentTiles.find(makeTileKey(level, x, y));
+        if (resident != residentTiles.end()) {
+          uint32_t slot = resident->second.slot;
+          entries[y * pages + x] = (slot % PHYSICAL_TILES) | (slot / PHYSICAL_TILES) << 8 | (uint32_t)level << 16 | 0xFFu << 24;
+        } else {
+          entries[y * pages + x] = pageTableLevels[level + 1][(y / 2) * (pages / 2) + x / 2];
+        }
+      }
+    }
+  }
+  glState.bindTexture(GL_TEXTURE_2D, pageTable);
+  for (uint32_t level = 0; level < header.levelCount; level++) {
+    uint32_t pages = header.pages >> level;
+    glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, pages, pages, GL_RGBA, GL_UNSIGNED_BYTE, pageTableLevels[level].data());
+  }
+  pageTableDirty = false;
+}
+
+void VirtualTexture::update() {
+  readFeedback();
+
+  std::deque<LoadedTile> ready;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.swap(loadedTiles);
+  }
+  GLint activeUnit, boundTexture;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &activeUnit);
+  glState.activeTexture(GL_TEXTURE0);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &boundTexture);
+
+  for (int uploads = 0; !ready.empty() && uploads < MAX_UPLOADS_PER_FRAME; uploads++) {
+    // a tile that finds no free slot is dropped, the next feedback asks again
+    uploadTile(ready.front());
+    tilesInFlight.erase(ready.front().key);
+    ready.pop_front();
+  }
+  if (pageTableDirty) {
+    refreshPageTable();
+  }
+
+  glState.bindTexture(GL_TEXTURE_2D, boundTexture);
+  glState.activeTexture(activeUnit);
+  {
+    // over the upload budget, these go first next frame
+    std::lock_guard<std::mutex> lock(mutex);
+    loadedTiles.insert(loadedTiles.begin(), std::make_move_iterator(ready.begin()), std::make_move_iterator(ready.end()));
+  }
+  counters.residentTiles = residentTiles.size();
+  frame++;
+}
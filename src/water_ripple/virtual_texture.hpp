@@ -0,0 +1,148 @@
+#pragma once
+#include <glad/glad.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Tiled image file (.gvt) for virtual texturing. The virtual space is a
+// square of `pages` x `pages` tiles (a power of two) at level 0, halving
+// per level down to a single tile. Only tiles that overlap the image are
+// stored: level by level, row by row, bottom-up like every other texture
+// here. Each tile is RGBA8 with `border` texels copied from its neighbours
+// on every side, so bilinear taps never leave the tile.
+const uint32_t VIRTUAL_TEXTURE_VERSION = 1;
+const uint32_t VIRTUAL_TEXTURE_TILE_SIZE = 128;
+const uint32_t VIRTUAL_TEXTURE_BORDER = 4;
+const uint32_t VIRTUAL_TEXTURE_DATA_OFFSET = 4096;
+// page coordinates and levels go through 8-bit texels, 256 pages of 128
+// texels cap the image at 32768 on its longer side
+const uint32_t VIRTUAL_TEXTURE_MAX_PAGES = 256;
+
+struct VirtualTextureHeader {
+  char magic[4];        // "GVT1"
+  uint32_t version;
+  uint32_t width;       // of the source image
+  uint32_t height;
+  uint32_t tileSize;    // without the border
+  uint32_t border;
+  uint32_t levelCount;
+  uint32_t pages;       // per side at level 0
+};
+static_assert(sizeof(VirtualTextureHeader) == 32, "on-disk header layout");
+
+// Writes a .gvt for tightly packed, bottom-up RGBA8 pixels.
+bool writeVirtualTexture(const std::string& path, const unsigned char* pixels, uint32_t width, uint32_t height);
+
+// Streams the tiles of a .gvt that the screen actually samples into a
+// fixed-size cache texture. Each frame the caller renders the scene once
+// more with the feedback shader between beginFeedback() and
+// endFeedback(), into a target FEEDBACK_DOWNSCALE times smaller than the
+// window. update() reads an older feedback frame back without stalling,
+// queues the missing tiles to worker threads (which copy them out of the
+// mapped file), uploads at most MAX_UPLOADS_PER_FRAME finished tiles and
+// refreshes the page table. Tiles leave the cache least recently seen
+// first; the single coarsest tile is loaded up front and never evicted,
+// so every page always resolves to something.
+class VirtualTexture {
+  public:
+    static const int PHYSICAL_TILES = 16;  // cache slots per side
+    static const int FEEDBACK_DOWNSCALE = 8;
+    static const int MAX_UPLOADS_PER_FRAME = 16;
+
+    struct Stats {
+      uint64_t tilesRequested = 0;  // sent to the workers
+      uint64_t tilesUploaded = 0;
+      uint64_t tilesEvicted = 0;
+      uint64_t bytesUploaded = 0;
+      size_t residentTiles = 0;
+      size_t visibleTiles = 0;      // distinct tiles in the last feedback read
+    };
+
+    VirtualTexture(const std::string& path, unsigned int workerCount = 2);
+    ~VirtualTexture();
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    void bind(GLenum pageTableUnit, GLenum physicalUnit) const;
+    void beginFeedback(int windowWidth, int windowHeight);
+    void endFeedback();
+    void update();
+
+    // uniform values for the VIRTUAL_TEXTURE_COMMON shader block
+    float imageScaleX() const { return (float)header.width / virtualSize(); }
+    float imageScaleY() const { return (float)header.height / virtualSize(); }
+    float virtualSize() const { return (float)header.pages * header.tileSize; }
+    float maxLevel() const { return (float)(header.levelCount - 1); }
+    float tileSize() const { return (float)header.tileSize; }
+    float border() const { return (float)header.border; }
+    const Stats& stats() const { return counters; }
+
+  private:
+    // level << 16 | y << 8 | x
+    using TileKey = uint32_t;
+    struct Tile {
+      int slot;
+      uint64_t lastSeenFrame;
+    };
+    struct LoadedTile {
+      TileKey key;
+      std::vector<unsigned char> texels;
+    };
+    struct ReadbackBuffer {
+      GLuint bufferId = 0;
+      GLsync fence = nullptr;
+      int width = 0, height = 0;
+    };
+    static const int READBACK_BUFFER_COUNT = 3;
+
+    uint32_t levelColumns(uint32_t level) const;
+    uint32_t levelRows(uint32_t level) const;
+    bool tileExists(TileKey key) const;
+    const unsigned char* tileData(TileKey key) const;
+    size_t paddedTileBytes() const;
+    void workerLoop();
+    void readFeedback();
+    void processFeedback(const unsigned char* pixels, int pixelCount);
+    void requestTile(TileKey key);
+    bool uploadTile(const LoadedTile& tile);
+    void refreshPageTable();
+
+    VirtualTextureHeader header;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    std::vector<uint64_t> levelFirstTile;
+
+    GLuint pageTable = 0;
+    GLuint physicalTiles = 0;
+    std::vector<std::vector<uint32_t>> pageTableLevels;
+    bool pageTableDirty = true;
+    std::unordered_map<TileKey, Tile> residentTiles;
+    std::vector<TileKey> slotOwners;  // per cache slot, ~0u when free
+    // queued or loaded but not uploaded yet, touched on the GL thread only
+    std::unordered_set<TileKey> tilesInFlight;
+    uint64_t frame = 0;
+    uint64_t lastFeedbackFrame = 0;
+
+    GLuint feedbackFramebuffer = 0;
+    GLuint feedbackTexture = 0;
+    int feedbackWidth = 0, feedbackHeight = 0;
+    GLint savedViewport[4];
+    ReadbackBuffer readbackBuffers[READBACK_BUFFER_COUNT];
+    int nextReadback = 0;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::deque<TileKey> pendingTiles;
+    std::deque<LoadedTile> loadedTiles;
+    bool stopping = false;
+
+    Stats counters;
+};